@@ -0,0 +1,228 @@
+#include <stdlib.h>
+#include <math.h>
+#include "acq.h"
+#include "convert.h"
+
+
+struct acq* acq_create(const struct acq_config* cfg, struct pool* pool)
+{
+    struct acq* acq;
+    double bin_width = cfg->sample_rate / cfg->n;
+    double freq, residual, *residuals;
+    long whole;
+    size_t i;
+    int b, g, slot;
+
+    acq = calloc(1, sizeof(struct acq));
+    if(!acq)
+        return NULL;
+
+    acq->cfg = *cfg;
+    acq->pool = pool;
+    pool_group_init(&acq->tasks);
+    acq->plan = fft_plan_create(cfg->n);
+    acq->samples = fft_alloc(cfg->n * sizeof(cf32));
+    acq->groups = calloc(cfg->n_doppler, sizeof(struct acq_group));
+    acq->bin_group = calloc(cfg->n_doppler, sizeof(int));
+    acq->bin_shift = calloc(cfg->n_doppler, sizeof(size_t));
+    acq->cells = calloc(cfg->n_doppler * cfg->max_codes,
+                        sizeof(struct acq_cell));
+    acq->work = calloc(pool_slots(pool), sizeof(cf32*));
+    residuals = calloc(cfg->n_doppler, sizeof(double));
+    if(!acq->plan || !acq->samples || !acq->groups || !acq->bin_group ||
+       !acq->bin_shift || !acq->cells || !acq->work || !residuals) {
+        free(residuals);
+        acq_destroy(acq);
+        return NULL;
+    }
+
+    for(slot=0; slot<pool_slots(pool); slot++) {
+        acq->work[slot] = fft_alloc(cfg->n * sizeof(cf32));
+        if(!acq->work[slot]) {
+            free(residuals);
+            acq_destroy(acq);
+            return NULL;
+        }
+    }
+
+    // Split each bin into whole FFT bins and a residual, grouping residuals
+    for(b=0; b<cfg->n_doppler; b++) {
+        freq = cfg->doppler_min + b * cfg->doppler_step;
+        whole = lround(freq / bin_width);
+        residual = freq - whole * bin_width;
+        acq->bin_shift[b] = ((whole % (long)cfg->n) + cfg->n) % cfg->n;
+
+        for(g=0; g<acq->n_groups; g++) {
+            if(fabs(residuals[g] - residual) < 1e-6 * bin_width)
+                break;
+        }
+        acq->bin_group[b] = g;
+        if(g < acq->n_groups)
+            continue;
+
+        residuals[g] = residual;
+        acq->n_groups++;
+        acq->groups[g].acq = acq;
+        acq->groups[g].spectrum = fft_alloc(cfg->n * sizeof(cf32));
+        if(!acq->groups[g].spectrum) {
+            free(residuals);
+            acq_destroy(acq);
+            return NULL;
+        }
+        if(fabs(residual) < 1e-6 * bin_width)
+            continue;
+
+        acq->groups[g].nco = fft_alloc(cfg->n * sizeof(cf32));
+        if(!acq->groups[g].nco) {
+            free(residuals);
+            acq_destroy(acq);
+            return NULL;
+        }
+        for(i=0; i<cfg->n; i++) {
+            acq->groups[g].nco[i].re =
+                cos(-2 * M_PI * residual * i / cfg->sample_rate);
+            acq->groups[g].nco[i].im =
+                sin(-2 * M_PI * residual * i / cfg->sample_rate);
+        }
+    }
+
+    free(residuals);
+    return acq;
+}
+
+
+void acq_destroy(struct acq* acq)
+{
+    int g, slot;
+
+    if(!acq)
+        return;
+    if(acq->groups) {
+        for(g=0; g<acq->n_groups; g++) {
+            free(acq->groups[g].nco);
+            free(acq->groups[g].spectrum);
+        }
+    }
+    if(acq->work) {
+        for(slot=0; slot<pool_slots(acq->pool); slot++)
+            free(acq->work[slot]);
+    }
+    fft_plan_destroy(acq->plan);
+    free(acq->samples);
+    free(acq->groups);
+    free(acq->bin_group);
+    free(acq->bin_shift);
+    free(acq->cells);
+    free(acq->work);
+    free(acq);
+}
+
+
+static void acq_group_fft(void* arg, int slot)
+{
+    struct acq_group* group = arg;
+    struct acq* acq = group->acq;
+    cf32* x = group->spectrum;
+    size_t i;
+
+    for(i=0; i<acq->cfg.n; i++) {
+        if(group->nco) {
+            x[i].re = acq->samples[i].re * group->nco[i].re -
+                      acq->samples[i].im * group->nco[i].im;
+            x[i].im = acq->samples[i].re * group->nco[i].im +
+                      acq->samples[i].im * group->nco[i].re;
+        } else {
+            x[i] = acq->samples[i];
+        }
+    }
+    fft_forward(acq->plan, x);
+}
+
+
+static void acq_cell_search(void* arg, int slot)
+{
+    struct acq_cell* cell = arg;
+    struct acq* acq = cell->acq;
+    size_t i, n = acq->cfg.n, mask = n - 1, shift = acq->bin_shift[cell->bin];
+    const cf32* s = acq->groups[acq->bin_group[cell->bin]].spectrum;
+    const cf32* h = acq->codes[cell->code];
+    cf32* x = acq->work[slot];
+    float power;
+
+    for(i=0; i<n; i++) {
+        x[i].re = s[(i + shift) & mask].re * h[i].re -
+                  s[(i + shift) & mask].im * h[i].im;
+        x[i].im = s[(i + shift) & mask].re * h[i].im +
+                  s[(i + shift) & mask].im * h[i].re;
+    }
+    fft_inverse(acq->plan, x);
+
+    cell->peak = 0.0f;
+    cell->phase = 0;
+    cell->sum = 0.0;
+    for(i=0; i<n; i++) {
+        power = x[i].re * x[i].re + x[i].im * x[i].im;
+        cell->sum += power;
+        if(power > cell->peak) {
+            cell->peak = power;
+            cell->phase = i;
+        }
+    }
+}
+
+
+int acq_search(struct acq* acq, const int16_t* samples,
+               const cf32* const* codes, int n_codes,
+               struct acq_result* results)
+{
+    struct acq_cell* cell;
+    struct acq_cell* best;
+    double sum;
+    int b, c, g;
+
+    if(n_codes > acq->cfg.max_codes)
+        return 1;
+
+    sc16_to_cf32(samples, acq->samples, acq->cfg.n, 1.0f / 2048.0f);
+    acq->codes = codes;
+
+    for(g=0; g<acq->n_groups; g++)
+        pool_submit_group(acq->pool, &acq->tasks, acq_group_fft,
+                          &acq->groups[g]);
+    pool_wait_group(acq->pool, &acq->tasks);
+
+    for(b=0; b<acq->cfg.n_doppler; b++) {
+        for(c=0; c<n_codes; c++) {
+            cell = &acq->cells[b * n_codes + c];
+            cell->acq = acq;
+            cell->bin = b;
+            cell->code = c;
+            pool_submit_group(acq->pool, &acq->tasks, acq_cell_search,
+                              cell);
+        }
+    }
+    pool_wait_group(acq->pool, &acq->tasks);
+
+    for(c=0; c<n_codes; c++) {
+        best = &acq->cells[c];
+        sum = 0.0;
+        for(b=0; b<acq->cfg.n_doppler; b++) {
+            cell = &acq->cells[b * n_codes + c];
+            sum += cell->sum;
+            if(cell->peak > best->peak)
+                best = cell;
+        }
+
+        results[c].doppler = acq->cfg.doppler_min +
+                             best->bin * acq->cfg.doppler_step;
+        results[c].code_phase = best->phase;
+        results[c].peak = best->peak;
+        results[c].metric = sum > 0.0 ?
+            best->peak / (sum / ((double)acq->cfg.n * acq->cfg.n_doppler)) :
+            0.0f;
+        results[c].detected = results[c].metric >= acq->cfg.threshold;
+    }
+
+    acq->codes = NULL;
+    return 0;
+}
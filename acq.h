@@ -0,0 +1,88 @@
+#ifndef ACQ_H
+#define ACQ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "fft.h"
+#include "pool.h"
+
+/*
+ * Code phase x Doppler acquisition, the C version of gcsearch.py's
+ * codeParallelSearchForSattelite.
+ *
+ * Each Doppler bin's frequency is split into a whole number of FFT bins
+ * plus a residual. Bins sharing a residual share one FFT of the samples,
+ * mixed down by the residual with a precomputed NCO table; the whole-bin
+ * part is then a circular shift of that spectrum. Each bin and code is
+ * correlated as a separate task on the worker pool, which keeps only the
+ * peak and total power of its correlation, never the full grid.
+ */
+
+// Search grid, as gcsearch.py's, and detection threshold radar uses
+#define ACQ_DOPPLER_MIN       -10000
+#define ACQ_DOPPLER_STEP      500
+#define ACQ_N_DOPPLER         40
+#define ACQ_THRESHOLD         20.0f
+
+struct acq_config {
+    size_t n;               // Samples searched, a power of two
+    double sample_rate;     // In S/s
+    double doppler_min;     // Lowest Doppler bin, in Hz
+    double doppler_step;    // In Hz
+    int    n_doppler;
+    int    max_codes;       // Most codes searched in one pass
+    float  threshold;       // Peak to mean power ratio for a detection
+};
+
+struct acq_result {
+    bool   detected;
+    double doppler;         // In Hz
+    size_t code_phase;      // In samples
+    float  peak;            // Correlation power at the peak
+    float  metric;          // Peak to mean power ratio
+};
+
+struct acq_group {
+    struct acq* acq;
+    cf32*       nco;        // exp(-j 2 pi residual t), NULL if residual 0
+    cf32*       spectrum;   // FFT of the samples mixed with nco
+};
+
+struct acq_cell {
+    struct acq* acq;
+    int         bin;
+    int         code;
+    float       peak;
+    size_t      phase;
+    double      sum;        // Total power over all code phases
+};
+
+struct acq {
+    struct acq_config cfg;
+    struct pool*      pool;
+    struct pool_group tasks;        // Waited for apart from others'
+    struct fft_plan*  plan;
+    cf32*             samples;
+    struct acq_group* groups;
+    int               n_groups;
+    int*              bin_group;
+    size_t*           bin_shift;    // Whole FFT bins, taken modulo n
+    struct acq_cell*  cells;        // n_doppler * max_codes
+    cf32**            work;         // One buffer per pool slot
+    const cf32* const* codes;       // Set for the duration of a search
+};
+
+struct acq* acq_create(const struct acq_config* cfg, struct pool* pool);
+void acq_destroy(struct acq* acq);
+
+/*
+ * Search cfg.n SC16 I/Q samples for each of n_codes code spectra, in the
+ * form corr_code_spectrum gives, writing one result per code.
+ * Returns 0 on success or 1 if n_codes is more than cfg.max_codes.
+ */
+int acq_search(struct acq* acq, const int16_t* samples,
+               const cf32* const* codes, int n_codes,
+               struct acq_result* results);
+
+#endif
@@ -0,0 +1,169 @@
+#include <string.h>
+#include "backend.h"
+
+static const struct radio_backend* backends[] = {
+#ifndef NO_BLADERF
+    &radio_backend_bladerf,
+#endif
+    &radio_backend_sim,
+    NULL
+};
+
+
+const struct radio_backend* radio_find_backend(const char* spec,
+                                               const char** args)
+{
+    size_t i, len;
+    const char* colon;
+
+    colon = strchr(spec, ':');
+    len = colon ? (size_t)(colon - spec) : strlen(spec);
+    *args = colon ? colon + 1 : NULL;
+
+    for(i=0; backends[i]; i++) {
+        if(strlen(backends[i]->name) == len &&
+           strncmp(backends[i]->name, spec, len) == 0)
+            return backends[i];
+    }
+
+    return NULL;
+}
+
+
+const char* radio_strerror(const struct radio_backend* backend, int status)
+{
+    switch(status) {
+        case RADIO_ERR_UNEXPECTED: return "Unexpected error";
+        case RADIO_ERR_MEM:        return "Out of memory";
+        case RADIO_ERR_INVAL:      return "Invalid argument";
+        case RADIO_ERR_IO:         return "I/O error";
+        case RADIO_ERR_NOT_READY:  return "Device not ready (FPGA not loaded)";
+        case RADIO_ERR_NO_BACKEND: return "No such backend";
+        case RADIO_ERR_SYNC:       return "Could not tie TX time to RX time";
+    }
+
+    if(backend)
+        return backend->strerror(status);
+
+    return "Unknown error";
+}
+
+
+int radio_open(const struct radio_backend* backend, struct radio_dev** dev,
+               const char* args)
+{
+    if(!backend)
+        return RADIO_ERR_NO_BACKEND;
+    return backend->open(dev, args);
+}
+
+
+void radio_close(struct radio_dev* dev)
+{
+    dev->backend->close(dev);
+}
+
+
+int radio_tune(struct radio_dev* dev, radio_module module, unsigned int freq)
+{
+    return dev->backend->tune(dev, module, freq);
+}
+
+
+int radio_set_bandwidth(struct radio_dev* dev, radio_module module,
+                        unsigned int bw, unsigned int* actual)
+{
+    return dev->backend->set_bandwidth(dev, module, bw, actual);
+}
+
+
+int radio_set_sample_rate(struct radio_dev* dev, radio_module module,
+                          unsigned int sr, unsigned int* actual)
+{
+    return dev->backend->set_sample_rate(dev, module, sr, actual);
+}
+
+
+int radio_set_gain(struct radio_dev* dev, radio_gain gain, int value)
+{
+    return dev->backend->set_gain(dev, gain, value);
+}
+
+
+int radio_get_frequency(struct radio_dev* dev, radio_module module,
+                        unsigned int* freq)
+{
+    return dev->backend->get_frequency(dev, module, freq);
+}
+
+
+int radio_get_bandwidth(struct radio_dev* dev, radio_module module,
+                        unsigned int* bw)
+{
+    return dev->backend->get_bandwidth(dev, module, bw);
+}
+
+
+int radio_get_sample_rate(struct radio_dev* dev, radio_module module,
+                          unsigned int* sr)
+{
+    return dev->backend->get_sample_rate(dev, module, sr);
+}
+
+
+int radio_get_gain(struct radio_dev* dev, radio_gain gain, int* value)
+{
+    return dev->backend->get_gain(dev, gain, value);
+}
+
+
+int radio_enable(struct radio_dev* dev, radio_module module, bool enabled)
+{
+    return dev->backend->enable(dev, module, enabled);
+}
+
+
+int radio_get_time(struct radio_dev* dev, uint64_t* time)
+{
+    return dev->backend->get_time(dev, time);
+}
+
+
+int radio_get_tx_window(struct radio_dev* dev, uint64_t* window)
+{
+    *window = 0;
+    if(!dev->backend->get_tx_window)
+        return 0;
+    return dev->backend->get_tx_window(dev, window);
+}
+
+
+int radio_init_stream(struct radio_stream** stream, struct radio_dev* dev,
+                      radio_module module, radio_stream_cb cb,
+                      void*** buffers, size_t num_buffers,
+                      size_t samples_per_buffer, size_t num_transfers,
+                      void* user_data)
+{
+    return dev->backend->init_stream(stream, dev, module, cb, buffers,
+                                     num_buffers, samples_per_buffer,
+                                     num_transfers, user_data);
+}
+
+
+int radio_stream(struct radio_stream* stream, radio_module module)
+{
+    return stream->dev->backend->stream(stream, module);
+}
+
+
+int radio_stream_at(struct radio_stream* stream, radio_module module,
+                    uint64_t time)
+{
+    return stream->dev->backend->stream_at(stream, module, time);
+}
+
+
+void radio_deinit_stream(struct radio_stream* stream)
+{
+    stream->dev->backend->deinit_stream(stream);
+}
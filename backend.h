@@ -0,0 +1,157 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Radio backend interface.
+ *
+ * Everything main.c needs from a radio goes through a struct radio_backend,
+ * so the streaming and processing paths can run against real hardware
+ * (libbladeRF) or against the software stand-in in backend_sim.c.
+ *
+ * Backends embed struct radio_dev / struct radio_stream as the first member
+ * of their own device and stream structs.
+ *
+ * Device time is counted in RX samples. Streams started with stream_at send
+ * or receive their first sample at a given device time, so a TX and an RX
+ * stream given the same time line up to the sample, run after run.
+ */
+
+typedef enum {
+    RADIO_MODULE_RX,
+    RADIO_MODULE_TX
+} radio_module;
+
+typedef enum {
+    RADIO_GAIN_TXVGA1,
+    RADIO_GAIN_TXVGA2,
+    RADIO_GAIN_RXVGA1,
+    RADIO_GAIN_RXVGA2,
+    RADIO_GAIN_LNA
+} radio_gain;
+
+// LNA gain settings, same values as bladerf_lna_gain
+#define RADIO_LNA_GAIN_BYPASS 1
+#define RADIO_LNA_GAIN_MID    2
+#define RADIO_LNA_GAIN_MAX    3
+
+// Backend-independent error codes, kept clear of libbladeRF's own range
+#define RADIO_ERR_UNEXPECTED  (-1000)
+#define RADIO_ERR_MEM         (-1001)
+#define RADIO_ERR_INVAL       (-1002)
+#define RADIO_ERR_IO          (-1003)
+#define RADIO_ERR_NOT_READY   (-1004)
+#define RADIO_ERR_NO_BACKEND  (-1005)
+#define RADIO_ERR_SYNC        (-1006)
+
+struct radio_backend;
+
+struct radio_dev {
+    const struct radio_backend* backend;
+};
+
+struct radio_stream {
+    struct radio_dev* dev;
+};
+
+/*
+ * Called once per completed transfer with the buffer just filled (RX) or
+ * sent (TX), and returns the next buffer to submit, or NULL to stop.
+ * As with libbladeRF, TX streams call it num_transfers times up front with
+ * samples == NULL to collect the initial buffers. For RX, n_lost is the
+ * number of samples the device lost just before this buffer, always a whole
+ * number of buffers, so buffers stay where they would have been in device
+ * time; it is 0 for TX.
+ */
+typedef void* (*radio_stream_cb)(struct radio_stream* stream, void* samples,
+                                 size_t n_samples, size_t n_lost,
+                                 void* user_data);
+
+struct radio_backend {
+    const char* name;
+    int  (*open)(struct radio_dev** dev, const char* args);
+    void (*close)(struct radio_dev* dev);
+    int  (*tune)(struct radio_dev* dev, radio_module module,
+                 unsigned int freq);
+    int  (*set_bandwidth)(struct radio_dev* dev, radio_module module,
+                          unsigned int bw, unsigned int* actual);
+    int  (*set_sample_rate)(struct radio_dev* dev, radio_module module,
+                            unsigned int sr, unsigned int* actual);
+    int  (*set_gain)(struct radio_dev* dev, radio_gain gain, int value);
+
+    // Read back the current setting
+    int  (*get_frequency)(struct radio_dev* dev, radio_module module,
+                          unsigned int* freq);
+    int  (*get_bandwidth)(struct radio_dev* dev, radio_module module,
+                          unsigned int* bw);
+    int  (*get_sample_rate)(struct radio_dev* dev, radio_module module,
+                            unsigned int* sr);
+    int  (*get_gain)(struct radio_dev* dev, radio_gain gain, int* value);
+
+    int  (*enable)(struct radio_dev* dev, radio_module module, bool enabled);
+    int  (*get_time)(struct radio_dev* dev, uint64_t* time);
+    // Optional: the uncertainty, in RX samples, with which the last TX
+    // stream's start was placed in device time
+    int  (*get_tx_window)(struct radio_dev* dev, uint64_t* window);
+    int  (*init_stream)(struct radio_stream** stream, struct radio_dev* dev,
+                        radio_module module, radio_stream_cb cb,
+                        void*** buffers, size_t num_buffers,
+                        size_t samples_per_buffer, size_t num_transfers,
+                        void* user_data);
+    int  (*stream)(struct radio_stream* stream, radio_module module);
+    int  (*stream_at)(struct radio_stream* stream, radio_module module,
+                      uint64_t time);
+    void (*deinit_stream)(struct radio_stream* stream);
+    const char* (*strerror)(int status);
+};
+
+extern const struct radio_backend radio_backend_sim;
+#ifndef NO_BLADERF
+extern const struct radio_backend radio_backend_bladerf;
+#endif
+
+/*
+ * Look up a backend from a device spec of the form "name[:args]", e.g.
+ * "bladerf", "bladerf:*:serial=f12ce1", "sim:delay=200,noise=8".
+ * *args is pointed at the part after the colon, or NULL.
+ * Returns NULL if no backend matches.
+ */
+const struct radio_backend* radio_find_backend(const char* spec,
+                                               const char** args);
+
+const char* radio_strerror(const struct radio_backend* backend, int status);
+
+int  radio_open(const struct radio_backend* backend, struct radio_dev** dev,
+                const char* args);
+void radio_close(struct radio_dev* dev);
+int  radio_tune(struct radio_dev* dev, radio_module module, unsigned int freq);
+int  radio_set_bandwidth(struct radio_dev* dev, radio_module module,
+                         unsigned int bw, unsigned int* actual);
+int  radio_set_sample_rate(struct radio_dev* dev, radio_module module,
+                           unsigned int sr, unsigned int* actual);
+int  radio_set_gain(struct radio_dev* dev, radio_gain gain, int value);
+int  radio_get_frequency(struct radio_dev* dev, radio_module module,
+                         unsigned int* freq);
+int  radio_get_bandwidth(struct radio_dev* dev, radio_module module,
+                         unsigned int* bw);
+int  radio_get_sample_rate(struct radio_dev* dev, radio_module module,
+                           unsigned int* sr);
+int  radio_get_gain(struct radio_dev* dev, radio_gain gain, int* value);
+int  radio_enable(struct radio_dev* dev, radio_module module, bool enabled);
+int  radio_get_time(struct radio_dev* dev, uint64_t* time);
+/* 0 for backends where TX and RX share one clock */
+int  radio_get_tx_window(struct radio_dev* dev, uint64_t* window);
+int  radio_init_stream(struct radio_stream** stream, struct radio_dev* dev,
+                       radio_module module, radio_stream_cb cb,
+                       void*** buffers, size_t num_buffers,
+                       size_t samples_per_buffer, size_t num_transfers,
+                       void* user_data);
+int  radio_stream(struct radio_stream* stream, radio_module module);
+int  radio_stream_at(struct radio_stream* stream, radio_module module,
+                     uint64_t time);
+void radio_deinit_stream(struct radio_stream* stream);
+
+#endif
@@ -0,0 +1,482 @@
+#include <stdlib.h>
+#include <string.h>
+#include "libbladeRF.h"
+#include "backend.h"
+#include "rt.h"
+
+/*
+ * libbladeRF backend: a thin shim mapping the radio_backend calls straight
+ * onto the libbladeRF API.
+ *
+ * Streams run on the synchronous interface with metadata, so that the
+ * first sample can be tied to a hardware timestamp. Device time is the RX
+ * timestamp counter. TX has a counter of its own at the TX sample rate;
+ * its offset from the RX counter is measured by reading TX between two RX
+ * reads just before a TX stream is scheduled. The reads are repeated until
+ * the two RX reads are within BRF_SYNC_WINDOW samples of each other, so
+ * that the TX start is known to within half that.
+ */
+
+#define BRF_TIMEOUT_MS   3500
+
+// How far ahead of now an unscheduled stream is started, in seconds
+#define BRF_START_MARGIN 0.01
+
+// Widest gap between the RX reads either side of the TX one, in RX samples,
+// and how many goes there are at getting it that narrow
+#define BRF_SYNC_WINDOW  4
+#define BRF_SYNC_TRIES   100
+
+struct brf_dev {
+    struct radio_dev base;
+    struct bladerf* dev;
+    uint64_t tx_window;     // Narrowest RX read gap at the last TX schedule
+};
+
+struct brf_stream {
+    struct radio_stream base;
+    void** buffers;
+    size_t num_buffers;
+    size_t samples_per_buffer;
+    size_t num_transfers;
+    radio_stream_cb cb;
+    void* user_data;
+};
+
+
+static bladerf_module brf_module(radio_module module)
+{
+    return module == RADIO_MODULE_TX ? BLADERF_MODULE_TX : BLADERF_MODULE_RX;
+}
+
+
+static int brf_open(struct radio_dev** dev, const char* args)
+{
+    struct brf_dev* bdev;
+    int status;
+
+    bdev = calloc(1, sizeof(struct brf_dev));
+    if(!bdev)
+        return RADIO_ERR_MEM;
+    bdev->base.backend = &radio_backend_bladerf;
+
+    status = bladerf_open(&bdev->dev, args && args[0] ? args : NULL);
+    if(status) {
+        free(bdev);
+        return status;
+    }
+
+    status = bladerf_is_fpga_configured(bdev->dev);
+    if(status <= 0) {
+        bladerf_close(bdev->dev);
+        free(bdev);
+        return status < 0 ? status : RADIO_ERR_NOT_READY;
+    }
+
+    *dev = &bdev->base;
+    return 0;
+}
+
+
+static void brf_close(struct radio_dev* dev)
+{
+    struct brf_dev* bdev = (struct brf_dev*)dev;
+    bladerf_close(bdev->dev);
+    free(bdev);
+}
+
+
+static int brf_tune(struct radio_dev* dev, radio_module module,
+                    unsigned int freq)
+{
+    struct brf_dev* bdev = (struct brf_dev*)dev;
+    return bladerf_set_frequency(bdev->dev, brf_module(module), freq);
+}
+
+
+static int brf_set_bandwidth(struct radio_dev* dev, radio_module module,
+                             unsigned int bw, unsigned int* actual)
+{
+    struct brf_dev* bdev = (struct brf_dev*)dev;
+    return bladerf_set_bandwidth(bdev->dev, brf_module(module), bw, actual);
+}
+
+
+static int brf_set_sample_rate(struct radio_dev* dev, radio_module module,
+                               unsigned int sr, unsigned int* actual)
+{
+    struct brf_dev* bdev = (struct brf_dev*)dev;
+    return bladerf_set_sample_rate(bdev->dev, brf_module(module), sr, actual);
+}
+
+
+static int brf_set_gain(struct radio_dev* dev, radio_gain gain, int value)
+{
+    struct brf_dev* bdev = (struct brf_dev*)dev;
+
+    switch(gain) {
+        case RADIO_GAIN_TXVGA1: return bladerf_set_txvga1(bdev->dev, value);
+        case RADIO_GAIN_TXVGA2: return bladerf_set_txvga2(bdev->dev, value);
+        case RADIO_GAIN_RXVGA1: return bladerf_set_rxvga1(bdev->dev, value);
+        case RADIO_GAIN_RXVGA2: return bladerf_set_rxvga2(bdev->dev, value);
+        case RADIO_GAIN_LNA:
+            return bladerf_set_lna_gain(bdev->dev, (bladerf_lna_gain)value);
+    }
+
+    return RADIO_ERR_INVAL;
+}
+
+
+static int brf_get_frequency(struct radio_dev* dev, radio_module module,
+                             unsigned int* freq)
+{
+    struct brf_dev* bdev = (struct brf_dev*)dev;
+    return bladerf_get_frequency(bdev->dev, brf_module(module), freq);
+}
+
+
+static int brf_get_bandwidth(struct radio_dev* dev, radio_module module,
+                             unsigned int* bw)
+{
+    struct brf_dev* bdev = (struct brf_dev*)dev;
+    return bladerf_get_bandwidth(bdev->dev, brf_module(module), bw);
+}
+
+
+static int brf_get_sample_rate(struct radio_dev* dev, radio_module module,
+                               unsigned int* sr)
+{
+    struct brf_dev* bdev = (struct brf_dev*)dev;
+    return bladerf_get_sample_rate(bdev->dev, brf_module(module), sr);
+}
+
+
+static int brf_get_gain(struct radio_dev* dev, radio_gain gain, int* value)
+{
+    struct brf_dev* bdev = (struct brf_dev*)dev;
+    bladerf_lna_gain lna;
+    int status;
+
+    switch(gain) {
+        case RADIO_GAIN_TXVGA1: return bladerf_get_txvga1(bdev->dev, value);
+        case RADIO_GAIN_TXVGA2: return bladerf_get_txvga2(bdev->dev, value);
+        case RADIO_GAIN_RXVGA1: return bladerf_get_rxvga1(bdev->dev, value);
+        case RADIO_GAIN_RXVGA2: return bladerf_get_rxvga2(bdev->dev, value);
+        case RADIO_GAIN_LNA:
+            status = bladerf_get_lna_gain(bdev->dev, &lna);
+            *value = lna;
+            return status;
+    }
+
+    return RADIO_ERR_INVAL;
+}
+
+
+static int brf_enable(struct radio_dev* dev, radio_module module,
+                      bool enabled)
+{
+    struct brf_dev* bdev = (struct brf_dev*)dev;
+    return bladerf_enable_module(bdev->dev, brf_module(module), enabled);
+}
+
+
+static int brf_get_time(struct radio_dev* dev, uint64_t* time)
+{
+    struct brf_dev* bdev = (struct brf_dev*)dev;
+    return bladerf_get_timestamp(bdev->dev, BLADERF_MODULE_RX, time);
+}
+
+
+static int brf_get_tx_window(struct radio_dev* dev, uint64_t* window)
+{
+    struct brf_dev* bdev = (struct brf_dev*)dev;
+    *window = bdev->tx_window;
+    return 0;
+}
+
+
+/* Convert device time to the TX timestamp counter */
+static int brf_tx_timestamp(struct brf_dev* bdev, uint64_t time,
+                            uint64_t* timestamp)
+{
+    unsigned int tx_sr, rx_sr;
+    uint64_t rx0, rx1, tx, rx_mid = 0, tx_mid = 0;
+    int i, status;
+
+    status = bladerf_get_sample_rate(bdev->dev, BLADERF_MODULE_TX, &tx_sr);
+    if(!status)
+        status = bladerf_get_sample_rate(bdev->dev, BLADERF_MODULE_RX, &rx_sr);
+    if(status)
+        return status;
+
+    // Keep the narrowest of the tries; tx was read halfway between rx0 and
+    // rx1, as near as we can tell, so it is out by up to half the gap
+    bdev->tx_window = UINT64_MAX;
+    for(i=0; i<BRF_SYNC_TRIES && bdev->tx_window > BRF_SYNC_WINDOW; i++) {
+        status = bladerf_get_timestamp(bdev->dev, BLADERF_MODULE_RX, &rx0);
+        if(!status)
+            status = bladerf_get_timestamp(bdev->dev, BLADERF_MODULE_TX, &tx);
+        if(!status)
+            status = bladerf_get_timestamp(bdev->dev, BLADERF_MODULE_RX,
+                                           &rx1);
+        if(status)
+            return status;
+        if(rx1 - rx0 < bdev->tx_window) {
+            bdev->tx_window = rx1 - rx0;
+            rx_mid = rx0 + (rx1 - rx0) / 2;
+            tx_mid = tx;
+        }
+    }
+    if(bdev->tx_window > BRF_SYNC_WINDOW)
+        return RADIO_ERR_SYNC;
+
+    if(time < rx_mid)
+        return RADIO_ERR_INVAL;
+    *timestamp = tx_mid + (time - rx_mid) * tx_sr / rx_sr;
+    return 0;
+}
+
+
+static int brf_init_stream(struct radio_stream** stream,
+                           struct radio_dev* dev, radio_module module,
+                           radio_stream_cb cb, void*** buffers,
+                           size_t num_buffers, size_t samples_per_buffer,
+                           size_t num_transfers, void* user_data)
+{
+    struct brf_dev* bdev = (struct brf_dev*)dev;
+    struct brf_stream* bstream;
+    size_t i;
+    int status;
+
+    if(num_buffers == 0 || num_transfers == 0 || num_transfers > num_buffers
+       || samples_per_buffer == 0)
+        return RADIO_ERR_INVAL;
+
+    bstream = calloc(1, sizeof(struct brf_stream));
+    if(!bstream)
+        return RADIO_ERR_MEM;
+    bstream->base.dev = dev;
+    bstream->cb = cb;
+    bstream->user_data = user_data;
+    bstream->num_buffers = num_buffers;
+    bstream->samples_per_buffer = samples_per_buffer;
+    bstream->num_transfers = num_transfers;
+
+    bstream->buffers = calloc(num_buffers, sizeof(void*));
+    if(!bstream->buffers) {
+        free(bstream);
+        return RADIO_ERR_MEM;
+    }
+    for(i=0; i<num_buffers; i++) {
+        bstream->buffers[i] = rt_alloc(samples_per_buffer * 2 *
+                                       sizeof(int16_t));
+        if(!bstream->buffers[i]) {
+            while(i--)
+                rt_free(bstream->buffers[i]);
+            free(bstream->buffers);
+            free(bstream);
+            return RADIO_ERR_MEM;
+        }
+    }
+
+    // The sync interface keeps its own transfers, one more buffer than
+    // it has in flight so it always has one to hand back
+    status = bladerf_sync_config(bdev->dev, brf_module(module),
+                                 BLADERF_FORMAT_SC16_Q11_META,
+                                 num_transfers + 1, samples_per_buffer,
+                                 num_transfers, BRF_TIMEOUT_MS);
+    if(status) {
+        for(i=0; i<num_buffers; i++)
+            rt_free(bstream->buffers[i]);
+        free(bstream->buffers);
+        free(bstream);
+        return status;
+    }
+
+    *buffers = bstream->buffers;
+    *stream = &bstream->base;
+    return 0;
+}
+
+
+static int brf_stream_tx(struct brf_stream* bstream, uint64_t timestamp)
+{
+    struct brf_dev* bdev = (struct brf_dev*)bstream->base.dev;
+    struct bladerf_metadata meta;
+    void** inflight;
+    void* buf;
+    void* zeros;
+    size_t i, head = 0, n_inflight = 0, spb = bstream->samples_per_buffer;
+    int status = 0;
+
+    inflight = calloc(bstream->num_transfers, sizeof(void*));
+    zeros = calloc(spb, 2 * sizeof(int16_t));
+    if(!inflight || !zeros) {
+        free(inflight);
+        free(zeros);
+        return RADIO_ERR_MEM;
+    }
+
+    for(i=0; i<bstream->num_transfers; i++) {
+        buf = bstream->cb(&bstream->base, NULL, 0, 0, bstream->user_data);
+        if(!buf)
+            break;
+        inflight[n_inflight++] = buf;
+    }
+
+    // One burst from timestamp on, closed with a buffer of zeros
+    memset(&meta, 0, sizeof(meta));
+    meta.flags = BLADERF_META_FLAG_TX_BURST_START;
+    meta.timestamp = timestamp;
+    while(n_inflight) {
+        buf = inflight[head];
+        status = bladerf_sync_tx(bdev->dev, buf, spb, &meta, BRF_TIMEOUT_MS);
+        if(status)
+            break;
+        meta.flags = 0;
+
+        buf = bstream->cb(&bstream->base, buf, spb, 0, bstream->user_data);
+        if(!buf)
+            break;
+        inflight[head] = buf;
+        head = (head + 1) % n_inflight;
+    }
+
+    if(n_inflight && !status) {
+        meta.flags = BLADERF_META_FLAG_TX_BURST_END;
+        status = bladerf_sync_tx(bdev->dev, zeros, spb, &meta,
+                                 BRF_TIMEOUT_MS);
+    }
+
+    free(zeros);
+    free(inflight);
+    return status;
+}
+
+
+static int brf_stream_rx(struct brf_stream* bstream, uint64_t timestamp)
+{
+    struct brf_dev* bdev = (struct brf_dev*)bstream->base.dev;
+    struct bladerf_metadata meta;
+    void** inflight;
+    void* buf;
+    size_t head = 0, spb = bstream->samples_per_buffer;
+    size_t n_inflight = bstream->num_transfers;
+    uint64_t next = timestamp, end;
+    int status;
+
+    inflight = calloc(n_inflight, sizeof(void*));
+    if(!inflight)
+        return RADIO_ERR_MEM;
+    memcpy(inflight, bstream->buffers, n_inflight * sizeof(void*));
+
+    // Start at timestamp, then carry on from wherever the last read ended,
+    // which should be next, the start of the buffer after the last one
+    memset(&meta, 0, sizeof(meta));
+    meta.timestamp = timestamp;
+    for(;;) {
+        buf = inflight[head];
+        status = bladerf_sync_rx(bdev->dev, buf, spb, &meta, BRF_TIMEOUT_MS);
+        if(status)
+            break;
+        meta.flags = BLADERF_META_FLAG_RX_NOW;
+
+        // After an overrun or a gap, read and throw away samples up to the
+        // next buffer boundary, so that what is lost is whole buffers and
+        // the callback can say how many
+        if(meta.status & BLADERF_META_STATUS_OVERRUN ||
+           meta.actual_count != spb || meta.timestamp < next ||
+           (meta.timestamp - next) % spb) {
+            end = meta.timestamp + meta.actual_count;
+            if(end > next && (end - next) % spb) {
+                status = bladerf_sync_rx(bdev->dev, buf,
+                                         spb - (end - next) % spb, &meta,
+                                         BRF_TIMEOUT_MS);
+                if(status)
+                    break;
+            }
+            continue;
+        }
+
+        buf = bstream->cb(&bstream->base, buf, spb, meta.timestamp - next,
+                          bstream->user_data);
+        next = meta.timestamp + spb;
+        if(!buf)
+            break;
+        inflight[head] = buf;
+        head = (head + 1) % n_inflight;
+    }
+
+    free(inflight);
+    return status;
+}
+
+
+static int brf_stream_at(struct radio_stream* stream, radio_module module,
+                         uint64_t time)
+{
+    struct brf_stream* bstream = (struct brf_stream*)stream;
+    uint64_t timestamp;
+    int status;
+
+    if(module == RADIO_MODULE_RX)
+        return brf_stream_rx(bstream, time);
+
+    status = brf_tx_timestamp((struct brf_dev*)stream->dev, time, &timestamp);
+    if(status)
+        return status;
+    return brf_stream_tx(bstream, timestamp);
+}
+
+
+static int brf_stream(struct radio_stream* stream, radio_module module)
+{
+    struct brf_dev* bdev = (struct brf_dev*)stream->dev;
+    unsigned int sr;
+    uint64_t now;
+    int status;
+
+    status = bladerf_get_sample_rate(bdev->dev, BLADERF_MODULE_RX, &sr);
+    if(!status)
+        status = brf_get_time(stream->dev, &now);
+    if(status)
+        return status;
+
+    return brf_stream_at(stream, module,
+                         now + (uint64_t)(BRF_START_MARGIN * sr));
+}
+
+
+static void brf_deinit_stream(struct radio_stream* stream)
+{
+    struct brf_stream* bstream = (struct brf_stream*)stream;
+    size_t i;
+
+    for(i=0; i<bstream->num_buffers; i++)
+        rt_free(bstream->buffers[i]);
+    free(bstream->buffers);
+    free(bstream);
+}
+
+
+const struct radio_backend radio_backend_bladerf = {
+    .name            = "bladerf",
+    .open            = brf_open,
+    .close           = brf_close,
+    .tune            = brf_tune,
+    .set_bandwidth   = brf_set_bandwidth,
+    .set_sample_rate = brf_set_sample_rate,
+    .set_gain        = brf_set_gain,
+    .get_frequency   = brf_get_frequency,
+    .get_bandwidth   = brf_get_bandwidth,
+    .get_sample_rate = brf_get_sample_rate,
+    .get_gain        = brf_get_gain,
+    .enable          = brf_enable,
+    .get_time        = brf_get_time,
+    .get_tx_window   = brf_get_tx_window,
+    .init_stream     = brf_init_stream,
+    .stream          = brf_stream,
+    .stream_at       = brf_stream_at,
+    .deinit_stream   = brf_deinit_stream,
+    .strerror        = bladerf_strerror,
+};
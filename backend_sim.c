@@ -0,0 +1,796 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include "backend.h"
+#include "capture.h"
+#include "convert.h"
+#include "rt.h"
+
+/*
+ * Software stand-in for a bladeRF, so the streaming and processing paths can
+ * be run and profiled without hardware.
+ *
+ * The RX side either replays a recorded capture (replay=FILE, looped, with
+ * any dropped stretches closed up and SC12 captures kept packed in memory;
+ * files without a capture header are taken as raw interleaved I/Q), or
+ * plays back whatever the TX stream sent, delayed by delay=N RX samples,
+ * attenuated by atten=DB and with gaussian noise of noise=RMS LSBs added.
+ * lose=N loses every Nth RX buffer, as an overrun on hardware would.
+ * TX samples are held for rx_sr/tx_sr RX samples, as the real RX would see.
+ * Device time runs from when the device was opened, and a stream started
+ * without a time starts at whatever the time is then, so as on hardware
+ * the TX to RX offset depends on thread start-up unless both are scheduled.
+ *
+ * Streams are paced to the configured sample rate unless "fast" is given,
+ * in which case they run as fast as the callbacks allow.
+ *
+ * Example device spec: "sim:delay=300,atten=20,noise=4,fast"
+ */
+
+#define SIM_LOOP_SAMPLES  (1 << 20)
+#define SIM_NOISE_SAMPLES (1 << 16)
+#define SIM_WAIT_NS       100000000L
+
+enum { SIM_TX_IDLE, SIM_TX_RUNNING, SIM_TX_DONE };
+
+struct sim_dev {
+    struct radio_dev base;
+
+    uint8_t*     replay;            // Replayed capture, as in the file
+    uint32_t     replay_format;     // CAPTURE_FORMAT_*
+    size_t       replay_samples;
+    size_t       delay;             // Loopback delay, in RX samples
+    int          gain_q15;          // Loopback attenuation as a Q15 gain
+    double       noise;             // Noise RMS, in LSBs
+    int16_t*     noise_table;       // SIM_NOISE_SAMPLES gaussian I/Q pairs
+    bool         fast;              // No real-time pacing
+    unsigned long lose;             // Lose every lose'th RX buffer, 0 never
+
+    unsigned int freq[2];
+    unsigned int bw[2];
+    unsigned int sr[2];
+    int          gain[5];
+    bool         enabled[2];
+
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    int16_t*        loop;           // TX history, SIM_LOOP_SAMPLES I/Q pairs
+    struct timespec epoch;          // Device time 0, on CLOCK_MONOTONIC
+    uint64_t        tx_start;       // Device time of the first TX sample
+    uint64_t        tx_count;       // TX samples written into loop
+    uint64_t        rx_need;        // Oldest TX sample RX still has to read
+    int             tx_state;
+    bool            rx_running;
+};
+
+struct sim_stream {
+    struct radio_stream base;
+    radio_stream_cb     cb;
+    void*               user_data;
+    void**              buffers;
+    size_t              num_buffers;
+    size_t              samples_per_buffer;
+    size_t              num_transfers;
+    uint32_t            rng;
+};
+
+
+static uint32_t sim_rand(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+
+// Read every frame of a capture file, in order, into sdev->replay
+static int sim_load_capture(struct sim_dev* sdev, FILE* fin,
+                            const struct capture_header* header)
+{
+    struct capture_index* index;
+    size_t i, pos = 0, size = capture_sample_size(header->format);
+    int status = 0;
+
+    if(!header->index_offset || !header->n_frames)
+        return RADIO_ERR_INVAL;
+
+    index = malloc(header->n_frames * sizeof(struct capture_index));
+    if(!index)
+        return RADIO_ERR_MEM;
+    if(fseek(fin, header->index_offset, SEEK_SET) ||
+       fread(index, sizeof(struct capture_index), header->n_frames, fin)
+       != header->n_frames) {
+        free(index);
+        return RADIO_ERR_IO;
+    }
+
+    sdev->replay_samples = 0;
+    for(i=0; i<header->n_frames; i++)
+        sdev->replay_samples += index[i].n_samples;
+    if(sdev->replay_samples == 0) {
+        free(index);
+        return RADIO_ERR_INVAL;
+    }
+
+    sdev->replay_format = header->format;
+    sdev->replay = malloc(sdev->replay_samples * size);
+    if(!sdev->replay) {
+        free(index);
+        return RADIO_ERR_MEM;
+    }
+
+    for(i=0; i<header->n_frames && !status; i++) {
+        if(fseek(fin, index[i].offset, SEEK_SET) ||
+           fread(sdev->replay + pos * size, size, index[i].n_samples, fin)
+           != index[i].n_samples)
+            status = RADIO_ERR_IO;
+        pos += index[i].n_samples;
+    }
+
+    free(index);
+    return status;
+}
+
+
+static int sim_load_replay(struct sim_dev* sdev, const char* path)
+{
+    struct capture_header header;
+    FILE* fin;
+    long size;
+    int status;
+
+    fin = fopen(path, "rb");
+    if(!fin)
+        return RADIO_ERR_IO;
+
+    if(fread(&header, sizeof(header), 1, fin) == 1 &&
+       memcmp(header.magic, CAPTURE_MAGIC, sizeof(header.magic)) == 0) {
+        status = sim_load_capture(sdev, fin, &header);
+        fclose(fin);
+        return status;
+    }
+
+    fseek(fin, 0, SEEK_END);
+    size = ftell(fin);
+    fseek(fin, 0, SEEK_SET);
+
+    sdev->replay_samples = size / (2 * sizeof(int16_t));
+    if(sdev->replay_samples == 0) {
+        fclose(fin);
+        return RADIO_ERR_INVAL;
+    }
+
+    sdev->replay_format = CAPTURE_FORMAT_SC16;
+    sdev->replay = malloc(sdev->replay_samples * 2 * sizeof(int16_t));
+    if(!sdev->replay) {
+        fclose(fin);
+        return RADIO_ERR_MEM;
+    }
+
+    if(fread(sdev->replay, 2 * sizeof(int16_t), sdev->replay_samples, fin)
+       != sdev->replay_samples) {
+        fclose(fin);
+        return RADIO_ERR_IO;
+    }
+
+    fclose(fin);
+    return 0;
+}
+
+
+static void sim_make_noise(struct sim_dev* sdev)
+{
+    size_t i;
+    uint32_t rng = 0x2545f491;
+    double u1, u2, r;
+
+    for(i=0; i<SIM_NOISE_SAMPLES; i++) {
+        u1 = (sim_rand(&rng) + 1.0) / 4294967297.0;
+        u2 = sim_rand(&rng) / 4294967296.0;
+        r = sdev->noise * sqrt(-2.0 * log(u1)) / sqrt(2.0);
+        sdev->noise_table[2*i]     = (int16_t)lrint(r * cos(2*M_PI*u2));
+        sdev->noise_table[2*i + 1] = (int16_t)lrint(r * sin(2*M_PI*u2));
+    }
+}
+
+
+static int sim_parse_args(struct sim_dev* sdev, const char* args)
+{
+    char *copy, *tok, *save, *val;
+    int status = 0;
+
+    copy = strdup(args);
+    if(!copy)
+        return RADIO_ERR_MEM;
+
+    for(tok = strtok_r(copy, ",", &save); tok && !status;
+        tok = strtok_r(NULL, ",", &save)) {
+        val = strchr(tok, '=');
+        if(val)
+            *val++ = '\0';
+
+        if(strcmp(tok, "fast") == 0) {
+            sdev->fast = true;
+        } else if(!val) {
+            status = RADIO_ERR_INVAL;
+        } else if(strcmp(tok, "replay") == 0) {
+            status = sim_load_replay(sdev, val);
+        } else if(strcmp(tok, "delay") == 0) {
+            sdev->delay = strtoul(val, NULL, 0);
+        } else if(strcmp(tok, "atten") == 0) {
+            sdev->gain_q15 = (int)lrint(32768.0 * pow(10.0, -atof(val)/20));
+        } else if(strcmp(tok, "noise") == 0) {
+            sdev->noise = atof(val);
+        } else if(strcmp(tok, "lose") == 0) {
+            sdev->lose = strtoul(val, NULL, 0);
+            if(sdev->lose == 1)
+                status = RADIO_ERR_INVAL;
+        } else {
+            status = RADIO_ERR_INVAL;
+        }
+    }
+
+    free(copy);
+    return status;
+}
+
+
+static void sim_close(struct radio_dev* dev)
+{
+    struct sim_dev* sdev = (struct sim_dev*)dev;
+    pthread_cond_destroy(&sdev->cond);
+    pthread_mutex_destroy(&sdev->lock);
+    free(sdev->replay);
+    free(sdev->noise_table);
+    free(sdev->loop);
+    free(sdev);
+}
+
+
+static int sim_open(struct radio_dev** dev, const char* args)
+{
+    struct sim_dev* sdev;
+    int status;
+
+    sdev = calloc(1, sizeof(struct sim_dev));
+    if(!sdev)
+        return RADIO_ERR_MEM;
+    sdev->base.backend = &radio_backend_sim;
+    sdev->gain_q15 = 32767;
+    sdev->sr[RADIO_MODULE_TX] = 1000000;
+    sdev->sr[RADIO_MODULE_RX] = 1000000;
+    pthread_mutex_init(&sdev->lock, NULL);
+    pthread_cond_init(&sdev->cond, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &sdev->epoch);
+
+    if(args && args[0]) {
+        status = sim_parse_args(sdev, args);
+        if(status) {
+            sim_close(&sdev->base);
+            return status;
+        }
+    }
+
+    sdev->loop = calloc(SIM_LOOP_SAMPLES, 2 * sizeof(int16_t));
+    if(!sdev->loop) {
+        sim_close(&sdev->base);
+        return RADIO_ERR_MEM;
+    }
+
+    if(sdev->noise > 0) {
+        sdev->noise_table = malloc(SIM_NOISE_SAMPLES * 2 * sizeof(int16_t));
+        if(!sdev->noise_table) {
+            sim_close(&sdev->base);
+            return RADIO_ERR_MEM;
+        }
+        sim_make_noise(sdev);
+    }
+
+    *dev = &sdev->base;
+    return 0;
+}
+
+
+static int sim_tune(struct radio_dev* dev, radio_module module,
+                    unsigned int freq)
+{
+    ((struct sim_dev*)dev)->freq[module] = freq;
+    return 0;
+}
+
+
+static int sim_set_bandwidth(struct radio_dev* dev, radio_module module,
+                             unsigned int bw, unsigned int* actual)
+{
+    ((struct sim_dev*)dev)->bw[module] = bw;
+    if(actual)
+        *actual = bw;
+    return 0;
+}
+
+
+static int sim_set_sample_rate(struct radio_dev* dev, radio_module module,
+                               unsigned int sr, unsigned int* actual)
+{
+    if(sr == 0)
+        return RADIO_ERR_INVAL;
+    ((struct sim_dev*)dev)->sr[module] = sr;
+    if(actual)
+        *actual = sr;
+    return 0;
+}
+
+
+static int sim_set_gain(struct radio_dev* dev, radio_gain gain, int value)
+{
+    ((struct sim_dev*)dev)->gain[gain] = value;
+    return 0;
+}
+
+
+static int sim_get_frequency(struct radio_dev* dev, radio_module module,
+                             unsigned int* freq)
+{
+    *freq = ((struct sim_dev*)dev)->freq[module];
+    return 0;
+}
+
+
+static int sim_get_bandwidth(struct radio_dev* dev, radio_module module,
+                             unsigned int* bw)
+{
+    *bw = ((struct sim_dev*)dev)->bw[module];
+    return 0;
+}
+
+
+static int sim_get_sample_rate(struct radio_dev* dev, radio_module module,
+                               unsigned int* sr)
+{
+    *sr = ((struct sim_dev*)dev)->sr[module];
+    return 0;
+}
+
+
+static int sim_get_gain(struct radio_dev* dev, radio_gain gain, int* value)
+{
+    *value = ((struct sim_dev*)dev)->gain[gain];
+    return 0;
+}
+
+
+static int sim_enable(struct radio_dev* dev, radio_module module,
+                      bool enabled)
+{
+    struct sim_dev* sdev = (struct sim_dev*)dev;
+
+    pthread_mutex_lock(&sdev->lock);
+    sdev->enabled[module] = enabled;
+    if(module == RADIO_MODULE_TX && enabled) {
+        sdev->tx_count = 0;
+        sdev->tx_state = SIM_TX_IDLE;
+    }
+    pthread_cond_broadcast(&sdev->cond);
+    pthread_mutex_unlock(&sdev->lock);
+
+    return 0;
+}
+
+
+static int sim_get_time(struct radio_dev* dev, uint64_t* time)
+{
+    struct sim_dev* sdev = (struct sim_dev*)dev;
+    struct timespec t;
+    uint64_t sec, nsec, sr = sdev->sr[RADIO_MODULE_RX];
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    sec = t.tv_sec - sdev->epoch.tv_sec;
+    if(t.tv_nsec >= sdev->epoch.tv_nsec) {
+        nsec = t.tv_nsec - sdev->epoch.tv_nsec;
+    } else {
+        sec--;
+        nsec = t.tv_nsec + 1000000000L - sdev->epoch.tv_nsec;
+    }
+
+    *time = sec * sr + nsec * sr / 1000000000ULL;
+    return 0;
+}
+
+
+/* The CLOCK_MONOTONIC time at which device time reaches time */
+static void sim_time_spec(struct sim_dev* sdev, uint64_t time,
+                          struct timespec* t)
+{
+    uint64_t sr = sdev->sr[RADIO_MODULE_RX];
+    uint64_t ns = (time % sr) * 1000000000ULL / sr;
+
+    t->tv_sec = sdev->epoch.tv_sec + time / sr;
+    t->tv_nsec = sdev->epoch.tv_nsec + ns;
+    if(t->tv_nsec >= 1000000000L) {
+        t->tv_sec++;
+        t->tv_nsec -= 1000000000L;
+    }
+}
+
+
+static int sim_init_stream(struct radio_stream** stream,
+                           struct radio_dev* dev, radio_module module,
+                           radio_stream_cb cb, void*** buffers,
+                           size_t num_buffers, size_t samples_per_buffer,
+                           size_t num_transfers, void* user_data)
+{
+    struct sim_stream* sstream;
+    size_t i;
+
+    if(num_buffers == 0 || num_transfers == 0 || num_transfers > num_buffers
+       || samples_per_buffer == 0)
+        return RADIO_ERR_INVAL;
+
+    sstream = calloc(1, sizeof(struct sim_stream));
+    if(!sstream)
+        return RADIO_ERR_MEM;
+    sstream->base.dev = dev;
+    sstream->cb = cb;
+    sstream->user_data = user_data;
+    sstream->num_buffers = num_buffers;
+    sstream->samples_per_buffer = samples_per_buffer;
+    sstream->num_transfers = num_transfers;
+    sstream->rng = 0x9e3779b9 ^ (uint32_t)(uintptr_t)sstream;
+
+    sstream->buffers = calloc(num_buffers, sizeof(void*));
+    if(!sstream->buffers) {
+        free(sstream);
+        return RADIO_ERR_MEM;
+    }
+    for(i=0; i<num_buffers; i++) {
+        sstream->buffers[i] = rt_alloc(samples_per_buffer * 2 *
+                                       sizeof(int16_t));
+        if(!sstream->buffers[i]) {
+            while(i--)
+                rt_free(sstream->buffers[i]);
+            free(sstream->buffers);
+            free(sstream);
+            return RADIO_ERR_MEM;
+        }
+    }
+
+    *buffers = sstream->buffers;
+    *stream = &sstream->base;
+    return 0;
+}
+
+
+static void sim_deinit_stream(struct radio_stream* stream)
+{
+    struct sim_stream* sstream = (struct sim_stream*)stream;
+    size_t i;
+
+    for(i=0; i<sstream->num_buffers; i++)
+        rt_free(sstream->buffers[i]);
+    free(sstream->buffers);
+    free(sstream);
+}
+
+
+/* Sleep until n samples at sr samples/s have elapsed since start. */
+static void sim_pace(const struct timespec* start, uint64_t n,
+                     unsigned int sr)
+{
+    struct timespec t;
+    uint64_t ns = (n % sr) * 1000000000ULL / sr;
+
+    // Split as in sim_time_spec, so n * 1e9 cannot overflow
+    t.tv_sec = start->tv_sec + n / sr;
+    t.tv_nsec = start->tv_nsec + ns;
+    if(t.tv_nsec >= 1000000000L) {
+        t.tv_sec++;
+        t.tv_nsec -= 1000000000L;
+    }
+
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) == EINTR);
+}
+
+
+static void sim_deadline(struct timespec* t)
+{
+    clock_gettime(CLOCK_REALTIME, t);
+    t->tv_nsec += SIM_WAIT_NS;
+    if(t->tv_nsec >= 1000000000L) {
+        t->tv_sec++;
+        t->tv_nsec -= 1000000000L;
+    }
+}
+
+
+static void sim_tx_write(struct sim_dev* sdev, const int16_t* samples,
+                         size_t n)
+{
+    struct timespec deadline;
+    size_t i, idx;
+
+    pthread_mutex_lock(&sdev->lock);
+    sim_deadline(&deadline);
+    while(sdev->rx_running &&
+          sdev->tx_count + n - sdev->rx_need > SIM_LOOP_SAMPLES) {
+        if(pthread_cond_timedwait(&sdev->cond, &sdev->lock, &deadline))
+            break;
+    }
+    pthread_mutex_unlock(&sdev->lock);
+
+    idx = sdev->tx_count & (SIM_LOOP_SAMPLES - 1);
+    for(i=0; i<n; i++) {
+        sdev->loop[2*idx]     = samples[2*i];
+        sdev->loop[2*idx + 1] = samples[2*i + 1];
+        idx = (idx + 1) & (SIM_LOOP_SAMPLES - 1);
+    }
+
+    pthread_mutex_lock(&sdev->lock);
+    sdev->tx_count += n;
+    pthread_cond_broadcast(&sdev->cond);
+    pthread_mutex_unlock(&sdev->lock);
+}
+
+
+/* TX sample heard at device time rx_time, or -1 if it was before TX began */
+static int64_t sim_tx_index(struct sim_dev* sdev, uint64_t rx_time)
+{
+    if(rx_time < sdev->tx_start + sdev->delay)
+        return -1;
+    return (rx_time - sdev->tx_start - sdev->delay) *
+           sdev->sr[RADIO_MODULE_TX] / sdev->sr[RADIO_MODULE_RX];
+}
+
+
+/* Fill n samples heard from device time r0 on */
+static void sim_rx_loopback(struct sim_dev* sdev, int16_t* samples,
+                            size_t n, uint64_t r0)
+{
+    struct timespec deadline;
+    uint64_t tx_count;
+    int64_t t;
+    size_t i, idx;
+    int gain = sdev->gain_q15;
+    bool tx_started;
+
+    // Wait for TX to have produced everything this buffer needs, unless TX
+    // is not going to produce any more.
+    pthread_mutex_lock(&sdev->lock);
+    sim_deadline(&deadline);
+    for(;;) {
+        tx_started = sdev->tx_state != SIM_TX_IDLE;
+        t = tx_started ? sim_tx_index(sdev, r0) : -1;
+        sdev->rx_need = t > 0 ? t : 0;
+        pthread_cond_broadcast(&sdev->cond);
+        if(!sdev->enabled[RADIO_MODULE_TX] ||
+           sdev->tx_state == SIM_TX_DONE || (tx_started &&
+           sim_tx_index(sdev, r0 + n - 1) < (int64_t)sdev->tx_count))
+            break;
+        if(pthread_cond_timedwait(&sdev->cond, &sdev->lock, &deadline))
+            break;
+    }
+    tx_started = sdev->tx_state != SIM_TX_IDLE;
+    tx_count = sdev->tx_count;
+    pthread_mutex_unlock(&sdev->lock);
+
+    for(i=0; i<n; i++) {
+        t = tx_started ? sim_tx_index(sdev, r0 + i) : -1;
+        if(t < 0 || (uint64_t)t >= tx_count ||
+           (uint64_t)t + SIM_LOOP_SAMPLES <= tx_count) {
+            samples[2*i] = samples[2*i + 1] = 0;
+            continue;
+        }
+        idx = t & (SIM_LOOP_SAMPLES - 1);
+        samples[2*i]     = (int16_t)((sdev->loop[2*idx] * gain) >> 15);
+        samples[2*i + 1] = (int16_t)((sdev->loop[2*idx + 1] * gain) >> 15);
+    }
+}
+
+
+static void sim_rx_replay(struct sim_dev* sdev, int16_t* samples, size_t n,
+                          uint64_t r0)
+{
+    size_t pos = r0 % sdev->replay_samples, chunk;
+    size_t size = capture_sample_size(sdev->replay_format);
+
+    // Up to the end of the replay at a time, then round again
+    while(n) {
+        chunk = sdev->replay_samples - pos;
+        if(chunk > n)
+            chunk = n;
+        if(sdev->replay_format == CAPTURE_FORMAT_SC12)
+            sc12_to_sc16(sdev->replay + pos * size, samples, chunk);
+        else
+            memcpy(samples, sdev->replay + pos * size, chunk * size);
+        samples += 2 * chunk;
+        n -= chunk;
+        pos = 0;
+    }
+}
+
+
+static void sim_add_noise(struct sim_dev* sdev, struct sim_stream* sstream,
+                          int16_t* samples, size_t n)
+{
+    size_t i, pos = sim_rand(&sstream->rng) & (SIM_NOISE_SAMPLES - 1);
+    int v;
+
+    for(i=0; i<2*n; i++) {
+        v = samples[i] + sdev->noise_table[pos];
+        samples[i] = v > 2047 ? 2047 : (v < -2048 ? -2048 : v);
+        pos = (pos + 1) & (2*SIM_NOISE_SAMPLES - 1);
+    }
+}
+
+
+static int sim_stream_tx(struct sim_stream* sstream, uint64_t time)
+{
+    struct sim_dev* sdev = (struct sim_dev*)sstream->base.dev;
+    struct timespec start;
+    void** inflight;
+    void* buf;
+    size_t i, head = 0, n_inflight = 0, spb = sstream->samples_per_buffer;
+    uint64_t sent = 0;
+
+    inflight = calloc(sstream->num_transfers, sizeof(void*));
+    if(!inflight)
+        return RADIO_ERR_MEM;
+
+    for(i=0; i<sstream->num_transfers; i++) {
+        buf = sstream->cb(&sstream->base, NULL, 0, 0, sstream->user_data);
+        if(!buf)
+            break;
+        inflight[n_inflight++] = buf;
+    }
+
+    sim_time_spec(sdev, time, &start);
+    if(!sdev->fast)
+        sim_pace(&start, 0, sdev->sr[RADIO_MODULE_TX]);
+
+    pthread_mutex_lock(&sdev->lock);
+    sdev->tx_start = time;
+    sdev->tx_state = SIM_TX_RUNNING;
+    pthread_cond_broadcast(&sdev->cond);
+    pthread_mutex_unlock(&sdev->lock);
+
+    while(n_inflight) {
+        buf = inflight[head];
+        sim_tx_write(sdev, buf, spb);
+        sent += spb;
+        if(!sdev->fast)
+            sim_pace(&start, sent, sdev->sr[RADIO_MODULE_TX]);
+
+        buf = sstream->cb(&sstream->base, buf, spb, 0, sstream->user_data);
+        if(!buf)
+            break;
+        inflight[head] = buf;
+        head = (head + 1) % n_inflight;
+    }
+
+    pthread_mutex_lock(&sdev->lock);
+    sdev->tx_state = SIM_TX_DONE;
+    pthread_cond_broadcast(&sdev->cond);
+    pthread_mutex_unlock(&sdev->lock);
+
+    free(inflight);
+    return 0;
+}
+
+
+static int sim_stream_rx(struct sim_stream* sstream, uint64_t time)
+{
+    struct sim_dev* sdev = (struct sim_dev*)sstream->base.dev;
+    struct timespec start;
+    void** inflight;
+    void* buf;
+    size_t head = 0, spb = sstream->samples_per_buffer;
+    size_t n_inflight = sstream->num_transfers;
+    size_t lost = 0;
+    uint64_t received = 0;
+
+    inflight = calloc(n_inflight, sizeof(void*));
+    if(!inflight)
+        return RADIO_ERR_MEM;
+    memcpy(inflight, sstream->buffers, n_inflight * sizeof(void*));
+
+    pthread_mutex_lock(&sdev->lock);
+    sdev->rx_running = true;
+    sdev->rx_need = 0;
+    pthread_mutex_unlock(&sdev->lock);
+
+    sim_time_spec(sdev, time, &start);
+    if(!sdev->fast)
+        sim_pace(&start, 0, sdev->sr[RADIO_MODULE_RX]);
+
+    for(;;) {
+        buf = inflight[head];
+        if(sdev->lose && received / spb % sdev->lose == sdev->lose - 1) {
+            // Nothing to hand over; the next buffer says what was lost
+            lost += spb;
+            received += spb;
+            if(!sdev->fast)
+                sim_pace(&start, received, sdev->sr[RADIO_MODULE_RX]);
+            continue;
+        }
+
+        if(sdev->replay)
+            sim_rx_replay(sdev, buf, spb, received);
+        else
+            sim_rx_loopback(sdev, buf, spb, time + received);
+        if(sdev->noise_table)
+            sim_add_noise(sdev, sstream, buf, spb);
+        received += spb;
+        if(!sdev->fast)
+            sim_pace(&start, received, sdev->sr[RADIO_MODULE_RX]);
+
+        buf = sstream->cb(&sstream->base, buf, spb, lost, sstream->user_data);
+        lost = 0;
+        if(!buf)
+            break;
+        inflight[head] = buf;
+        head = (head + 1) % n_inflight;
+    }
+
+    pthread_mutex_lock(&sdev->lock);
+    sdev->rx_running = false;
+    pthread_cond_broadcast(&sdev->cond);
+    pthread_mutex_unlock(&sdev->lock);
+
+    free(inflight);
+    return 0;
+}
+
+
+static int sim_stream_at(struct radio_stream* stream, radio_module module,
+                         uint64_t time)
+{
+    if(module == RADIO_MODULE_TX)
+        return sim_stream_tx((struct sim_stream*)stream, time);
+    else
+        return sim_stream_rx((struct sim_stream*)stream, time);
+}
+
+
+static int sim_stream(struct radio_stream* stream, radio_module module)
+{
+    uint64_t now;
+
+    sim_get_time(stream->dev, &now);
+    return sim_stream_at(stream, module, now);
+}
+
+
+static const char* sim_strerror(int status)
+{
+    return radio_strerror(NULL, status);
+}
+
+
+const struct radio_backend radio_backend_sim = {
+    .name            = "sim",
+    .open            = sim_open,
+    .close           = sim_close,
+    .tune            = sim_tune,
+    .set_bandwidth   = sim_set_bandwidth,
+    .set_sample_rate = sim_set_sample_rate,
+    .set_gain        = sim_set_gain,
+    .get_frequency   = sim_get_frequency,
+    .get_bandwidth   = sim_get_bandwidth,
+    .get_sample_rate = sim_get_sample_rate,
+    .get_gain        = sim_get_gain,
+    .enable          = sim_enable,
+    .get_time        = sim_get_time,
+    .init_stream     = sim_init_stream,
+    .stream          = sim_stream,
+    .stream_at       = sim_stream_at,
+    .deinit_stream   = sim_deinit_stream,
+    .strerror        = sim_strerror,
+};
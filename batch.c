@@ -0,0 +1,631 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pool.h"
+#include "corr.h"
+#include "goldcode.h"
+#include "resample.h"
+#include "convert.h"
+#include "capture.h"
+#include "config.h"
+#include "batch.h"
+
+/*
+ * Offline batch processing of archived captures.
+ *
+ * Every capture named, directly, in a list or under a directory, is
+ * correlated against the code in its header and its code periods averaged
+ * into one profile, as radar -p does for a frame, and a result record of
+ * the peak and noise is kept for it. Each capture is one task on the
+ * worker pool, so captures are spread over every CPU and a long one does
+ * not hold up the rest. A task maps its capture rather than reading it,
+ * feeds each frame to an overlap-save correlator an RX buffer's worth at
+ * a time, unpacking SC12 or decimating into buffers of its slot's, and
+ * drops each frame's pages once done, so memory use stays the same however
+ * large the captures are and SC16 samples are never copied.
+ *
+ * Code periods are counted from sample 0 of the capture, so periods line
+ * up across frames and gaps, and the correlation is linear: a period is
+ * averaged in wherever it falls in a frame, and one cut into by a gap is
+ * left out. Captures must share the sample rates of the settings, which
+ * come from bladerf_config.json and -s as for radar; the geometry is not
+ * in the capture header.
+ *
+ * Files without a capture header, as radar saved single-shot captures
+ * before it had one, are taken as one frame of raw sign-extended SC16 if
+ * they hold a whole number of RX buffers. Their rates are the settings'
+ * and their code is -P's, there being nothing else to go on.
+ */
+
+#define KNRM "\x1B[0m"
+#define KRED "\x1B[31m"
+#define KGRN "\x1B[32m"
+
+char* config_filename = "./bladerf_config.json";
+char* results_filename = "./batch_results.dat";
+
+// State of one pool slot, used by one task at a time
+struct batch_worker {
+    struct corr_ols*  corr;
+    int               prn;          // Code corr is set up for
+    float*            code;
+    struct resampler* decimator;    // If rx_decimation is over 1
+    int16_t*          unpacked;     // A buffer unpacked from SC12
+    int16_t*          decimated;    // And decimated
+    float*            profile;
+};
+
+struct batch_job {
+    struct batch*        batch;
+    const char*          path;
+    struct batch_result* result;
+};
+
+struct batch {
+    struct bladerf_config  cfg;
+    struct pool*           pool;
+    struct pool_group      tasks;
+    struct batch_worker*   workers;     // One per pool slot
+    int                    n_workers;
+    int                    prn;         // Code of raw captures
+    char**                 paths;
+    size_t                 n_paths;
+    size_t                 max_paths;
+    struct batch_job*      jobs;
+    struct batch_result*   results;
+};
+
+
+static uint64_t now_ns(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+
+static int append_path(struct batch* b, const char* path)
+{
+    char** paths;
+
+    if(b->n_paths == b->max_paths) {
+        paths = realloc(b->paths, (b->max_paths ? 2 * b->max_paths : 256) *
+                                  sizeof(char*));
+        if(!paths)
+            return 1;
+        b->paths = paths;
+        b->max_paths = b->max_paths ? 2 * b->max_paths : 256;
+    }
+    b->paths[b->n_paths] = strdup(path);
+    if(!b->paths[b->n_paths])
+        return 1;
+    b->n_paths++;
+
+    return 0;
+}
+
+
+static int add_path(struct batch* b, const char* path, bool given);
+
+
+// Every .dat file under dir, in name order, not following symlinks
+static int add_dir(struct batch* b, const char* dir)
+{
+    struct dirent** entries;
+    char* path;
+    int n, i, status = 0;
+
+    n = scandir(dir, &entries, NULL, alphasort);
+    if(n < 0)
+        return 1;
+
+    for(i=0; i<n; i++) {
+        if(!status && strcmp(entries[i]->d_name, ".") &&
+           strcmp(entries[i]->d_name, "..")) {
+            path = malloc(strlen(dir) + strlen(entries[i]->d_name) + 2);
+            if(path) {
+                sprintf(path, "%s/%s", dir, entries[i]->d_name);
+                status = add_path(b, path, false);
+                free(path);
+            } else {
+                status = 1;
+            }
+        }
+        free(entries[i]);
+    }
+    free(entries);
+
+    return status;
+}
+
+
+/*
+ * Add a capture, or the captures under a directory. A file named directly
+ * is added whatever it is called, so that it gets a result either way.
+ */
+static int add_path(struct batch* b, const char* path, bool given)
+{
+    struct stat st;
+    size_t len = strlen(path);
+
+    if(given ? stat(path, &st) : lstat(path, &st))
+        return given ? append_path(b, path) : 0;
+    if(S_ISDIR(st.st_mode))
+        return add_dir(b, path);
+    if(given || (S_ISREG(st.st_mode) && len > 4 &&
+                 !strcmp(path + len - 4, ".dat")))
+        return append_path(b, path);
+
+    return 0;
+}
+
+
+// Paths one per line, "-" for stdin
+static int add_list(struct batch* b, const char* filename)
+{
+    FILE* fin = strcmp(filename, "-") ? fopen(filename, "r") : stdin;
+    char* line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    int status = 0;
+
+    if(!fin)
+        return 1;
+    while(!status && (len = getline(&line, &size, fin)) >= 0) {
+        while(len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+        if(len)
+            status = add_path(b, line, true);
+    }
+
+    free(line);
+    if(fin != stdin)
+        fclose(fin);
+    return status;
+}
+
+
+/*
+ * Correlate frame n an RX buffer's worth at a time, then drop its pages
+ * from the mapping. A frame straight after the last carries on from it.
+ */
+static void batch_frame(const struct batch* b, struct batch_worker* w,
+                        const struct capture_file* capture, uint64_t n)
+{
+    const struct capture_index* entry = &capture->index[n];
+    uint32_t format = capture->header->format;
+    size_t sample_size = capture_sample_size(format);
+    size_t block = b->cfg.rx_samples_per_buffer, len, out;
+    const uint8_t* in = capture_frame(capture, n);
+    const int16_t* samples;
+    uint64_t pos;
+
+    if(!n || entry->sample != entry[-1].sample + entry[-1].n_samples) {
+        corr_ols_seek(w->corr, entry->sample / b->cfg.rx_decimation);
+        if(w->decimator)
+            resampler_reset(w->decimator);
+    }
+    for(pos=0; pos<entry->n_samples; pos+=len) {
+        len = entry->n_samples - pos < block ? entry->n_samples - pos :
+                                               block;
+        if(format == CAPTURE_FORMAT_SC12) {
+            sc12_to_sc16(in + pos * sample_size, w->unpacked, len);
+            samples = w->unpacked;
+        } else {
+            samples = (const int16_t*)(in + pos * sample_size);
+        }
+        if(w->decimator) {
+            out = resampler_run(w->decimator, samples, len, w->decimated);
+            corr_ols_add(w->corr, w->decimated, out);
+        } else {
+            corr_ols_add(w->corr, samples, len);
+        }
+    }
+
+    // Frames start page-aligned; the page cache keeps them if it has room
+    madvise((void*)in, entry->n_samples * sample_size, MADV_DONTNEED);
+}
+
+
+/*
+ * Map a headerless file as one frame of raw SC16, filling in h and entry
+ * for it from the settings. Returns 0 on success, 1 with errno set if the
+ * file could not be mapped, or 2 if it is not a whole number of buffers.
+ */
+static int map_raw(const struct batch* b, struct capture_file* capture,
+                   struct capture_header* h, struct capture_index* entry,
+                   const char* path)
+{
+    size_t buffer = b->cfg.rx_samples_per_buffer * 2 * sizeof(int16_t);
+    struct stat st;
+    void* data;
+    int fd;
+
+    memset(capture, 0, sizeof(*capture));
+    fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return 1;
+    if(fstat(fd, &st)) {
+        close(fd);
+        return 1;
+    }
+    if(!S_ISREG(st.st_mode) || !st.st_size || st.st_size % buffer) {
+        close(fd);
+        return 2;
+    }
+
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED)
+        return 1;
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, CAPTURE_MAGIC, sizeof(h->magic));
+    h->frame_samples = st.st_size / (2 * sizeof(int16_t));
+    h->tx_sr = b->cfg.tx_sr;
+    h->rx_sr = b->cfg.rx_sr;
+    h->prn = b->prn;
+    h->n_frames = 1;
+    h->format = CAPTURE_FORMAT_SC16;
+    memset(entry, 0, sizeof(*entry));
+    entry->n_samples = h->frame_samples;
+
+    capture->data = data;
+    capture->size = st.st_size;
+    capture->header = h;
+    capture->index = entry;
+    return 0;
+}
+
+
+static void batch_process(void* arg, int slot)
+{
+    struct batch_job* job = arg;
+    const struct batch* b = job->batch;
+    struct batch_worker* w = &b->workers[slot];
+    struct batch_result* r = job->result;
+    const struct capture_header* h;
+    const struct capture_index* index;
+    struct capture_file capture;
+    struct capture_header raw_header;
+    struct capture_index raw_index;
+    size_t n = CODE_LEN_CORR(&b->cfg), i;
+    int8_t chips[GOLDCODE_LEN];
+    uint64_t f;
+    int status;
+
+    memset(r, 0, sizeof(*r));
+    status = capture_map(&capture, job->path);
+    if(status == 2) {
+        status = map_raw(b, &capture, &raw_header, &raw_index, job->path);
+    }
+    if(status == 1) {
+        fprintf(stderr, KRED "%s: %s" KNRM "\n", job->path,
+                strerror(errno));
+        r->status = BATCH_UNREADABLE;
+        return;
+    } else if(status) {
+        r->status = status == 2 ? BATCH_NOT_CAPTURE : BATCH_INCOMPLETE;
+        return;
+    }
+
+    h = capture.header;
+    index = capture.index;
+    r->prn = h->prn;
+    r->start_time = h->start_time;
+    r->frames = h->n_frames;
+    for(f=0; f<h->n_frames; f++) {
+        r->samples += index[f].n_samples;
+        if(f && index[f].sample > index[f - 1].sample +
+                                  index[f - 1].n_samples) {
+            r->dropped += index[f].sample - (index[f - 1].sample +
+                                             index[f - 1].n_samples);
+        }
+    }
+    if(h->rx_sr != b->cfg.rx_sr || h->tx_sr != b->cfg.tx_sr ||
+       h->prn < 1 || h->prn > GOLDCODE_N_PRNS) {
+        r->status = BATCH_MISMATCH;
+        capture_unmap(&capture);
+        return;
+    }
+
+    if(w->prn != h->prn) {
+        goldcode_generate(h->prn, chips);
+        goldcode_reference(chips, CORR_SAMPLES_PER_CHIP(&b->cfg), w->code, n);
+        corr_ols_set_code(w->corr, w->code);
+        w->prn = h->prn;
+    }
+    corr_ols_reset(w->corr);
+    for(f=0; f<h->n_frames; f++)
+        batch_frame(b, w, &capture, f);
+    corr_ols_flush(w->corr);
+    capture_unmap(&capture);
+
+    r->periods = w->corr->chunks;
+    if(!r->periods) {
+        r->status = BATCH_EMPTY;
+        return;
+    }
+
+    corr_ols_result(w->corr, w->profile);
+    for(i=0; i<n; i++) {
+        r->noise += w->profile[i];
+        if(w->profile[i] > w->profile[r->peak_bin])
+            r->peak_bin = i;
+    }
+    r->noise /= n;
+    r->peak = w->profile[r->peak_bin];
+    r->snr = r->noise > 0 ? 10 * log10(r->peak / r->noise) : 0;
+}
+
+
+static int batch_create(struct batch* b, int n_workers)
+{
+    size_t code_len = CODE_LEN_CORR(&b->cfg);
+    size_t block = b->cfg.rx_samples_per_buffer;
+    unsigned int decimation = b->cfg.rx_decimation;
+    struct batch_worker* w;
+    size_t i;
+    int s;
+
+    b->pool = pool_create(n_workers);
+    b->jobs = calloc(b->n_paths, sizeof(struct batch_job));
+    b->results = calloc(b->n_paths, sizeof(struct batch_result));
+    if(!b->pool || !b->jobs || !b->results)
+        return 1;
+    pool_group_init(&b->tasks);
+
+    b->n_workers = pool_slots(b->pool);
+    b->workers = calloc(b->n_workers, sizeof(struct batch_worker));
+    if(!b->workers)
+        return 1;
+    for(s=0; s<b->n_workers; s++) {
+        w = &b->workers[s];
+        // Any code will do until the first capture sets one
+        w->code = calloc(code_len, sizeof(float));
+        w->corr = w->code ? corr_ols_create(w->code, code_len, code_len,
+                                            code_len, CORR_DELAY(&b->cfg)) :
+                            NULL;
+        w->unpacked = malloc(block * 2 * sizeof(int16_t));
+        w->profile = malloc(code_len * sizeof(float));
+        if(!w->corr || !w->unpacked || !w->profile)
+            return 1;
+        if(decimation > 1) {
+            w->decimator = resampler_create(1, decimation,
+                                            DECIMATION_HALF_LEN * decimation,
+                                            block);
+            w->decimated = malloc(resampler_max_out(w->decimator, block) *
+                                  2 * sizeof(int16_t));
+            if(!w->decimator || !w->decimated)
+                return 1;
+        }
+    }
+
+    for(i=0; i<b->n_paths; i++) {
+        b->jobs[i].batch = b;
+        b->jobs[i].path = b->paths[i];
+        b->jobs[i].result = &b->results[i];
+    }
+
+    return 0;
+}
+
+
+static void batch_destroy(struct batch* b)
+{
+    size_t i;
+    int s;
+
+    for(s=0; b->workers && s<b->n_workers; s++) {
+        corr_ols_destroy(b->workers[s].corr);
+        free(b->workers[s].code);
+        resampler_destroy(b->workers[s].decimator);
+        free(b->workers[s].unpacked);
+        free(b->workers[s].decimated);
+        free(b->workers[s].profile);
+    }
+    free(b->workers);
+    pool_destroy(b->pool);
+    free(b->results);
+    free(b->jobs);
+    for(i=0; i<b->n_paths; i++)
+        free(b->paths[i]);
+    free(b->paths);
+}
+
+
+// Returns 0 on success or 1 with errno set
+static int write_results(const struct batch* b, const char* filename)
+{
+    struct batch_header header;
+    FILE* fout;
+    size_t i;
+    int status = 0;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BATCH_MAGIC, sizeof(header.magic));
+    header.n_results = b->n_paths;
+    header.n_range = CODE_LEN_CORR(&b->cfg);
+    header.range_bin = 1.0 / CORR_SR(&b->cfg);
+    header.names_offset = sizeof(header) +
+                          b->n_paths * sizeof(struct batch_result);
+
+    fout = fopen(filename, "wb");
+    if(!fout)
+        return 1;
+    if(fwrite(&header, sizeof(header), 1, fout) != 1 ||
+       fwrite(b->results, sizeof(struct batch_result), b->n_paths, fout) !=
+       b->n_paths)
+        status = 1;
+    for(i=0; i<b->n_paths && !status; i++) {
+        if(fwrite(b->paths[i], strlen(b->paths[i]) + 1, 1, fout) != 1)
+            status = 1;
+    }
+
+    return fclose(fout) || status;
+}
+
+
+static void print_summary(const struct batch* b, uint64_t ns)
+{
+    unsigned long counts[BATCH_EMPTY + 1] = { 0 };
+    uint64_t samples = 0;
+    double seconds = ns / 1e9;
+    size_t i;
+
+    for(i=0; i<b->n_paths; i++) {
+        counts[b->results[i].status]++;
+        if(b->results[i].status == BATCH_OK)
+            samples += b->results[i].samples;
+    }
+
+    printf("%-30s %15lu\n", "Captures processed:", counts[BATCH_OK]);
+    printf("%-30s %15lu\n", "Unreadable:", counts[BATCH_UNREADABLE]);
+    printf("%-30s %15lu\n", "Not captures:", counts[BATCH_NOT_CAPTURE]);
+    printf("%-30s %15lu\n", "Never closed:", counts[BATCH_INCOMPLETE]);
+    printf("%-30s %15lu\n", "Other sample rates:", counts[BATCH_MISMATCH]);
+    printf("%-30s %15lu\n", "Too short:", counts[BATCH_EMPTY]);
+    printf("%-30s %'15lu\n", "Samples correlated:", samples);
+    printf("%-30s %15.2f\n", "Seconds:", seconds);
+    printf("%-30s %'15.0f\n", "Samples per second:",
+           seconds > 0 ? samples / seconds : 0);
+}
+
+
+static void usage(const char* argv0)
+{
+    printf("Usage: %s [-j workers] [-l list] [-o file] [-s name=value]...\n"
+           "       [-P prn] [capture|directory]...\n", argv0);
+    printf("  -j workers    Worker threads, default one per CPU\n");
+    printf("  -l list       Read capture paths from list, one per line,\n"
+           "                - for stdin\n");
+    printf("  -o file       Results file, default %s\n", results_filename);
+    printf("  -s setting    Override a setting, as radar's -s\n");
+    printf("  -P prn        Gold code of captures without a header, 1 to "
+           "%d,\n"
+           "                default 1\n", GOLDCODE_N_PRNS);
+    printf("Directories are searched for .dat files, in subdirectories "
+           "too.\n");
+}
+
+
+int main(int argc, char** argv)
+{
+    struct batch b;
+    const char* error;
+    uint64_t start;
+    size_t i;
+    int opt, n_workers = -1, i_arg;
+
+    memset(&b, 0, sizeof(b));
+    b.prn = 1;
+    config_defaults(&b.cfg);
+    if(config_read(&b.cfg, config_filename) == 2) {
+        printf(KRED "Malformed %s" KNRM "\n", config_filename);
+        return 1;
+    }
+
+    while((opt = getopt(argc, argv, "j:l:o:s:P:")) != -1) {
+        switch(opt) {
+            case 'j':
+                n_workers = atoi(optarg);
+                break;
+            case 'l':
+                if(!add_list(&b, optarg)) {
+                    break;
+                }
+                printf(KRED "Failed to read %s: %s" KNRM "\n", optarg,
+                       strerror(errno));
+                batch_destroy(&b);
+                return 1;
+            case 'o':
+                results_filename = optarg;
+                break;
+            case 'P':
+                b.prn = atoi(optarg);
+                if(b.prn >= 1 && b.prn <= GOLDCODE_N_PRNS) {
+                    break;
+                }
+                usage(argv[0]);
+                batch_destroy(&b);
+                return 1;
+            case 's':
+                if(!config_set(&b.cfg, optarg)) {
+                    break;
+                }
+                printf(KRED "Not a valid setting: %s" KNRM "\n", optarg);
+                batch_destroy(&b);
+                return 1;
+            default:
+                usage(argv[0]);
+                batch_destroy(&b);
+                return 1;
+        }
+    }
+
+    for(i_arg=optind; i_arg<argc; i_arg++) {
+        if(add_path(&b, argv[i_arg], true)) {
+            printf(KRED "Failed to read %s: %s" KNRM "\n", argv[i_arg],
+                   strerror(errno));
+            batch_destroy(&b);
+            return 1;
+        }
+    }
+    if(!b.n_paths) {
+        usage(argv[0]);
+        batch_destroy(&b);
+        return 1;
+    }
+
+    error = config_check(&b.cfg);
+    if(error) {
+        printf(KRED "Invalid settings: %s" KNRM "\n", error);
+        batch_destroy(&b);
+        return 1;
+    }
+    if(n_workers < 0) {
+        n_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    convert_init();
+    printf("%-50s", "Creating workers... ");
+    fflush(stdout);
+    if(batch_create(&b, n_workers > 0 ? n_workers : 0)) {
+        printf(KRED "Failed: %s" KNRM "\n", strerror(ENOMEM));
+        batch_destroy(&b);
+        return 1;
+    }
+    printf(KGRN "%d" KNRM "\n", b.pool->n_workers);
+
+    printf("Processing %zu captures...\n", b.n_paths);
+    fflush(stdout);
+    start = now_ns();
+    for(i=0; i<b.n_paths; i++)
+        pool_submit_group(b.pool, &b.tasks, batch_process, &b.jobs[i]);
+    pool_wait_group(b.pool, &b.tasks);
+    print_summary(&b, now_ns() - start);
+
+    printf("%-20s %-29s", "Writing results to", results_filename);
+    fflush(stdout);
+    if(write_results(&b, results_filename)) {
+        printf(KRED "Failed: %s" KNRM "\n", strerror(errno));
+        batch_destroy(&b);
+        return 1;
+    }
+    printf(KGRN "OK" KNRM "\n");
+
+    batch_destroy(&b);
+    return 0;
+}
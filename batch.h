@@ -0,0 +1,47 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+
+/*
+ * Results file radar_batch writes for a batch of captures.
+ *
+ * A struct batch_header, then n_results struct batch_result in the order
+ * the captures were given, then at names_offset the captures' paths in
+ * the same order, each NUL-terminated. Everything is little-endian.
+ */
+
+#define BATCH_MAGIC "BAT1"
+
+enum batch_status {
+    BATCH_OK,
+    BATCH_UNREADABLE,       // Could not be opened or mapped
+    BATCH_NOT_CAPTURE,
+    BATCH_INCOMPLETE,       // Never closed, so it has no index
+    BATCH_MISMATCH,         // Sample rates other than the batch's
+    BATCH_EMPTY             // Not one whole code period to correlate
+};
+
+struct batch_header {
+    char     magic[4];
+    uint32_t n_results;
+    uint32_t n_range;       // Bins in each correlation profile
+    float    range_bin;     // Seconds of delay per range bin
+    uint64_t names_offset;
+};
+
+struct batch_result {
+    uint32_t status;        // enum batch_status
+    int32_t  prn;           // From the capture's header
+    uint64_t start_time;    // Likewise, in ns; 0 if it has no header
+    uint64_t frames;
+    uint64_t samples;       // In all frames
+    uint64_t dropped;       // Samples missing between frames
+    uint64_t periods;       // Code periods correlated and averaged
+    uint32_t peak_bin;      // Strongest bin of the averaged profile
+    float    peak;          // Its power
+    float    noise;         // Mean power over the profile
+    float    snr;           // Peak over noise, in dB
+};
+
+#endif
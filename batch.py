@@ -0,0 +1,56 @@
+import sys
+import numpy as np
+
+# Reader for the results file radar_batch writes; the layout is described
+# in batch.h. Results come back as a numpy record array, one record per
+# capture in the order they were given, alongside their paths.
+
+BATCH_MAGIC = "BAT1"
+STATUSES = ('ok', 'unreadable', 'not a capture', 'never closed',
+            'other sample rates', 'too short')
+
+header_dtype = np.dtype([
+    ('magic', 'S4'), ('n_results', '<u4'), ('n_range', '<u4'),
+    ('range_bin', '<f4'), ('names_offset', '<u8'),
+])
+
+result_dtype = np.dtype([
+    ('status', '<u4'), ('prn', '<i4'), ('start_time', '<u8'),
+    ('frames', '<u8'), ('samples', '<u8'), ('dropped', '<u8'),
+    ('periods', '<u8'), ('peak_bin', '<u4'), ('peak', '<f4'),
+    ('noise', '<f4'), ('snr', '<f4'),
+])
+
+
+class BatchResults(object):
+    def __init__(self, filename="batch_results.dat"):
+        data = np.fromfile(filename, np.uint8)
+        header = data[:header_dtype.itemsize].view(header_dtype)[0]
+        if header['magic'] != BATCH_MAGIC:
+            raise ValueError("%s is not a batch results file" % filename)
+        self.n_range = int(header['n_range'])
+        self.range_bin = float(header['range_bin'])
+        start = header_dtype.itemsize
+        end = start + int(header['n_results']) * result_dtype.itemsize
+        self.results = data[start:end].view(result_dtype)
+        names = data[int(header['names_offset']):].tostring()
+        self.paths = names.split('\0')[:len(self.results)]
+
+    def __len__(self):
+        return len(self.results)
+
+    def delay(self, n):
+        """Delay of capture n's peak in seconds"""
+        return self.results[n]['peak_bin'] * self.range_bin
+
+
+if __name__ == '__main__':
+    batch = BatchResults(*sys.argv[1:2])
+    for n, path in enumerate(batch.paths):
+        r = batch.results[n]
+        if r['status'] != 0:
+            print "%-50s %s" % (path, STATUSES[r['status']])
+        else:
+            print "%-50s PRN %2d peak %6d (%.3fus) %6.1fdB" % (
+                path, r['prn'], r['peak_bin'], batch.delay(n) * 1e6,
+                r['snr'])
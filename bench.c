@@ -0,0 +1,607 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include "pool.h"
+#include "corr.h"
+#include "rdmap.h"
+#include "goldcode.h"
+#include "acq.h"
+#include "cfar.h"
+#include "resample.h"
+#include "iqcorr.h"
+#include "convert.h"
+#include "writer.h"
+#include "config.h"
+
+/*
+ * Benchmark of radar's processing stages.
+ *
+ * A frame of synthetic echoes is generated: the PRN's code as radar
+ * transmits it, delayed, attenuated, shifted in Doppler and with gaussian
+ * noise added, then cut to 12 bits as the bladeRF delivers it. Each stage
+ * then runs over the whole frame, buffer by buffer where radar works that
+ * way, for a number of iterations. Geometry comes from the defaults radar
+ * uses, which -s can change; with rx_decimation set, correlation and the
+ * stages after it run on the decimated frame.
+ *
+ * Results go to stdout as JSON: per stage the mean and best time for a
+ * frame, ns per sample and samples per second at the mean, plus where the
+ * correlator and acquisition found the echo and whether packing to SC12
+ * and back gave the samples back, as checks.
+ */
+
+#define BENCH_ITERATIONS 20
+#define TX_AMPLITUDE     2047
+
+#define KNRM "\x1B[0m"
+#define KRED "\x1B[31m"
+
+struct echo {
+    int    prn;
+    size_t delay;           // In RX samples
+    double atten;           // In dB
+    double noise;           // RMS, in LSBs
+    double doppler;         // In Hz
+};
+
+enum {
+    STAGE_SIGN_EXTEND,
+    STAGE_CONVERT,
+    STAGE_PACK,
+    STAGE_UNPACK,
+    STAGE_WRITE,
+    STAGE_IQ,
+    STAGE_RESAMPLE,
+    STAGE_CORRELATE,
+    STAGE_AVERAGE,
+    STAGE_CORRELATE_OLS,
+    STAGE_RDMAP,
+    STAGE_ACQUIRE,
+    STAGE_DETECT,
+    N_STAGES
+};
+
+static const char* stage_names[N_STAGES] = {
+    "sign_extend", "convert", "pack", "unpack", "write", "iq", "resample",
+    "correlate", "average", "correlate_ols", "rdmap", "acquire", "detect"
+};
+
+struct timing {
+    uint64_t total;         // In ns
+    uint64_t best;
+    int      runs;
+};
+
+
+static uint64_t now_ns(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+
+static void timing_add(struct timing* timing, uint64_t start)
+{
+    uint64_t ns = now_ns() - start;
+
+    timing->total += ns;
+    if(!timing->runs || ns < timing->best)
+        timing->best = ns;
+    timing->runs++;
+}
+
+
+static double gaussian(unsigned int* seed)
+{
+    double u1 = (rand_r(seed) + 1.0) / (RAND_MAX + 2.0);
+    double u2 = rand_r(seed) / (RAND_MAX + 1.0);
+
+    return sqrt(-2.0 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+
+static int16_t to_q11(double v)
+{
+    long q = lrint(v);
+
+    if(q > 2047)
+        q = 2047;
+    if(q < -2048)
+        q = -2048;
+    // Leave the top four bits unused, as the bladeRF does
+    return (int16_t)(q & 0x0fff);
+}
+
+
+/*
+ * n samples of the echo of a code repeating every code_len samples, the
+ * first of them transmitted at sample 0.
+ */
+static int generate_echo(const struct bladerf_config* cfg,
+                         const struct echo* echo, int16_t* samples, size_t n)
+{
+    size_t code_len = CODE_LEN_RX(cfg), i;
+    int8_t chips[GOLDCODE_LEN];
+    double amplitude = TX_AMPLITUDE * pow(10.0, -echo->atten / 20.0);
+    double phase, c;
+    unsigned int seed = 1;
+    float* code;
+
+    code = malloc(code_len * sizeof(float));
+    if(!code)
+        return 1;
+    goldcode_generate(echo->prn, chips);
+    goldcode_reference(chips, RX_SAMPLES_PER_CHIP(cfg), code, code_len);
+
+    for(i=0; i<n; i++) {
+        c = code[(i + code_len - echo->delay % code_len) % code_len];
+        phase = 2 * M_PI * echo->doppler * i / cfg->rx_sr;
+        samples[2*i] = to_q11(amplitude * c * cos(phase) +
+                              echo->noise * gaussian(&seed));
+        samples[2*i + 1] = to_q11(amplitude * c * sin(phase) +
+                                  echo->noise * gaussian(&seed));
+    }
+
+    free(code);
+    return 0;
+}
+
+
+static void rdmap_chunk(void* user_data, unsigned long period,
+                        const cf32* chunk)
+{
+    rdmap_add_profile(user_data, period, chunk);
+}
+
+
+struct bench {
+    struct bladerf_config  cfg;
+    struct echo            echo;
+    const char*            filename;    // Written and removed by STAGE_WRITE
+    bool                   direct;
+    uint32_t               format;      // Of the file STAGE_WRITE writes
+    int                    iterations;
+    const char*            kernels;
+    struct pool*           pool;
+    struct goldcode_cache* codes;
+    struct corr_pool*      corr;
+    struct corr_ols*       ols;         // Linear, a buffer at a time
+    struct rdmap*          rdmap;
+    struct acq*            acq;
+    struct cfar*           cfar;
+    struct resampler*      decimator;
+    struct iq_corrector*   iq;
+    int16_t*               samples;     // One frame
+    uint8_t*               packed;      // The frame as SC12
+    int16_t*               unpacked;    // And back again
+    int16_t*               corrected;   // A copy, IQ corrected
+    int16_t*               decimated;   // The frame by rx_decimation
+    int16_t*               corr_input;  // Whichever the correlator takes
+    cf32*                  converted;
+    float*                 profile;
+    float*                 ols_profile;
+    struct timing          timings[N_STAGES];
+    struct acq_result      acquired;
+};
+
+
+static int bench_create(struct bench* b, int n_workers)
+{
+    size_t n = b->cfg.rx_n_samples, code_len = CODE_LEN_CORR(&b->cfg);
+    size_t n_doppler = 1;
+    int8_t chips[GOLDCODE_LEN];
+    float* code;
+    struct acq_config acq_cfg = {
+        .n = code_len,
+        .sample_rate = CORR_SR(&b->cfg),
+        .doppler_min = ACQ_DOPPLER_MIN,
+        .doppler_step = ACQ_DOPPLER_STEP,
+        .n_doppler = ACQ_N_DOPPLER,
+        .max_codes = 1,
+        .threshold = ACQ_THRESHOLD,
+    };
+    struct cfar_config cfar_cfg = {
+        .type = CFAR_CA,
+        .guard = CFAR_GUARD,
+        .train = CFAR_TRAIN,
+        .pfa = CFAR_PFA,
+    };
+
+    while(n_doppler < n / CODE_LEN_RX(&b->cfg))
+        n_doppler *= 2;
+
+    b->samples = malloc(n * 2 * sizeof(int16_t));
+    b->packed = malloc(n * capture_sample_size(CAPTURE_FORMAT_SC12));
+    b->unpacked = malloc(n * 2 * sizeof(int16_t));
+    b->corrected = malloc(n * 2 * sizeof(int16_t));
+    b->decimated = malloc(n / b->cfg.rx_decimation * 2 * sizeof(int16_t));
+    b->converted = malloc(n * sizeof(cf32));
+    b->profile = malloc(code_len * sizeof(float));
+    b->ols_profile = malloc(code_len * sizeof(float));
+    b->pool = pool_create(n_workers);
+    b->codes = goldcode_cache_create(code_len, CORR_SAMPLES_PER_CHIP(&b->cfg),
+                                     CORR_DELAY(&b->cfg));
+    // With no decimation this is timed alone, as a filter
+    b->decimator = resampler_create(1, b->cfg.rx_decimation,
+                                    DECIMATION_HALF_LEN *
+                                    b->cfg.rx_decimation,
+                                    b->cfg.rx_samples_per_buffer);
+    b->iq = iq_corrector_create(fmax(1, IQ_TIME_CONSTANT * b->cfg.rx_sr /
+                                        b->cfg.rx_samples_per_buffer));
+    if(!b->samples || !b->packed || !b->unpacked || !b->corrected ||
+       !b->decimated || !b->converted || !b->profile || !b->ols_profile ||
+       !b->pool ||
+       !b->codes || !b->decimator || !b->iq)
+        return 1;
+    b->corr_input = b->cfg.rx_decimation > 1 ? b->decimated : b->samples;
+
+    b->corr = corr_pool_create(goldcode_spectrum(b->codes, b->echo.prn),
+                               code_len, b->pool,
+                               n / b->cfg.rx_samples_per_buffer);
+    code = malloc(code_len * sizeof(float));
+    if(code) {
+        goldcode_generate(b->echo.prn, chips);
+        goldcode_reference(chips, CORR_SAMPLES_PER_CHIP(&b->cfg), code,
+                           code_len);
+        b->ols = corr_ols_create(code, code_len, code_len, code_len,
+                                 CORR_DELAY(&b->cfg));
+        free(code);
+    }
+    b->rdmap = rdmap_create(code_len, n_doppler, b->pool);
+    b->acq = acq_create(&acq_cfg, b->pool);
+    b->cfar = cfar_create(&cfar_cfg, code_len, n_doppler * code_len);
+    if(!b->corr || !b->ols || !b->rdmap || !b->acq || !b->cfar)
+        return 1;
+
+    return generate_echo(&b->cfg, &b->echo, b->samples, n);
+}
+
+
+static void bench_destroy(struct bench* b)
+{
+    iq_corrector_destroy(b->iq);
+    resampler_destroy(b->decimator);
+    cfar_destroy(b->cfar);
+    acq_destroy(b->acq);
+    rdmap_destroy(b->rdmap);
+    corr_pool_destroy(b->corr);
+    corr_ols_destroy(b->ols);
+    goldcode_cache_destroy(b->codes);
+    pool_destroy(b->pool);
+    free(b->ols_profile);
+    free(b->profile);
+    free(b->converted);
+    free(b->decimated);
+    free(b->corrected);
+    free(b->unpacked);
+    free(b->packed);
+    free(b->samples);
+}
+
+
+// Returns 0 on success or 1 with errno set if the file could not be written
+static int bench_write(struct bench* b)
+{
+    struct capture_header header;
+    struct writer writer;
+    size_t n = b->cfg.rx_n_samples, spb = b->cfg.rx_samples_per_buffer, i;
+    void* buffer;
+    int status = 0;
+
+    capture_header_init(&header, &b->cfg, b->echo.prn, 0, n, b->format);
+    if(writer_open(&writer, b->filename, b->direct, &header))
+        return 1;
+    for(i=0; i<n && !status; i+=spb) {
+        buffer = b->samples + 2*i;
+        status = writer_write(&writer, &buffer, 1,
+                              spb * 2 * sizeof(int16_t), i);
+    }
+
+    return writer_close(&writer) || status;
+}
+
+
+// A buffer at a time, as the frame thread does with -I. A copy is
+// corrected so the frame the later stages check stays as generated.
+static void bench_correct(struct bench* b)
+{
+    size_t n = b->cfg.rx_n_samples, spb = b->cfg.rx_samples_per_buffer, i;
+
+    iq_corrector_reset(b->iq);
+    for(i=0; i<n; i+=spb)
+        iq_correct(b->iq, b->corrected + 2*i, spb);
+}
+
+
+// A buffer at a time, as the frame thread does
+static void bench_decimate(struct bench* b)
+{
+    size_t n = b->cfg.rx_n_samples, spb = b->cfg.rx_samples_per_buffer, i;
+    int16_t* out = b->decimated;
+
+    resampler_reset(b->decimator);
+    for(i=0; i<n; i+=spb)
+        out += 2 * resampler_run(b->decimator, b->samples + 2*i, spb, out);
+}
+
+
+// As the frame thread does: reset, then a job per buffer
+static void bench_correlate(struct bench* b)
+{
+    size_t n = b->cfg.rx_n_samples / b->cfg.rx_decimation;
+    size_t spb = b->cfg.rx_samples_per_buffer / b->cfg.rx_decimation, i;
+
+    corr_pool_reset(b->corr);
+    for(i=0; i<n; i+=spb)
+        corr_pool_add(b->corr, b->corr_input + 2*i, spb);
+    pool_wait(b->pool);
+}
+
+
+// Linear correlation on this thread, fed a buffer at a time as it arrives
+static void bench_correlate_ols(struct bench* b)
+{
+    size_t n = b->cfg.rx_n_samples / b->cfg.rx_decimation;
+    size_t spb = b->cfg.rx_samples_per_buffer / b->cfg.rx_decimation, i;
+
+    corr_ols_reset(b->ols);
+    for(i=0; i<n; i+=spb)
+        corr_ols_add(b->ols, b->corr_input + 2*i, spb);
+    corr_ols_flush(b->ols);
+    corr_ols_result(b->ols, b->ols_profile);
+}
+
+
+static int bench_run(struct bench* b)
+{
+    size_t n = b->cfg.rx_n_samples, code_len = CODE_LEN_CORR(&b->cfg);
+    size_t n_corr = n / b->cfg.rx_decimation;
+    const cf32* code = goldcode_spectrum(b->codes, b->echo.prn);
+    struct timing* timings = b->timings;
+    struct rdmap* rd = b->rdmap;
+    size_t d;
+    uint64_t t;
+    int it;
+
+    for(it=0; it<b->iterations; it++) {
+        t = now_ns();
+        sc16_sign_extend(b->samples, n);
+        timing_add(&timings[STAGE_SIGN_EXTEND], t);
+
+        t = now_ns();
+        sc16_to_cf32(b->samples, b->converted, n, 1.0f / 2048);
+        timing_add(&timings[STAGE_CONVERT], t);
+
+        t = now_ns();
+        sc16_to_sc12(b->samples, b->packed, n);
+        timing_add(&timings[STAGE_PACK], t);
+
+        t = now_ns();
+        sc12_to_sc16(b->packed, b->unpacked, n);
+        timing_add(&timings[STAGE_UNPACK], t);
+
+        t = now_ns();
+        if(bench_write(b)) {
+            unlink(b->filename);
+            return 1;
+        }
+        timing_add(&timings[STAGE_WRITE], t);
+
+        memcpy(b->corrected, b->samples, n * 2 * sizeof(int16_t));
+        t = now_ns();
+        bench_correct(b);
+        timing_add(&timings[STAGE_IQ], t);
+
+        t = now_ns();
+        bench_decimate(b);
+        timing_add(&timings[STAGE_RESAMPLE], t);
+
+        t = now_ns();
+        bench_correlate(b);
+        timing_add(&timings[STAGE_CORRELATE], t);
+
+        t = now_ns();
+        corr_pool_result(b->corr, b->profile);
+        timing_add(&timings[STAGE_AVERAGE], t);
+
+        t = now_ns();
+        bench_correlate_ols(b);
+        timing_add(&timings[STAGE_CORRELATE_OLS], t);
+
+        // Only the map itself is timed; filling it is correlation time
+        corr_pool_set_chunk_cb(b->corr, rdmap_chunk, b->rdmap);
+        bench_correlate(b);
+        corr_pool_set_chunk_cb(b->corr, NULL, NULL);
+        t = now_ns();
+        rdmap_compute(b->rdmap, b->corr->periods, b->pool);
+        timing_add(&timings[STAGE_RDMAP], t);
+
+        t = now_ns();
+        acq_search(b->acq, b->corr_input + 2 * (n_corr - code_len), &code, 1,
+                   &b->acquired);
+        timing_add(&timings[STAGE_ACQUIRE], t);
+
+        // As radar -m -C ca does, over each Doppler bin of the map
+        t = now_ns();
+        cfar_reset(b->cfar);
+        for(d=0; d<rd->n_doppler; d++) {
+            cfar_run(b->cfar, rd->map + d, rd->n_range, rd->n_doppler,
+                     (int32_t)d - (int32_t)(rd->n_doppler / 2));
+        }
+        timing_add(&timings[STAGE_DETECT], t);
+    }
+
+    unlink(b->filename);
+    return 0;
+}
+
+
+static void print_results(const struct bench* b)
+{
+    const struct bladerf_config* cfg = &b->cfg;
+    double mean, n = cfg->rx_n_samples;
+    size_t peak_bin = 0, ols_peak_bin = 0, i;
+
+    for(i=1; i<CODE_LEN_CORR(cfg); i++) {
+        if(b->profile[i] > b->profile[peak_bin])
+            peak_bin = i;
+        if(b->ols_profile[i] > b->ols_profile[ols_peak_bin])
+            ols_peak_bin = i;
+    }
+
+    printf("{\n");
+    printf("  \"frame_samples\": %u, \"samples_per_buffer\": %u, "
+           "\"code_len\": %u, \"decimation\": %u,\n", cfg->rx_n_samples,
+           cfg->rx_samples_per_buffer, CODE_LEN_CORR(cfg),
+           cfg->rx_decimation);
+    printf("  \"rx_sr\": %u, \"kernels\": \"%s\", \"workers\": %d, "
+           "\"iterations\": %d, \"file_format\": \"%s\",\n", cfg->rx_sr,
+           b->kernels, b->pool->n_workers, b->iterations,
+           b->format == CAPTURE_FORMAT_SC12 ? "sc12" : "sc16");
+    printf("  \"echo\": {\"prn\": %d, \"delay\": %zu, \"atten_db\": %g, "
+           "\"noise_rms\": %g, \"doppler_hz\": %g},\n", b->echo.prn,
+           b->echo.delay, b->echo.atten, b->echo.noise, b->echo.doppler);
+    printf("  \"stages\": {\n");
+    for(i=0; i<N_STAGES; i++) {
+        mean = (double)b->timings[i].total / b->timings[i].runs;
+        printf("    \"%s\": {\"mean_ns\": %.0f, \"best_ns\": %llu, "
+               "\"ns_per_sample\": %.3f, \"samples_per_second\": %.0f}%s\n",
+               stage_names[i], mean, (unsigned long long)b->timings[i].best,
+               mean / n, n * 1e9 / mean, i < N_STAGES - 1 ? "," : "");
+    }
+    printf("  },\n");
+    printf("  \"check\": {\"peak_bin\": %zu, \"ols_peak_bin\": %zu, "
+           "\"acquired\": %s, \"code_phase\": %zu, \"doppler_hz\": %.0f, "
+           "\"detections\": %zu, \"sc12_round_trip\": %s}\n", peak_bin,
+           ols_peak_bin, b->acquired.detected ? "true" : "false",
+           b->acquired.code_phase,
+           b->acquired.doppler, b->cfar->n_detections,
+           memcmp(b->samples, b->unpacked, n * 2 * sizeof(int16_t)) ?
+           "false" : "true");
+    printf("}\n");
+}
+
+
+static void usage(const char* argv0)
+{
+    printf("Usage: %s [-i iterations] [-j workers] [-P prn] [-d delay]\n"
+           "       [-a atten] [-n noise] [-f doppler] [-o file] [-D] [-k]\n"
+           "       [-s name=value]...\n", argv0);
+    printf("  -i iterations Runs of each stage, default %d\n",
+           BENCH_ITERATIONS);
+    printf("  -j workers    Worker threads, default one per CPU\n");
+    printf("  -P prn        Gold code of the echo, default 1\n");
+    printf("  -d delay      Echo delay in RX samples, default 100\n");
+    printf("  -a atten      Echo attenuation in dB, default 20\n");
+    printf("  -n noise      Noise RMS in LSBs, default 16\n");
+    printf("  -f doppler    Echo Doppler shift in Hz, default 1000\n");
+    printf("  -o file       File the write stage writes and removes,\n"
+           "                default ./bench_capture.dat\n");
+    printf("  -D            Write with O_DIRECT\n");
+    printf("  -k            Write packed SC12 samples\n");
+    printf("  -s setting    Override a default setting, as radar's -s\n");
+}
+
+
+int main(int argc, char** argv)
+{
+    struct bench b = {
+        .echo = { .prn = 1, .delay = 100, .atten = 20, .noise = 16,
+                  .doppler = 1000 },
+        .filename = "./bench_capture.dat",
+        .iterations = BENCH_ITERATIONS,
+    };
+    const char* error;
+    int opt, n_workers = -1;
+
+    config_defaults(&b.cfg);
+
+    while((opt = getopt(argc, argv, "i:j:P:d:a:n:f:o:Dks:")) != -1) {
+        switch(opt) {
+            case 'i':
+                b.iterations = atoi(optarg);
+                break;
+            case 'j':
+                n_workers = atoi(optarg);
+                break;
+            case 'P':
+                b.echo.prn = atoi(optarg);
+                break;
+            case 'd':
+                b.echo.delay = strtoul(optarg, NULL, 0);
+                break;
+            case 'a':
+                b.echo.atten = atof(optarg);
+                break;
+            case 'n':
+                b.echo.noise = atof(optarg);
+                break;
+            case 'f':
+                b.echo.doppler = atof(optarg);
+                break;
+            case 'o':
+                b.filename = optarg;
+                break;
+            case 'D':
+                b.direct = true;
+                break;
+            case 'k':
+                b.format = CAPTURE_FORMAT_SC12;
+                break;
+            case 's':
+                if(!config_set(&b.cfg, optarg)) {
+                    break;
+                }
+                fprintf(stderr, KRED "Not a valid setting: %s" KNRM "\n",
+                        optarg);
+                return 1;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    error = config_check(&b.cfg);
+    if(error) {
+        fprintf(stderr, KRED "Invalid settings: %s" KNRM "\n", error);
+        return 1;
+    }
+    if(b.echo.prn < 1 || b.echo.prn > GOLDCODE_N_PRNS || b.iterations < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    if(n_workers < 0) {
+        n_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    // Progress goes to stderr, leaving stdout to the results
+    b.kernels = convert_init();
+    if(bench_create(&b, n_workers > 0 ? n_workers : 0)) {
+        fprintf(stderr, KRED "Failed: %s" KNRM "\n", strerror(ENOMEM));
+        bench_destroy(&b);
+        return 1;
+    }
+
+    fprintf(stderr, "%d iterations of %u samples... ", b.iterations,
+            b.cfg.rx_n_samples);
+    fflush(stderr);
+    if(bench_run(&b)) {
+        fprintf(stderr, KRED "Failed to write %s: %s" KNRM "\n", b.filename,
+                strerror(errno));
+        bench_destroy(&b);
+        return 1;
+    }
+    fprintf(stderr, "done\n");
+
+    print_results(&b);
+    bench_destroy(&b);
+    return 0;
+}
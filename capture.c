@@ -0,0 +1,125 @@
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "capture.h"
+
+
+void capture_header_init(struct capture_header* header,
+                         const struct bladerf_config* config, int prn,
+                         uint64_t start_time, uint32_t frame_samples,
+                         uint32_t format)
+{
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, CAPTURE_MAGIC, sizeof(header->magic));
+    header->version = CAPTURE_VERSION;
+    header->header_size = CAPTURE_ALIGN;
+    header->frame_samples = frame_samples;
+    header->tx_freq = config->tx_freq;
+    header->rx_freq = config->rx_freq;
+    header->tx_bw = config->tx_bw;
+    header->rx_bw = config->rx_bw;
+    header->tx_sr = config->tx_sr;
+    header->rx_sr = config->rx_sr;
+    header->txvga1 = config->txvga1;
+    header->txvga2 = config->txvga2;
+    header->rxvga1 = config->rxvga1;
+    header->rxvga2 = config->rxvga2;
+    header->lna = config->lna;
+    header->prn = prn;
+    header->start_time = start_time;
+    header->format = format;
+}
+
+
+uint64_t capture_time_now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_REALTIME, &t);
+    return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+
+// Returns 0 if the mapped file holds a whole capture, else 2 or 3
+static int capture_check(const struct capture_file* capture)
+{
+    const struct capture_header* h = capture->header;
+    const struct capture_index* index;
+    size_t sample_size;
+    uint64_t i;
+
+    if(capture->size < CAPTURE_ALIGN ||
+       memcmp(h->magic, CAPTURE_MAGIC, sizeof(h->magic)) ||
+       h->version < 1 || h->version > CAPTURE_VERSION ||
+       h->header_size < sizeof(*h) || h->header_size > capture->size ||
+       h->format > CAPTURE_FORMAT_SC12)
+        return 2;
+    if(!h->index_offset)
+        return 3;
+    if(h->index_offset > capture->size || h->n_frames >
+       (capture->size - h->index_offset) / sizeof(struct capture_index))
+        return 2;
+
+    index = (const struct capture_index*)(capture->data + h->index_offset);
+    sample_size = capture_sample_size(h->format);
+    for(i=0; i<h->n_frames; i++) {
+        if(index[i].offset < h->header_size ||
+           index[i].offset > h->index_offset ||
+           index[i].n_samples >
+           (h->index_offset - index[i].offset) / sample_size)
+            return 2;
+    }
+
+    return 0;
+}
+
+
+int capture_map(struct capture_file* capture, const char* filename)
+{
+    struct stat st;
+    void* data;
+    int fd, status;
+
+    memset(capture, 0, sizeof(*capture));
+    fd = open(filename, O_RDONLY);
+    if(fd < 0)
+        return 1;
+    if(fstat(fd, &st)) {
+        close(fd);
+        return 1;
+    }
+    if(!S_ISREG(st.st_mode) || st.st_size < CAPTURE_ALIGN) {
+        close(fd);
+        return 2;
+    }
+
+    // The mapping keeps the file open
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED)
+        return 1;
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    capture->data = data;
+    capture->size = st.st_size;
+    capture->header = data;
+    capture->index = (const struct capture_index*)
+                     (capture->data + capture->header->index_offset);
+    status = capture_check(capture);
+    if(status)
+        capture_unmap(capture);
+
+    return status;
+}
+
+
+void capture_unmap(struct capture_file* capture)
+{
+    if(capture->data)
+        munmap((void*)capture->data, capture->size);
+    memset(capture, 0, sizeof(*capture));
+}
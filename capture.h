@@ -0,0 +1,110 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+/*
+ * Capture file format for bladerf_samples.dat and recordings.
+ *
+ * A capture starts with a CAPTURE_ALIGN byte page holding a struct
+ * capture_header, zero padded. Frames of I/Q samples follow, in the
+ * header's format: SC16, or SC12 packed three bytes to a sample. Each
+ * frame starts on a CAPTURE_ALIGN boundary and is zero padded to the next
+ * one, so any frame can be mapped on its own. A frame holds at most
+ * frame_samples samples, all contiguous in time; a frame is cut short
+ * wherever samples were dropped. After the last frame, at index_offset,
+ * comes an array of n_frames struct capture_index entries. Everything is
+ * little-endian.
+ *
+ * index_offset stays 0 until the capture has been closed, which tells
+ * readers the file is incomplete. Version 1 files have no format, which
+ * reads as SC16.
+ */
+
+#define CAPTURE_MAGIC   "RCAP"
+#define CAPTURE_VERSION 2
+#define CAPTURE_ALIGN   4096
+
+#define CAPTURE_FORMAT_SC16 0       // int16 I then Q, sign-extended
+#define CAPTURE_FORMAT_SC12 1       // Packed as by sc16_to_sc12
+
+struct capture_header {
+    char     magic[4];
+    uint32_t version;
+    uint32_t header_size;     // Offset of the first frame
+    uint32_t frame_samples;   // Most samples in one frame
+    uint32_t tx_freq;         // Settings as in struct bladerf_config
+    uint32_t rx_freq;
+    uint32_t tx_bw;
+    uint32_t rx_bw;
+    uint32_t tx_sr;
+    uint32_t rx_sr;
+    int32_t  txvga1;
+    int32_t  txvga2;
+    int32_t  rxvga1;
+    int32_t  rxvga2;
+    int32_t  lna;
+    int32_t  prn;             // Code transmitted
+    uint64_t start_time;      // CLOCK_REALTIME at sample 0, in ns
+    uint64_t n_frames;
+    uint64_t index_offset;
+    uint32_t format;          // CAPTURE_FORMAT_*
+};
+
+struct capture_index {
+    uint64_t offset;          // Of the frame in the file
+    uint64_t sample;          // First sample, counted from sample 0
+    uint64_t n_samples;
+    uint64_t time;            // start_time plus sample / rx_sr, in ns
+};
+
+/* Fill in a header for a capture of frames of up to frame_samples */
+void capture_header_init(struct capture_header* header,
+                         const struct bladerf_config* config, int prn,
+                         uint64_t start_time, uint32_t frame_samples,
+                         uint32_t format);
+
+/* Bytes of one I/Q sample on disk */
+static inline size_t capture_sample_size(uint32_t format)
+{
+    return format == CAPTURE_FORMAT_SC12 ? 3 : 2 * sizeof(int16_t);
+}
+
+/* Bytes from one frame to the next for frames of n samples */
+static inline uint64_t capture_frame_stride(uint64_t n, uint32_t format)
+{
+    return (n * capture_sample_size(format) + CAPTURE_ALIGN - 1) &
+           ~(uint64_t)(CAPTURE_ALIGN - 1);
+}
+
+/* A closed capture mapped read-only by capture_map */
+struct capture_file {
+    const uint8_t*               data;
+    size_t                       size;
+    const struct capture_header* header;
+    const struct capture_index*  index;    // header->n_frames entries
+};
+
+/*
+ * Map a capture for reading, checking that the header, index and every
+ * frame lie within the file. Pages are read ahead as they are first
+ * touched, for reading front to back. Returns 0 on success, 1 with errno
+ * set if the file could not be mapped, 2 if it is not a capture, or 3 if
+ * it was never closed.
+ */
+int capture_map(struct capture_file* capture, const char* filename);
+void capture_unmap(struct capture_file* capture);
+
+/* Frame n's samples, in the header's format */
+static inline const void* capture_frame(const struct capture_file* capture,
+                                        uint64_t n)
+{
+    return capture->data + capture->index[n].offset;
+}
+
+/* CLOCK_REALTIME now, in ns */
+uint64_t capture_time_now(void);
+
+#endif
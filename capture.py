@@ -0,0 +1,68 @@
+import numpy as np
+
+# Reader for the capture files radar writes; the layout is described in
+# capture.h. Frames are memory mapped, so only the frames read are loaded.
+
+CAPTURE_MAGIC = "RCAP"
+CAPTURE_FORMAT_SC12 = 1
+
+header_dtype = np.dtype([
+    ('magic', 'S4'), ('version', '<u4'), ('header_size', '<u4'),
+    ('frame_samples', '<u4'),
+    ('tx_freq', '<u4'), ('rx_freq', '<u4'), ('tx_bw', '<u4'),
+    ('rx_bw', '<u4'), ('tx_sr', '<u4'), ('rx_sr', '<u4'),
+    ('txvga1', '<i4'), ('txvga2', '<i4'), ('rxvga1', '<i4'),
+    ('rxvga2', '<i4'), ('lna', '<i4'), ('prn', '<i4'),
+    ('start_time', '<u8'), ('n_frames', '<u8'), ('index_offset', '<u8'),
+    ('format', '<u4'),
+])
+
+index_dtype = np.dtype([
+    ('offset', '<u8'), ('sample', '<u8'), ('n_samples', '<u8'),
+    ('time', '<u8'),
+])
+
+
+class Capture(object):
+    def __init__(self, filename):
+        self.data = np.memmap(filename, np.uint8, 'r')
+        header = self.data[:header_dtype.itemsize].view(header_dtype)[0]
+        if header['magic'] != CAPTURE_MAGIC:
+            raise ValueError("%s is not a capture file" % filename)
+        if header['index_offset'] == 0:
+            raise ValueError("%s was not closed properly" % filename)
+        self.header = dict((name, header[name]) for name in header_dtype.names)
+        start = int(header['index_offset'])
+        end = start + int(header['n_frames']) * index_dtype.itemsize
+        self.index = self.data[start:end].view(index_dtype)
+
+    def __len__(self):
+        return len(self.index)
+
+    def frame(self, n):
+        """Complex samples of frame n, scaled to +-1"""
+        entry = self.index[n]
+        start = int(entry['offset'])
+        if self.header['format'] == CAPTURE_FORMAT_SC12:
+            # Three bytes a sample, the 24-bit value I | Q << 12
+            end = start + int(entry['n_samples']) * 3
+            b = self.data[start:end].reshape((-1, 3)).astype(np.int32)
+            w = b[:, 0] | (b[:, 1] << 8) | (b[:, 2] << 16)
+            i = ((w & 0xfff) ^ 0x800) - 0x800
+            q = ((w >> 12) ^ 0x800) - 0x800
+            return (i + 1j * q) / 2048.0
+        end = start + int(entry['n_samples']) * 4
+        iq = self.data[start:end].view('<i2').reshape((-1, 2))
+        return (iq[:, 0] + 1j * iq[:, 1]) / 2048.0
+
+    def frame_at(self, sample):
+        """Index of the frame holding sample, or None if it was dropped"""
+        n = np.searchsorted(self.index['sample'], sample, 'right') - 1
+        if n < 0 or sample >= (self.index[n]['sample'] +
+                               self.index[n]['n_samples']):
+            return None
+        return n
+
+    def samples(self):
+        """Every sample in the capture, gaps closed up"""
+        return np.concatenate([self.frame(n) for n in range(len(self))])
@@ -0,0 +1,201 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "cfar.h"
+
+
+// Probability noise alone beats alpha times the rank'th of n training cells
+static double os_pfa(size_t n, size_t rank, double alpha)
+{
+    double p = 1.0;
+    size_t i;
+
+    for(i=0; i<rank; i++)
+        p *= (n - i) / (n - i + alpha);
+    return p;
+}
+
+
+/*
+ * Scale factor for square-law detected noise, which is exponentially
+ * distributed: closed form for CA, found by bisection for OS.
+ */
+static double cfar_alpha(const struct cfar_config* cfg)
+{
+    size_t n = 2 * cfg->train;
+    double lo = 0, hi = 1, mid;
+    int i;
+
+    if(cfg->type == CFAR_CA)
+        return n * (pow(cfg->pfa, -1.0 / n) - 1);
+
+    while(os_pfa(n, cfg->rank, hi) > cfg->pfa)
+        hi *= 2;
+    for(i=0; i<100; i++) {
+        mid = (lo + hi) / 2;
+        if(os_pfa(n, cfg->rank, mid) > cfg->pfa)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return hi;
+}
+
+
+struct cfar* cfar_create(const struct cfar_config* cfg, size_t max_n,
+                         size_t max_detections)
+{
+    struct cfar* cfar;
+
+    if(!cfg->train || cfg->pfa <= 0 || cfg->pfa >= 1 ||
+       cfg->rank > 2 * cfg->train)
+        return NULL;
+
+    cfar = calloc(1, sizeof(struct cfar));
+    if(!cfar)
+        return NULL;
+
+    cfar->cfg = *cfg;
+    if(cfar->cfg.rank == 0)
+        cfar->cfg.rank = (3 * cfg->train + 1) / 2;
+    cfar->alpha = cfar_alpha(&cfar->cfg);
+    cfar->max_n = max_n;
+    cfar->max_detections = max_detections;
+    cfar->line = malloc((max_n + 2 * (cfg->guard + cfg->train + 1)) *
+                        sizeof(float));
+    cfar->detections = calloc(max_detections, sizeof(struct cfar_detection));
+    if(cfg->type == CFAR_OS)
+        cfar->window = malloc(2 * cfg->train * sizeof(float));
+    if(!cfar->line || !cfar->detections ||
+       (cfg->type == CFAR_OS && !cfar->window)) {
+        cfar_destroy(cfar);
+        return NULL;
+    }
+
+    return cfar;
+}
+
+
+void cfar_destroy(struct cfar* cfar)
+{
+    if(!cfar)
+        return;
+
+    free(cfar->window);
+    free(cfar->line);
+    free(cfar->detections);
+    free(cfar);
+}
+
+
+void cfar_reset(struct cfar* cfar)
+{
+    cfar->n_detections = 0;
+    cfar->missed = 0;
+}
+
+
+static int compare_float(const void* a, const void* b)
+{
+    float fa = *(const float*)a, fb = *(const float*)b;
+
+    return (fa > fb) - (fa < fb);
+}
+
+
+// Swap one value of the sorted window for another, keeping it sorted
+static void window_replace(float* window, size_t n, float old, float new)
+{
+    size_t lo = 0, hi = n, mid, i;
+
+    while(lo < hi) {
+        mid = (lo + hi) / 2;
+        if(window[mid] < old)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    i = lo;
+
+    while(i + 1 < n && window[i + 1] < new) {
+        window[i] = window[i + 1];
+        i++;
+    }
+    while(i > 0 && window[i - 1] > new) {
+        window[i] = window[i - 1];
+        i--;
+    }
+    window[i] = new;
+}
+
+
+static size_t cfar_test(struct cfar* cfar, const float* x, long i,
+                        double noise, int32_t doppler)
+{
+    struct cfar_detection* d;
+    float v = x[i];
+
+    if(v <= cfar->alpha * noise || v < x[i - 1] || v < x[i + 1])
+        return 0;
+
+    if(cfar->n_detections == cfar->max_detections) {
+        cfar->missed++;
+        return 0;
+    }
+    d = &cfar->detections[cfar->n_detections++];
+    d->range = i;
+    d->doppler = doppler;
+    d->snr = noise > 0 ? 10 * log10f(v / noise) : INFINITY;
+    return 1;
+}
+
+
+size_t cfar_run(struct cfar* cfar, const float* x, size_t n, size_t stride,
+                int32_t doppler)
+{
+    long g = cfar->cfg.guard, t = cfar->cfg.train, pad = g + t + 1, i, j;
+    long len = n;
+    float* line = cfar->line + pad;
+    float* window = cfar->window;
+    double lead = 0, lag = 0;
+    size_t found = 0;
+
+    if(n <= 2 * (cfar->cfg.guard + cfar->cfg.train) || n > cfar->max_n)
+        return 0;
+
+    // Gather the run with pad cells of wrap-around either side
+    for(i=0; i<len; i++)
+        line[i] = x[i * stride];
+    for(i=1; i<=pad; i++) {
+        line[-i] = line[len - i];
+        line[len - 1 + i] = line[i - 1];
+    }
+
+    if(cfar->cfg.type == CFAR_CA) {
+        for(j=g+1; j<=g+t; j++) {
+            lead += line[j];
+            lag += line[-j];
+        }
+        for(i=0; i<len; i++) {
+            found += cfar_test(cfar, line, i, (lead + lag) / (2 * t),
+                               doppler);
+            lead += line[i + g + t + 1] - line[i + g + 1];
+            lag += line[i - g] - line[i - g - t];
+        }
+        return found;
+    }
+
+    for(j=0; j<t; j++) {
+        window[j] = line[g + 1 + j];
+        window[t + j] = line[-g - 1 - j];
+    }
+    qsort(window, 2 * t, sizeof(float), compare_float);
+    for(i=0; i<len; i++) {
+        found += cfar_test(cfar, line, i, window[cfar->cfg.rank - 1],
+                           doppler);
+        window_replace(window, 2 * t, line[i + g + 1], line[i + g + t + 1]);
+        window_replace(window, 2 * t, line[i - g - t], line[i - g]);
+    }
+
+    return found;
+}
@@ -0,0 +1,96 @@
+#ifndef CFAR_H
+#define CFAR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Constant false alarm rate detector for correlation profiles and
+ * range-Doppler maps.
+ *
+ * Each cell is compared against a noise level estimated from train cells
+ * either side of it, skipping guard cells next to it, and scaled so that
+ * noise alone crosses the threshold with probability pfa. Cell averaging
+ * (CA) takes the mean of the training cells, kept as two running sums that
+ * each move by one cell per step, so a run costs O(n) whatever the window.
+ * Ordered statistic (OS) takes the rank'th smallest instead, from a sorted
+ * copy of the window updated as it slides, which copes better with a second
+ * target in the window. Cells are treated as circular, as the correlation
+ * is, and only cells at least as strong as both neighbours are reported, so
+ * a target gives one detection per run rather than one per cell it spans.
+ */
+
+// Detector radar uses
+#define CFAR_GUARD 4
+#define CFAR_TRAIN 16
+#define CFAR_PFA   1e-6
+
+#define CFAR_MAGIC "DET1"
+
+enum cfar_type {
+    CFAR_CA,
+    CFAR_OS
+};
+
+struct cfar_config {
+    enum cfar_type type;
+    size_t guard;           // Cells each side of the cell under test skipped
+    size_t train;           // Training cells each side
+    size_t rank;            // OS: 1 to 2 * train, 0 for 3/4 of the way up
+    double pfa;             // Probability of a false alarm per cell
+};
+
+struct cfar_detection {
+    uint32_t range;         // Range bin
+    int32_t  doppler;       // Doppler bin, 0 for zero Doppler
+    float    snr;           // Cell over the noise estimate, in dB
+};
+
+/*
+ * Detections of one frame as saved by radar: a header and then n_detections
+ * struct cfar_detection, one after another in a file for a run.
+ */
+struct cfar_header {
+    char     magic[4];
+    uint32_t n_detections;
+    uint64_t frame;
+    float    prf;           // Code periods per second
+    float    range_bin;     // Seconds of delay per range bin
+    uint32_t n_range;
+    uint32_t n_doppler;     // Doppler bins in the map, 1 for a profile
+    uint32_t missed;        // Detections past the limit, not saved
+    uint32_t reserved;
+};
+
+struct cfar {
+    struct cfar_config     cfg;
+    float                  alpha;       // Threshold over the noise estimate
+    size_t                 max_n;
+    float*                 line;        // The run being tested, padded
+    float*                 window;      // OS: the training cells, sorted
+    struct cfar_detection* detections;
+    size_t                 n_detections;
+    size_t                 max_detections;
+    unsigned long          missed;      // Detections past max_detections
+};
+
+/*
+ * For runs of up to max_n cells. Returns NULL if out of memory or cfg does
+ * not make sense.
+ */
+struct cfar* cfar_create(const struct cfar_config* cfg, size_t max_n,
+                         size_t max_detections);
+void cfar_destroy(struct cfar* cfar);
+
+/* Forget the detections so far */
+void cfar_reset(struct cfar* cfar);
+
+/*
+ * Detect along n power values stride apart in x, adding them to the list
+ * tagged with doppler. n must be more than 2 * (guard + train) and at
+ * most max_n. Returns the number of detections added.
+ */
+size_t cfar_run(struct cfar* cfar, const float* x, size_t n, size_t stride,
+                int32_t doppler);
+
+#endif
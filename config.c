@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include "config.h"
+#include "goldcode.h"
+#include "backend.h"
+
+// Defaults for anything bladerf_config.json or -s does not set
+#define TXFREQ 3410000000
+#define TXBW   28000000
+#define TXSR   20000000
+#define TXVGA1 -4
+#define TXVGA2 25
+
+#define RXFREQ 3410000000
+#define RXBW   28000000
+#define RXSR   40000000
+#define RXVGA1 30
+#define RXVGA2 30
+#define LNA RADIO_LNA_GAIN_MAX
+
+#define TX_N_BUFFERS          32
+#define TX_SAMPLES_PER_BUFFER 1024
+#define TX_N_SAMPLES          (130*1024)
+#define TX_N_TRANSFERS        32
+
+#define RX_SAMPLES_PER_BUFFER 2048
+#define RX_N_SAMPLES          (250*1024)
+#define RX_N_TRANSFERS        32
+#define RX_DECIMATION         1
+
+#define CONFIG_MAX_SIZE 65536
+
+struct config_field {
+    const char* name;
+    size_t      offset;
+    bool        is_signed;
+};
+
+#define FIELD(name, is_signed) \
+    { #name, offsetof(struct bladerf_config, name), is_signed }
+
+static const struct config_field fields[] = {
+    FIELD(tx_freq, false),
+    FIELD(rx_freq, false),
+    FIELD(tx_bw, false),
+    FIELD(rx_bw, false),
+    FIELD(tx_sr, false),
+    FIELD(rx_sr, false),
+    FIELD(txvga1, true),
+    FIELD(txvga2, true),
+    FIELD(rxvga1, true),
+    FIELD(rxvga2, true),
+    FIELD(lna, true),
+    FIELD(tx_n_buffers, false),
+    FIELD(tx_samples_per_buffer, false),
+    FIELD(tx_n_samples, false),
+    FIELD(tx_n_transfers, false),
+    FIELD(rx_samples_per_buffer, false),
+    FIELD(rx_n_samples, false),
+    FIELD(rx_n_transfers, false),
+    FIELD(rx_decimation, false),
+};
+
+#define N_FIELDS (sizeof(fields) / sizeof(fields[0]))
+
+
+static const struct config_field* find_field(const char* name, size_t len)
+{
+    size_t i;
+
+    for(i=0; i<N_FIELDS; i++) {
+        if(strlen(fields[i].name) == len &&
+           strncmp(fields[i].name, name, len) == 0)
+            return &fields[i];
+    }
+
+    return NULL;
+}
+
+
+/* Parse an integer for field from s, returning where it ended or NULL */
+static const char* set_field(struct bladerf_config* config,
+                             const struct config_field* field, const char* s)
+{
+    char* end;
+    long long value;
+
+    errno = 0;
+    value = strtoll(s, &end, 10);
+    if(end == s || errno)
+        return NULL;
+
+    if(field->is_signed) {
+        if(value < -2147483647LL - 1 || value > 2147483647LL)
+            return NULL;
+        *(int*)((char*)config + field->offset) = value;
+    } else {
+        if(value < 0 || value > 4294967295LL)
+            return NULL;
+        *(unsigned int*)((char*)config + field->offset) = value;
+    }
+
+    return end;
+}
+
+
+int config_read(struct bladerf_config* config, const char* filename)
+{
+    const struct config_field* field;
+    const char* p;
+    const char* key;
+    const char* end;
+    char* text;
+    size_t len;
+    FILE* fin;
+
+    fin = fopen(filename, "r");
+    if(!fin)
+        return 1;
+
+    text = malloc(CONFIG_MAX_SIZE + 1);
+    if(!text) {
+        fclose(fin);
+        errno = ENOMEM;
+        return 1;
+    }
+    len = fread(text, 1, CONFIG_MAX_SIZE, fin);
+    fclose(fin);
+    text[len] = '\0';
+
+    // Look for "name": value pairs, skipping anything unrecognised
+    p = text;
+    while((key = strchr(p, '"'))) {
+        key++;
+        end = strchr(key, '"');
+        if(!end)
+            break;
+        p = end + 1;
+        while(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+            p++;
+        if(*p != ':')
+            continue;
+        p++;
+
+        field = find_field(key, end - key);
+        if(!field)
+            continue;
+        p = set_field(config, field, p);
+        if(!p) {
+            free(text);
+            return 2;
+        }
+    }
+
+    free(text);
+    return 0;
+}
+
+
+int config_write(const struct bladerf_config* config, const char* filename)
+{
+    const char* base = (const char*)config;
+    size_t i;
+    FILE* fout;
+
+    fout = fopen(filename, "w");
+    if(!fout)
+        return 1;
+
+    fprintf(fout, "{\n");
+    for(i=0; i<N_FIELDS; i++) {
+        if(fields[i].is_signed) {
+            fprintf(fout, "    \"%s\": %d", fields[i].name,
+                    *(const int*)(base + fields[i].offset));
+        } else {
+            fprintf(fout, "    \"%s\": %u", fields[i].name,
+                    *(const unsigned int*)(base + fields[i].offset));
+        }
+        fprintf(fout, i + 1 < N_FIELDS ? ",\n" : "\n");
+    }
+    fprintf(fout, "}\n");
+
+    return fclose(fout) ? 1 : 0;
+}
+
+
+int config_set(struct bladerf_config* config, const char* setting)
+{
+    const struct config_field* field;
+    const char* equals;
+    const char* end;
+
+    equals = strchr(setting, '=');
+    if(!equals)
+        return 1;
+
+    field = find_field(setting, equals - setting);
+    if(!field)
+        return 1;
+
+    end = set_field(config, field, equals + 1);
+    return (!end || *end) ? 1 : 0;
+}
+
+
+void config_defaults(struct bladerf_config* config)
+{
+    config->tx_freq = TXFREQ;
+    config->rx_freq = RXFREQ;
+    config->tx_bw = TXBW;
+    config->rx_bw = RXBW;
+    config->tx_sr = TXSR;
+    config->rx_sr = RXSR;
+    config->txvga1 = TXVGA1;
+    config->txvga2 = TXVGA2;
+    config->rxvga1 = RXVGA1;
+    config->rxvga2 = RXVGA2;
+    config->lna = LNA;
+    config->tx_n_buffers = TX_N_BUFFERS;
+    config->tx_samples_per_buffer = TX_SAMPLES_PER_BUFFER;
+    config->tx_n_samples = TX_N_SAMPLES;
+    config->tx_n_transfers = TX_N_TRANSFERS;
+    config->rx_samples_per_buffer = RX_SAMPLES_PER_BUFFER;
+    config->rx_n_samples = RX_N_SAMPLES;
+    config->rx_n_transfers = RX_N_TRANSFERS;
+    config->rx_decimation = RX_DECIMATION;
+}
+
+
+const char* config_check(const struct bladerf_config* config)
+{
+    unsigned int code_len;
+
+    if(!config->tx_sr || !config->rx_sr || config->rx_sr % config->tx_sr)
+        return "rx_sr must be a multiple of tx_sr";
+    if(!config->tx_n_buffers || !config->tx_samples_per_buffer ||
+       !config->tx_n_transfers || config->tx_n_transfers > config->tx_n_buffers)
+        return "TX needs buffers, samples and at most one transfer per buffer";
+    if(config->tx_samples_per_buffer < GOLDCODE_LEN)
+        return "tx_samples_per_buffer must hold one sample per chip";
+
+    code_len = config->tx_samples_per_buffer * (config->rx_sr / config->tx_sr);
+    if(code_len & (code_len - 1))
+        return "tx_samples_per_buffer * rx_sr / tx_sr must be a power of two";
+    if(!config->rx_samples_per_buffer ||
+       config->rx_samples_per_buffer % code_len)
+        return "rx_samples_per_buffer must be a multiple of the code length";
+    if(!config->rx_n_samples ||
+       config->rx_n_samples % config->rx_samples_per_buffer)
+        return "rx_n_samples must be a multiple of rx_samples_per_buffer";
+    if(!config->rx_n_transfers || config->rx_n_transfers >
+       config->rx_n_samples / config->rx_samples_per_buffer)
+        return "rx_n_transfers must be between 1 and the buffers per frame";
+    if(!config->rx_decimation ||
+       (config->rx_decimation & (config->rx_decimation - 1)) ||
+       RX_SAMPLES_PER_CHIP(config) % config->rx_decimation)
+        return "rx_decimation must be a power of two dividing samples per chip";
+
+    return NULL;
+}
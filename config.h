@@ -0,0 +1,78 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include "goldcode.h"
+
+/*
+ * Radio settings and buffer geometry, loaded from bladerf_config.json and
+ * "-s name=value" flags and written back out for the Python scripts.
+ * The JSON is a flat object of integers named as the fields below.
+ */
+
+struct bladerf_config
+{
+    unsigned int tx_freq; // TX Frequency,   300MHz  to 3.8GHz, in Hz
+    unsigned int rx_freq; // RX Frequency,   300MHz  to 3.8GHz, in Hz
+    unsigned int tx_bw;   // TX Bandwidth,   1.5MHz  to  28MHz, in Hz
+    unsigned int rx_bw;   // RX Bandwidth,   1.5MHz  to  28MHz, in Hz
+    unsigned int tx_sr;   // TX Sample rate, 400kS/s to 40MS/s, in S/s
+    unsigned int rx_sr;   // RX Sample rate, 400kS/s to 40MS/s, in S/s
+    int txvga1; // Post-LPF gain, default -14dB, -35dB to -4dB, 1dB steps
+    int txvga2; // PA gain,       default   0dB,   0dB to 25dB, 1dB steps
+    int rxvga1; // Mixer gain,    default  30dB,   5dB to 30dB
+    int rxvga2; // Post-LPF gain, default   3dB,   0dB to 60dB, 3dB steps
+    int lna;    // RADIO_LNA_GAIN_BYPASS/MID/MAX, default MAX
+
+    // Stream geometry; one TX buffer holds one code period
+    unsigned int tx_n_buffers;
+    unsigned int tx_samples_per_buffer;
+    unsigned int tx_n_samples;          // Sent in single-shot mode
+    unsigned int tx_n_transfers;
+    unsigned int rx_samples_per_buffer;
+    unsigned int rx_n_samples;          // Per capture or frame
+    unsigned int rx_n_transfers;
+    unsigned int rx_decimation;         // Before correlating, a power of two
+};
+
+// The code is stretched to fill as much of each TX buffer as it can
+#define TX_SAMPLES_PER_CHIP(cfg) ((cfg)->tx_samples_per_buffer / GOLDCODE_LEN)
+#define RX_SAMPLES_PER_CHIP(cfg) \
+    (TX_SAMPLES_PER_CHIP(cfg) * ((cfg)->rx_sr / (cfg)->tx_sr))
+
+// RX samples per transmitted code period, the correlator's chunk length
+#define CODE_LEN_RX(cfg) \
+    ((cfg)->tx_samples_per_buffer * ((cfg)->rx_sr / (cfg)->tx_sr))
+
+// After decimation, what the correlator and everything after it sees
+#define CORR_SAMPLES_PER_CHIP(cfg) \
+    (RX_SAMPLES_PER_CHIP(cfg) / (cfg)->rx_decimation)
+#define CODE_LEN_CORR(cfg) (CODE_LEN_RX(cfg) / (cfg)->rx_decimation)
+#define CORR_SR(cfg) ((cfg)->rx_sr / (cfg)->rx_decimation)
+
+// Decimation filter reach either side, and so its delay, in output samples
+#define DECIMATION_HALF_LEN 8
+#define CORR_DELAY(cfg) ((cfg)->rx_decimation > 1 ? DECIMATION_HALF_LEN : 0)
+
+#define RX_N_BUFFERS(cfg) \
+    ((cfg)->rx_n_samples / (cfg)->rx_samples_per_buffer)
+
+/* The settings used when neither the config file nor -s gives one */
+void config_defaults(struct bladerf_config* config);
+
+/*
+ * Read settings from a config file, leaving any it does not mention alone.
+ * Returns 0 on success, 1 with errno set if the file could not be read, or
+ * 2 if it is malformed.
+ */
+int config_read(struct bladerf_config* config, const char* filename);
+
+/* Returns 0 on success, 1 with errno set on failure */
+int config_write(const struct bladerf_config* config, const char* filename);
+
+/* Apply a "name=value" setting. Returns 0 on success, 1 if not valid. */
+int config_set(struct bladerf_config* config, const char* setting);
+
+/* Returns NULL if the settings fit together, else what is wrong */
+const char* config_check(const struct bladerf_config* config);
+
+#endif
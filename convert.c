@@ -0,0 +1,309 @@
+#include <string.h>
+#include "convert.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CONVERT_X86
+#endif
+
+
+static void sign_extend_scalar(int16_t* samples, size_t n)
+{
+    size_t i;
+    for(i=0; i<2*n; i++)
+        samples[i] = (int16_t)(samples[i] << 4) >> 4;
+}
+
+
+static void to_cf32_scalar(const int16_t* samples, cf32* out, size_t n,
+                           float scale)
+{
+    size_t i;
+    for(i=0; i<n; i++) {
+        out[i].re = ((int16_t)(samples[2*i] << 4) >> 4) * scale;
+        out[i].im = ((int16_t)(samples[2*i + 1] << 4) >> 4) * scale;
+    }
+}
+
+
+static void to_split_scalar(const int16_t* samples, float* i_out,
+                            float* q_out, size_t n, float scale)
+{
+    size_t i;
+    for(i=0; i<n; i++) {
+        i_out[i] = ((int16_t)(samples[2*i] << 4) >> 4) * scale;
+        q_out[i] = ((int16_t)(samples[2*i + 1] << 4) >> 4) * scale;
+    }
+}
+
+
+static void to_sc12_scalar(const int16_t* samples, uint8_t* out, size_t n)
+{
+    size_t i;
+    uint32_t w;
+    for(i=0; i<n; i++) {
+        w = (samples[2*i] & 0xfff) | (uint32_t)(samples[2*i + 1] & 0xfff) << 12;
+        out[3*i] = w;
+        out[3*i + 1] = w >> 8;
+        out[3*i + 2] = w >> 16;
+    }
+}
+
+
+static void to_sc16_scalar(const uint8_t* packed, int16_t* out, size_t n)
+{
+    size_t i;
+    uint32_t w;
+    for(i=0; i<n; i++) {
+        w = packed[3*i] | packed[3*i + 1] << 8 | packed[3*i + 2] << 16;
+        out[2*i] = (int16_t)(w << 4) >> 4;
+        out[2*i + 1] = (int16_t)((w >> 12) << 4) >> 4;
+    }
+}
+
+
+#ifdef CONVERT_X86
+
+__attribute__((target("sse4.1")))
+static void sign_extend_sse41(int16_t* samples, size_t n)
+{
+    size_t i, len = 2*n;
+    __m128i x;
+
+    for(i=0; i+8<=len; i+=8) {
+        x = _mm_loadu_si128((const __m128i*)(samples + i));
+        x = _mm_srai_epi16(_mm_slli_epi16(x, 4), 4);
+        _mm_storeu_si128((__m128i*)(samples + i), x);
+    }
+    sign_extend_scalar(samples + i, (len - i) / 2);
+}
+
+
+__attribute__((target("sse4.1")))
+static void to_cf32_sse41(const int16_t* samples, cf32* out, size_t n,
+                          float scale)
+{
+    size_t i, len = 2*n;
+    __m128 s = _mm_set1_ps(scale);
+    __m128i x;
+    float* o = (float*)out;
+
+    for(i=0; i+4<=len; i+=4) {
+        x = _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i*)(samples+i)));
+        x = _mm_srai_epi32(_mm_slli_epi32(x, 20), 20);
+        _mm_storeu_ps(o + i, _mm_mul_ps(_mm_cvtepi32_ps(x), s));
+    }
+    to_cf32_scalar(samples + i, out + i/2, (len - i) / 2, scale);
+}
+
+
+__attribute__((target("sse4.1")))
+static void to_split_sse41(const int16_t* samples, float* i_out,
+                           float* q_out, size_t n, float scale)
+{
+    size_t i;
+    __m128 s = _mm_set1_ps(scale);
+    __m128i x, xi, xq;
+
+    // Each 32-bit lane holds one I/Q pair, I in the low half
+    for(i=0; i+4<=n; i+=4) {
+        x = _mm_loadu_si128((const __m128i*)(samples + 2*i));
+        xi = _mm_srai_epi32(_mm_slli_epi32(x, 20), 20);
+        xq = _mm_srai_epi32(_mm_slli_epi32(x, 4), 20);
+        _mm_storeu_ps(i_out + i, _mm_mul_ps(_mm_cvtepi32_ps(xi), s));
+        _mm_storeu_ps(q_out + i, _mm_mul_ps(_mm_cvtepi32_ps(xq), s));
+    }
+    to_split_scalar(samples + 2*i, i_out + i, q_out + i, n - i, scale);
+}
+
+
+// The low three bytes of each 32-bit lane, then four spare
+#define SC12_PACK_SHUFFLE 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, \
+                          -1, -1, -1, -1
+// Bytes 0-2 of a pair to 16-bit lanes holding I in bits 0-11, Q in 4-15
+#define SC12_UNPACK_SHUFFLE(o) o, o+1, o+1, o+2, o+3, o+4, o+4, o+5, \
+                               o+6, o+7, o+7, o+8, o+9, o+10, o+10, o+11
+
+__attribute__((target("sse4.1")))
+static void to_sc12_sse41(const int16_t* samples, uint8_t* out, size_t n)
+{
+    size_t i;
+    const __m128i shuffle = _mm_setr_epi8(SC12_PACK_SHUFFLE);
+    __m128i x;
+    uint32_t tail;
+
+    // Each 32-bit lane holds one I/Q pair, packed to its low 24 bits
+    for(i=0; i+4<=n; i+=4) {
+        x = _mm_loadu_si128((const __m128i*)(samples + 2*i));
+        x = _mm_or_si128(_mm_and_si128(x, _mm_set1_epi32(0xfff)),
+                         _mm_and_si128(_mm_srli_epi32(x, 4),
+                                       _mm_set1_epi32(0xfff000)));
+        x = _mm_shuffle_epi8(x, shuffle);
+        _mm_storel_epi64((__m128i*)(out + 3*i), x);
+        tail = _mm_extract_epi32(x, 2);
+        memcpy(out + 3*i + 8, &tail, sizeof(tail));
+    }
+    to_sc12_scalar(samples + 2*i, out + 3*i, n - i);
+}
+
+
+__attribute__((target("sse4.1")))
+static void to_sc16_sse41(const uint8_t* packed, int16_t* out, size_t n)
+{
+    size_t i;
+    const __m128i shuffle = _mm_setr_epi8(SC12_UNPACK_SHUFFLE(0));
+    __m128i x;
+    uint32_t tail;
+
+    for(i=0; i+4<=n; i+=4) {
+        memcpy(&tail, packed + 3*i + 8, sizeof(tail));
+        x = _mm_loadl_epi64((const __m128i*)(packed + 3*i));
+        x = _mm_shuffle_epi8(_mm_insert_epi32(x, tail, 2), shuffle);
+        x = _mm_blend_epi16(_mm_srai_epi16(_mm_slli_epi16(x, 4), 4),
+                            _mm_srai_epi16(x, 4), 0xaa);
+        _mm_storeu_si128((__m128i*)(out + 2*i), x);
+    }
+    to_sc16_scalar(packed + 3*i, out + 2*i, n - i);
+}
+
+
+__attribute__((target("avx2")))
+static void sign_extend_avx2(int16_t* samples, size_t n)
+{
+    size_t i, len = 2*n;
+    __m256i x;
+
+    for(i=0; i+16<=len; i+=16) {
+        x = _mm256_loadu_si256((const __m256i*)(samples + i));
+        x = _mm256_srai_epi16(_mm256_slli_epi16(x, 4), 4);
+        _mm256_storeu_si256((__m256i*)(samples + i), x);
+    }
+    sign_extend_scalar(samples + i, (len - i) / 2);
+}
+
+
+__attribute__((target("avx2")))
+static void to_cf32_avx2(const int16_t* samples, cf32* out, size_t n,
+                         float scale)
+{
+    size_t i, len = 2*n;
+    __m256 s = _mm256_set1_ps(scale);
+    __m256i x0, x1;
+    float* o = (float*)out;
+
+    for(i=0; i+16<=len; i+=16) {
+        x0 = _mm256_cvtepi16_epi32(
+            _mm_loadu_si128((const __m128i*)(samples + i)));
+        x1 = _mm256_cvtepi16_epi32(
+            _mm_loadu_si128((const __m128i*)(samples + i + 8)));
+        x0 = _mm256_srai_epi32(_mm256_slli_epi32(x0, 20), 20);
+        x1 = _mm256_srai_epi32(_mm256_slli_epi32(x1, 20), 20);
+        _mm256_storeu_ps(o + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x0), s));
+        _mm256_storeu_ps(o + i + 8,
+                         _mm256_mul_ps(_mm256_cvtepi32_ps(x1), s));
+    }
+    to_cf32_scalar(samples + i, out + i/2, (len - i) / 2, scale);
+}
+
+
+__attribute__((target("avx2")))
+static void to_split_avx2(const int16_t* samples, float* i_out,
+                          float* q_out, size_t n, float scale)
+{
+    size_t i;
+    __m256 s = _mm256_set1_ps(scale);
+    __m256i x, xi, xq;
+
+    for(i=0; i+8<=n; i+=8) {
+        x = _mm256_loadu_si256((const __m256i*)(samples + 2*i));
+        xi = _mm256_srai_epi32(_mm256_slli_epi32(x, 20), 20);
+        xq = _mm256_srai_epi32(_mm256_slli_epi32(x, 4), 20);
+        _mm256_storeu_ps(i_out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(xi), s));
+        _mm256_storeu_ps(q_out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(xq), s));
+    }
+    to_split_scalar(samples + 2*i, i_out + i, q_out + i, n - i, scale);
+}
+
+
+__attribute__((target("avx2")))
+static void to_sc12_avx2(const int16_t* samples, uint8_t* out, size_t n)
+{
+    size_t i;
+    const __m256i shuffle = _mm256_setr_epi8(SC12_PACK_SHUFFLE,
+                                             SC12_PACK_SHUFFLE);
+    const __m256i gather = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    __m256i x;
+
+    // 12 bytes from each half, brought together as the first 24
+    for(i=0; i+8<=n; i+=8) {
+        x = _mm256_loadu_si256((const __m256i*)(samples + 2*i));
+        x = _mm256_or_si256(_mm256_and_si256(x, _mm256_set1_epi32(0xfff)),
+                            _mm256_and_si256(_mm256_srli_epi32(x, 4),
+                                             _mm256_set1_epi32(0xfff000)));
+        x = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(x, shuffle),
+                                        gather);
+        _mm_storeu_si128((__m128i*)(out + 3*i), _mm256_castsi256_si128(x));
+        _mm_storel_epi64((__m128i*)(out + 3*i + 16),
+                         _mm256_extracti128_si256(x, 1));
+    }
+    to_sc12_scalar(samples + 2*i, out + 3*i, n - i);
+}
+
+
+__attribute__((target("avx2")))
+static void to_sc16_avx2(const uint8_t* packed, int16_t* out, size_t n)
+{
+    size_t i;
+    const __m256i shuffle = _mm256_setr_epi8(SC12_UNPACK_SHUFFLE(0),
+                                             SC12_UNPACK_SHUFFLE(4));
+    __m256i x;
+
+    // Bytes 0-15 and 8-23, so the second half's pairs start at byte 4
+    for(i=0; i+8<=n; i+=8) {
+        x = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(
+                _mm_loadu_si128((const __m128i*)(packed + 3*i))),
+            _mm_loadu_si128((const __m128i*)(packed + 3*i + 8)), 1);
+        x = _mm256_shuffle_epi8(x, shuffle);
+        x = _mm256_blend_epi16(
+            _mm256_srai_epi16(_mm256_slli_epi16(x, 4), 4),
+            _mm256_srai_epi16(x, 4), 0xaa);
+        _mm256_storeu_si256((__m256i*)(out + 2*i), x);
+    }
+    to_sc16_scalar(packed + 3*i, out + 2*i, n - i);
+}
+
+#endif
+
+
+void (*sc16_sign_extend)(int16_t*, size_t) = sign_extend_scalar;
+void (*sc16_to_cf32)(const int16_t*, cf32*, size_t, float) = to_cf32_scalar;
+void (*sc16_to_split)(const int16_t*, float*, float*, size_t, float) =
+    to_split_scalar;
+void (*sc16_to_sc12)(const int16_t*, uint8_t*, size_t) = to_sc12_scalar;
+void (*sc12_to_sc16)(const uint8_t*, int16_t*, size_t) = to_sc16_scalar;
+
+
+const char* convert_init(void)
+{
+#ifdef CONVERT_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        sc16_sign_extend = sign_extend_avx2;
+        sc16_to_cf32 = to_cf32_avx2;
+        sc16_to_split = to_split_avx2;
+        sc16_to_sc12 = to_sc12_avx2;
+        sc12_to_sc16 = to_sc16_avx2;
+        return "avx2";
+    }
+    if(__builtin_cpu_supports("sse4.1")) {
+        sc16_sign_extend = sign_extend_sse41;
+        sc16_to_cf32 = to_cf32_sse41;
+        sc16_to_split = to_split_sse41;
+        sc16_to_sc12 = to_sc12_sse41;
+        sc12_to_sc16 = to_sc16_sse41;
+        return "sse4.1";
+    }
+#endif
+    return "scalar";
+}
@@ -0,0 +1,42 @@
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "fft.h"
+
+/*
+ * SC16_Q12 sample conversion kernels.
+ *
+ * The bladeRF delivers 12-bit I and Q values in 16-bit words with unused
+ * top bits. Each kernel sign-extends bit 11 as part of its work, so they
+ * accept raw or already sign-extended samples alike. n counts I/Q pairs.
+ *
+ * The function pointers start out at the scalar versions; convert_init()
+ * switches them to the best implementation this CPU supports.
+ */
+
+/* Sign-extend 12-bit I/Q values in place */
+extern void (*sc16_sign_extend)(int16_t* samples, size_t n);
+
+/* Convert to interleaved complex float, multiplying by scale */
+extern void (*sc16_to_cf32)(const int16_t* samples, cf32* out, size_t n,
+                            float scale);
+
+/* Convert to separate I and Q float planes, multiplying by scale */
+extern void (*sc16_to_split)(const int16_t* samples, float* i_out,
+                             float* q_out, size_t n, float scale);
+
+/*
+ * Pack to SC12: each I/Q pair in 3 bytes, the little-endian 24-bit value
+ * I | Q << 12, so a sample takes three quarters of the space
+ */
+extern void (*sc16_to_sc12)(const int16_t* samples, uint8_t* out, size_t n);
+
+/* Unpack SC12 to sign-extended SC16 */
+extern void (*sc12_to_sc16)(const uint8_t* packed, int16_t* out, size_t n);
+
+/* Select kernels for this CPU, returns "avx2", "sse4.1" or "scalar" */
+const char* convert_init(void);
+
+#endif
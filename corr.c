@@ -0,0 +1,489 @@
+#include <stdlib.h>
+#include <string.h>
+#include "corr.h"
+#include "convert.h"
+
+
+void corr_code_spectrum(const struct fft_plan* plan, const float* code,
+                        cf32* code_conj)
+{
+    size_t i;
+
+    for(i=0; i<plan->n; i++) {
+        code_conj[i].re = code[i];
+        code_conj[i].im = 0.0f;
+    }
+    fft_forward(plan, code_conj);
+    for(i=0; i<plan->n; i++)
+        code_conj[i].im = -code_conj[i].im;
+    code_conj[0].re = 0.0f;
+    code_conj[0].im = 0.0f;
+}
+
+
+struct corr* corr_create_spectrum(const cf32* code_conj, size_t n)
+{
+    struct corr* corr;
+
+    corr = calloc(1, sizeof(struct corr));
+    if(!corr)
+        return NULL;
+
+    corr->n = n;
+    corr->plan = fft_plan_create(n);
+    corr->work = fft_alloc(CORR_BATCH * n * sizeof(cf32));
+    corr->acc = fft_alloc(n * sizeof(float));
+    if(!corr->plan || !corr->work || !corr->acc) {
+        corr_destroy(corr);
+        return NULL;
+    }
+
+    corr->code_conj = code_conj;
+    corr_reset(corr);
+    return corr;
+}
+
+
+struct corr* corr_create(const float* code, size_t n)
+{
+    struct corr* corr;
+
+    corr = corr_create_spectrum(NULL, n);
+    if(!corr)
+        return NULL;
+
+    corr->own_conj = fft_alloc(n * sizeof(cf32));
+    if(!corr->own_conj) {
+        corr_destroy(corr);
+        return NULL;
+    }
+    corr_code_spectrum(corr->plan, code, corr->own_conj);
+    corr->code_conj = corr->own_conj;
+
+    return corr;
+}
+
+
+void corr_set_spectrum(struct corr* corr, const cf32* code_conj)
+{
+    corr->code_conj = code_conj;
+}
+
+
+void corr_destroy(struct corr* corr)
+{
+    if(!corr)
+        return;
+    fft_plan_destroy(corr->plan);
+    free(corr->own_conj);
+    free(corr->work);
+    free(corr->acc);
+    free(corr);
+}
+
+
+void corr_reset(struct corr* corr)
+{
+    memset(corr->acc, 0, corr->n * sizeof(float));
+    corr->chunks = 0;
+    corr->period = 0;
+}
+
+
+void corr_set_chunk_cb(struct corr* corr, corr_chunk_cb cb, void* user_data)
+{
+    corr->chunk_cb = cb;
+    corr->chunk_data = user_data;
+}
+
+
+static void corr_batch(struct corr* corr, const int16_t* samples,
+                       size_t n_chunks)
+{
+    size_t c, i, n = corr->n;
+    const cf32* h = corr->code_conj;
+    float* acc = corr->acc;
+    cf32* x;
+    float re, im;
+
+    sc16_to_cf32(samples, corr->work, n_chunks*n, 1.0f / 2048.0f);
+
+    for(c=0; c<n_chunks; c++) {
+        x = corr->work + c*n;
+        fft_forward(corr->plan, x);
+        for(i=0; i<n; i++) {
+            re = x[i].re * h[i].re - x[i].im * h[i].im;
+            im = x[i].re * h[i].im + x[i].im * h[i].re;
+            x[i].re = re;
+            x[i].im = im;
+        }
+        fft_inverse(corr->plan, x);
+        if(corr->chunk_cb)
+            corr->chunk_cb(corr->chunk_data, corr->period + c, x);
+        for(i=0; i<n; i++)
+            acc[i] += x[i].re * x[i].re + x[i].im * x[i].im;
+    }
+
+    corr->chunks += n_chunks;
+    corr->period += n_chunks;
+}
+
+
+void corr_add(struct corr* corr, const int16_t* samples, size_t n_samples)
+{
+    size_t n_chunks = n_samples / corr->n, batch;
+
+    while(n_chunks) {
+        batch = n_chunks < CORR_BATCH ? n_chunks : CORR_BATCH;
+        corr_batch(corr, samples, batch);
+        samples += 2 * batch * corr->n;
+        n_chunks -= batch;
+    }
+}
+
+
+void corr_result(const struct corr* corr, float* profile)
+{
+    size_t i;
+    float scale = corr->chunks ? 1.0f / corr->chunks : 0.0f;
+
+    for(i=0; i<corr->n; i++)
+        profile[i] = corr->acc[i] * scale;
+}
+
+
+struct corr_pool* corr_pool_create(const cf32* code_conj, size_t n,
+                                   struct pool* pool, size_t max_jobs)
+{
+    struct corr_pool* cp;
+    size_t i;
+    int slot;
+
+    cp = calloc(1, sizeof(struct corr_pool));
+    if(!cp)
+        return NULL;
+
+    cp->n = n;
+    cp->pool = pool;
+    pool_group_init(&cp->tasks);
+    cp->n_corrs = pool_slots(pool);
+    cp->corrs = calloc(cp->n_corrs, sizeof(struct corr*));
+    cp->n_jobs = max_jobs;
+    cp->jobs = calloc(max_jobs, sizeof(struct corr_job));
+    if(!cp->corrs || !cp->jobs) {
+        corr_pool_destroy(cp);
+        return NULL;
+    }
+
+    for(slot=0; slot<cp->n_corrs; slot++) {
+        cp->corrs[slot] = corr_create_spectrum(code_conj, n);
+        if(!cp->corrs[slot]) {
+            corr_pool_destroy(cp);
+            return NULL;
+        }
+    }
+
+    for(i=0; i<max_jobs; i++) {
+        cp->jobs[i].cp = cp;
+        atomic_init(&cp->jobs[i].done, true);
+    }
+
+    return cp;
+}
+
+
+void corr_pool_destroy(struct corr_pool* cp)
+{
+    int slot;
+
+    if(!cp)
+        return;
+    pool_wait_group(cp->pool, &cp->tasks);
+    if(cp->corrs) {
+        for(slot=0; slot<cp->n_corrs; slot++)
+            corr_destroy(cp->corrs[slot]);
+    }
+    free(cp->corrs);
+    free(cp->jobs);
+    free(cp);
+}
+
+
+void corr_pool_reset(struct corr_pool* cp)
+{
+    int slot;
+
+    pool_wait_group(cp->pool, &cp->tasks);
+    for(slot=0; slot<cp->n_corrs; slot++)
+        corr_reset(cp->corrs[slot]);
+    cp->periods = 0;
+}
+
+
+void corr_pool_set_spectrum(struct corr_pool* cp, const cf32* code_conj)
+{
+    int slot;
+
+    pool_wait_group(cp->pool, &cp->tasks);
+    for(slot=0; slot<cp->n_corrs; slot++)
+        corr_set_spectrum(cp->corrs[slot], code_conj);
+}
+
+
+void corr_pool_set_chunk_cb(struct corr_pool* cp, corr_chunk_cb cb,
+                            void* user_data)
+{
+    int slot;
+
+    for(slot=0; slot<cp->n_corrs; slot++)
+        corr_set_chunk_cb(cp->corrs[slot], cb, user_data);
+}
+
+
+static void corr_job_run(void* arg, int slot)
+{
+    struct corr_job* job = arg;
+    struct corr* corr = job->cp->corrs[slot];
+
+    corr->period = job->period;
+    corr_add(corr, job->samples, job->n_samples);
+    atomic_store(&job->done, true);
+}
+
+
+struct corr_job* corr_pool_add(struct corr_pool* cp, const int16_t* samples,
+                               size_t n_samples)
+{
+    struct corr_job* job = &cp->jobs[cp->next_job];
+
+    cp->next_job = (cp->next_job + 1) % cp->n_jobs;
+
+    // Only happens if the caller has more than max_jobs outstanding
+    if(!corr_job_done(job))
+        pool_wait_group(cp->pool, &cp->tasks);
+
+    job->samples = samples;
+    job->n_samples = n_samples;
+    job->period = cp->periods;
+    atomic_store(&job->done, false);
+    cp->periods += n_samples / cp->n;
+
+    pool_submit_group(cp->pool, &cp->tasks, corr_job_run, job);
+    return job;
+}
+
+
+void corr_pool_result(struct corr_pool* cp, float* profile)
+{
+    unsigned long chunks = 0;
+    size_t i;
+    int slot;
+    float scale;
+
+    pool_wait_group(cp->pool, &cp->tasks);
+
+    memset(profile, 0, cp->n * sizeof(float));
+    for(slot=0; slot<cp->n_corrs; slot++) {
+        for(i=0; i<cp->n; i++)
+            profile[i] += cp->corrs[slot]->acc[i];
+        chunks += cp->corrs[slot]->chunks;
+    }
+
+    scale = chunks ? 1.0f / chunks : 0.0f;
+    for(i=0; i<cp->n; i++)
+        profile[i] *= scale;
+}
+
+
+void corr_ols_set_code(struct corr_ols* ols, const float* code)
+{
+    size_t i, n = ols->plan->n;
+
+    // Zero-padded, so the wrap lands in lags that are thrown away
+    for(i=0; i<n; i++) {
+        ols->code_conj[i].re = i < ols->code_len ? code[i] : 0.0f;
+        ols->code_conj[i].im = 0.0f;
+    }
+    fft_forward(ols->plan, ols->code_conj);
+    for(i=0; i<n; i++)
+        ols->code_conj[i].im = -ols->code_conj[i].im;
+}
+
+
+struct corr_ols* corr_ols_create(const float* code, size_t code_len,
+                                 size_t period, size_t n_range,
+                                 size_t delay)
+{
+    struct corr_ols* ols;
+    size_t n = 2;
+
+    if(!code_len || !n_range || n_range > period)
+        return NULL;
+
+    ols = calloc(1, sizeof(struct corr_ols));
+    if(!ols)
+        return NULL;
+
+    while(n < 4 * code_len)
+        n *= 2;
+    ols->code_len = code_len;
+    ols->period = period;
+    ols->n_range = n_range;
+    ols->delay = delay;
+    ols->plan = fft_plan_create(n);
+    ols->code_conj = fft_alloc(n * sizeof(cf32));
+    ols->in = fft_alloc(n * sizeof(cf32));
+    ols->work = fft_alloc(n * sizeof(cf32));
+    ols->lags = fft_alloc(n_range * sizeof(cf32));
+    ols->acc = fft_alloc(n_range * sizeof(float));
+    if(!ols->plan || !ols->code_conj || !ols->in || !ols->work ||
+       !ols->lags || !ols->acc) {
+        corr_ols_destroy(ols);
+        return NULL;
+    }
+
+    corr_ols_set_code(ols, code);
+    corr_ols_reset(ols);
+    return ols;
+}
+
+
+void corr_ols_destroy(struct corr_ols* ols)
+{
+    if(!ols)
+        return;
+    fft_plan_destroy(ols->plan);
+    free(ols->code_conj);
+    free(ols->in);
+    free(ols->work);
+    free(ols->lags);
+    free(ols->acc);
+    free(ols);
+}
+
+
+void corr_ols_reset(struct corr_ols* ols)
+{
+    memset(ols->acc, 0, ols->n_range * sizeof(float));
+    ols->chunks = 0;
+    ols->n_in = 0;
+    ols->filled = 0;
+    ols->sample = -(int64_t)ols->delay;
+}
+
+
+void corr_ols_set_chunk_cb(struct corr_ols* ols, corr_chunk_cb cb,
+                           void* user_data)
+{
+    ols->chunk_cb = cb;
+    ols->chunk_data = user_data;
+}
+
+
+// The lags of one period are all in
+static void corr_ols_period(struct corr_ols* ols, int64_t period)
+{
+    size_t i;
+
+    ols->filled = 0;
+    if(period < 0)
+        return;
+    if(ols->chunk_cb)
+        ols->chunk_cb(ols->chunk_data, period, ols->lags);
+    for(i=0; i<ols->n_range; i++) {
+        ols->acc[i] += ols->lags[i].re * ols->lags[i].re +
+                       ols->lags[i].im * ols->lags[i].im;
+    }
+    ols->chunks++;
+}
+
+
+// Correlate the samples waiting, zero-padded, and use the first n_out lags
+static void corr_ols_block(struct corr_ols* ols, size_t n_out)
+{
+    size_t n = ols->plan->n, i, lag;
+    const cf32* h = ols->code_conj;
+    cf32* x = ols->work;
+    int64_t period;
+    float re, im;
+
+    memcpy(x, ols->in, ols->n_in * sizeof(cf32));
+    memset(x + ols->n_in, 0, (n - ols->n_in) * sizeof(cf32));
+    fft_forward(ols->plan, x);
+    for(i=0; i<n; i++) {
+        re = x[i].re * h[i].re - x[i].im * h[i].im;
+        im = x[i].re * h[i].im + x[i].im * h[i].re;
+        x[i].re = re;
+        x[i].im = im;
+    }
+    fft_inverse(ols->plan, x);
+
+    // Floor division, as the first samples may come before sample 0
+    period = ols->sample >= 0 ? ols->sample / (int64_t)ols->period :
+             -((-ols->sample + (int64_t)ols->period - 1) /
+               (int64_t)ols->period);
+    lag = ols->sample - period * (int64_t)ols->period;
+    for(i=0; i<n_out; i++) {
+        if(lag == 0)
+            ols->filled = 0;
+        if(lag < ols->n_range && lag == ols->filled) {
+            ols->lags[ols->filled++] = x[i];
+            if(ols->filled == ols->n_range)
+                corr_ols_period(ols, period);
+        }
+        if(++lag == ols->period) {
+            lag = 0;
+            period++;
+        }
+    }
+}
+
+
+void corr_ols_add(struct corr_ols* ols, const int16_t* samples,
+                  size_t n_samples)
+{
+    size_t n = ols->plan->n, hop = n - ols->code_len + 1, take;
+
+    while(n_samples) {
+        take = n - ols->n_in < n_samples ? n - ols->n_in : n_samples;
+        sc16_to_cf32(samples, ols->in + ols->n_in, take, 1.0f / 2048.0f);
+        ols->n_in += take;
+        samples += 2 * take;
+        n_samples -= take;
+
+        if(ols->n_in == n) {
+            corr_ols_block(ols, hop);
+            memmove(ols->in, ols->in + hop,
+                    (ols->code_len - 1) * sizeof(cf32));
+            ols->n_in = ols->code_len - 1;
+            ols->sample += hop;
+        }
+    }
+}
+
+
+void corr_ols_flush(struct corr_ols* ols)
+{
+    if(ols->n_in >= ols->code_len)
+        corr_ols_block(ols, ols->n_in - ols->code_len + 1);
+    ols->sample += ols->n_in;
+    ols->n_in = 0;
+    ols->filled = 0;
+}
+
+
+void corr_ols_seek(struct corr_ols* ols, uint64_t sample)
+{
+    corr_ols_flush(ols);
+    ols->sample = (int64_t)sample - (int64_t)ols->delay;
+}
+
+
+void corr_ols_result(const struct corr_ols* ols, float* profile)
+{
+    size_t i;
+    float scale = ols->chunks ? 1.0f / ols->chunks : 0.0f;
+
+    for(i=0; i<ols->n_range; i++)
+        profile[i] = ols->acc[i] * scale;
+}
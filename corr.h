@@ -0,0 +1,197 @@
+#ifndef CORR_H
+#define CORR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "fft.h"
+#include "pool.h"
+
+/*
+ * FFT matched-filter correlator, the C version of prn.py's get_corrs.
+ *
+ * The received stream is cut into code-length chunks; each chunk is
+ * circularly correlated against the code via FFT, and |.|^2 of the result
+ * is accumulated so corr_result gives the average correlation profile.
+ *
+ * A corr_pool spreads the chunks over a worker pool instead. Every pool
+ * slot has its own correlator and accumulator, so workers share nothing
+ * they write, and the accumulators are summed when the result is wanted.
+ */
+
+#define CORR_BATCH 8
+
+/*
+ * Called with each chunk's complex correlation, n values, and its period:
+ * the chunk's position in the stream since the last reset.
+ */
+typedef void (*corr_chunk_cb)(void* user_data, unsigned long period,
+                              const cf32* chunk);
+
+struct corr {
+    size_t           n;          // Code length and FFT size
+    struct fft_plan* plan;
+    const cf32*      code_conj;  // conj(FFT(code)), computed once
+    cf32*            own_conj;   // code_conj if corr_create computed it
+    cf32*            work;       // CORR_BATCH chunks of workspace
+    float*           acc;        // Accumulated |correlation|^2
+    unsigned long    chunks;
+    unsigned long    period;     // Period of the next chunk
+    corr_chunk_cb    chunk_cb;   // Optional, see corr_set_chunk_cb
+    void*            chunk_data;
+};
+
+/*
+ * Create a correlator for a real code of length n (a power of two).
+ * The DC bin of the code spectrum is zeroed, which removes any DC offset
+ * from the samples as prn.py does by subtracting the mean.
+ */
+struct corr* corr_create(const float* code, size_t n);
+void corr_destroy(struct corr* corr);
+
+/*
+ * Create a correlator for a spectrum from corr_code_spectrum, which must
+ * outlive it. Swapping in another with corr_set_spectrum costs nothing.
+ */
+struct corr* corr_create_spectrum(const cf32* code_conj, size_t n);
+void corr_set_spectrum(struct corr* corr, const cf32* code_conj);
+
+/* Compute the spectrum corr_create uses for code, plan->n values */
+void corr_code_spectrum(const struct fft_plan* plan, const float* code,
+                        cf32* code_conj);
+
+void corr_reset(struct corr* corr);
+
+/* Also hand each chunk's complex correlation to cb, e.g. for rdmap */
+void corr_set_chunk_cb(struct corr* corr, corr_chunk_cb cb, void* user_data);
+
+/*
+ * Correlate SC16_Q12 I/Q samples, as many whole chunks as n_samples holds.
+ * Samples are scaled by 1/2048 as in prn.py.
+ */
+void corr_add(struct corr* corr, const int16_t* samples, size_t n_samples);
+
+/* Write the averaged profile, n floats, to profile */
+void corr_result(const struct corr* corr, float* profile);
+
+
+struct corr_job {
+    struct corr_pool* cp;
+    const int16_t*    samples;
+    size_t            n_samples;
+    unsigned long     period;
+    atomic_bool       done;
+};
+
+struct corr_pool {
+    size_t           n;
+    struct pool*     pool;
+    struct pool_group tasks;     // Its jobs, waited for apart from others'
+    struct corr**    corrs;      // One per pool slot
+    int              n_corrs;
+    struct corr_job* jobs;
+    size_t           n_jobs;
+    size_t           next_job;
+    unsigned long    periods;    // Chunks added since the last reset
+};
+
+/* Up to max_jobs calls to corr_pool_add may be outstanding at once */
+struct corr_pool* corr_pool_create(const cf32* code_conj, size_t n,
+                                   struct pool* pool, size_t max_jobs);
+void corr_pool_destroy(struct corr_pool* cp);
+
+/* These wait for outstanding jobs first, though not for others' tasks */
+void corr_pool_reset(struct corr_pool* cp);
+void corr_pool_set_spectrum(struct corr_pool* cp, const cf32* code_conj);
+void corr_pool_set_chunk_cb(struct corr_pool* cp, corr_chunk_cb cb,
+                            void* user_data);
+
+/*
+ * Queue samples for correlation. They must stay untouched until
+ * corr_job_done returns true for the returned job.
+ */
+struct corr_job* corr_pool_add(struct corr_pool* cp, const int16_t* samples,
+                               size_t n_samples);
+
+static inline bool corr_job_done(struct corr_job* job)
+{
+    return atomic_load(&job->done);
+}
+
+/* Wait for outstanding jobs, then reduce them into the averaged profile */
+void corr_pool_result(struct corr_pool* cp, float* profile);
+
+
+/*
+ * Streaming linear correlator, by overlap-save.
+ *
+ * Samples are taken in pieces of any size as they arrive, such as one RX
+ * buffer at a time. Each FFT of n_fft samples, a power of two at least
+ * four times the code, gives n_fft - code_len + 1 lags of the exact linear
+ * correlation against the code, with no circular wrap, and its last
+ * code_len - 1 samples start the next one; nothing more is buffered. The
+ * code may be any length, and need not fill or match the period.
+ *
+ * Lags are counted from the start of each period, the first starting at
+ * sample 0, and the first n_range of each period (at most the period) are
+ * kept: handed to the chunk callback, period by period, and accumulated
+ * as |.|^2 as corr does. A period is only counted once every one of its
+ * kept lags has been seen, so one cut into by a gap is left out. Unlike
+ * corr, DC is not removed from the samples.
+ */
+struct corr_ols {
+    size_t           code_len;
+    size_t           period;
+    size_t           n_range;
+    size_t           delay;      // Samples arrive this late
+    struct fft_plan* plan;       // n_fft points
+    cf32*            code_conj;  // conj(FFT(code zero-padded to n_fft))
+    cf32*            in;         // History, then samples waiting
+    size_t           n_in;
+    cf32*            work;
+    cf32*            lags;       // Of the period being filled
+    size_t           filled;     // Its lags seen so far, in order
+    float*           acc;        // Accumulated |correlation|^2
+    int64_t          sample;     // Of in[0], less delay
+    unsigned long    chunks;     // Periods accumulated
+    corr_chunk_cb    chunk_cb;
+    void*            chunk_data;
+};
+
+/*
+ * Create a correlator for a real code of code_len samples, keeping n_range
+ * lags of each period of period samples. Samples are taken to have been
+ * delayed by delay by a filter on the way in, as with goldcode_cache.
+ */
+struct corr_ols* corr_ols_create(const float* code, size_t code_len,
+                                 size_t period, size_t n_range,
+                                 size_t delay);
+void corr_ols_destroy(struct corr_ols* ols);
+
+/* Switch to another code of the same length */
+void corr_ols_set_code(struct corr_ols* ols, const float* code);
+
+/* Forget everything; the next sample is sample 0 */
+void corr_ols_reset(struct corr_ols* ols);
+
+/* As corr_set_chunk_cb, with n_range lags a chunk */
+void corr_ols_set_chunk_cb(struct corr_ols* ols, corr_chunk_cb cb,
+                           void* user_data);
+
+/* Correlate n_samples more SC16_Q12 I/Q samples, scaled as corr_add does */
+void corr_ols_add(struct corr_ols* ols, const int16_t* samples,
+                  size_t n_samples);
+
+/*
+ * End a run of samples, correlating those still waiting as far as the
+ * samples reach. Whatever comes next is taken to follow a gap.
+ */
+void corr_ols_flush(struct corr_ols* ols);
+
+/* Flush, then continue with sample, counted as from reset, after a gap */
+void corr_ols_seek(struct corr_ols* ols, uint64_t sample);
+
+/* Write the averaged profile of the periods counted, n_range floats */
+void corr_ols_result(const struct corr_ols* ols, float* profile);
+
+#endif
@@ -0,0 +1,132 @@
+#include <stdlib.h>
+#include <math.h>
+#include "fft.h"
+
+
+void* fft_alloc(size_t size)
+{
+    void* ptr;
+    if(posix_memalign(&ptr, 32, size ? size : 32))
+        return NULL;
+    return ptr;
+}
+
+
+struct fft_plan* fft_plan_create(size_t n)
+{
+    struct fft_plan* plan;
+    size_t i, m, bits = 0;
+    uint32_t r;
+
+    if(n < 2 || (n & (n - 1)))
+        return NULL;
+    while((1UL << bits) < n)
+        bits++;
+
+    plan = calloc(1, sizeof(struct fft_plan));
+    if(!plan)
+        return NULL;
+    plan->n = n;
+    plan->bitrev = malloc(n * sizeof(uint32_t));
+    plan->twiddle = fft_alloc(n * sizeof(cf32));
+    if(!plan->bitrev || !plan->twiddle) {
+        fft_plan_destroy(plan);
+        return NULL;
+    }
+
+    for(i=0; i<n; i++) {
+        r = 0;
+        for(m=0; m<bits; m++)
+            r |= ((i >> m) & 1) << (bits - 1 - m);
+        plan->bitrev[i] = r;
+    }
+
+    // Twiddles for each stage stored contiguously so the inner butterfly
+    // loop walks them with unit stride.
+    plan->twiddle[0].re = 1.0f;
+    plan->twiddle[0].im = 0.0f;
+    for(m=1; m<n; m<<=1) {
+        for(i=0; i<m; i++) {
+            plan->twiddle[m + i].re = (float)cos(-M_PI * i / m);
+            plan->twiddle[m + i].im = (float)sin(-M_PI * i / m);
+        }
+    }
+
+    return plan;
+}
+
+
+void fft_plan_destroy(struct fft_plan* plan)
+{
+    if(!plan)
+        return;
+    free(plan->bitrev);
+    free(plan->twiddle);
+    free(plan);
+}
+
+
+void fft_forward(const struct fft_plan* plan, cf32* data)
+{
+    size_t n = plan->n, i, j, k, m;
+    const cf32* w;
+    cf32 t, u, v;
+
+    for(i=0; i<n; i++) {
+        j = plan->bitrev[i];
+        if(j > i) {
+            t = data[i];
+            data[i] = data[j];
+            data[j] = t;
+        }
+    }
+
+    // First stage has only trivial twiddles
+    for(i=0; i<n; i+=2) {
+        u = data[i];
+        v = data[i + 1];
+        data[i].re = u.re + v.re;
+        data[i].im = u.im + v.im;
+        data[i + 1].re = u.re - v.re;
+        data[i + 1].im = u.im - v.im;
+    }
+
+    for(m=2; m<n; m<<=1) {
+        w = plan->twiddle + m;
+        for(j=0; j<n; j+=2*m) {
+            cf32* a = data + j;
+            cf32* b = data + j + m;
+            for(k=0; k<m; k++) {
+                v.re = b[k].re * w[k].re - b[k].im * w[k].im;
+                v.im = b[k].re * w[k].im + b[k].im * w[k].re;
+                u = a[k];
+                a[k].re = u.re + v.re;
+                a[k].im = u.im + v.im;
+                b[k].re = u.re - v.re;
+                b[k].im = u.im - v.im;
+            }
+        }
+    }
+}
+
+
+void fft_inverse(const struct fft_plan* plan, cf32* data)
+{
+    size_t i, n = plan->n;
+    float scale = 1.0f / n, t;
+
+    // ifft(x) = swap(fft(swap(x))) / N, where swap exchanges re and im
+    for(i=0; i<n; i++) {
+        t = data[i].re;
+        data[i].re = data[i].im;
+        data[i].im = t;
+    }
+
+    fft_forward(plan, data);
+
+    for(i=0; i<n; i++) {
+        t = data[i].re;
+        data[i].re = data[i].im * scale;
+        data[i].im = t * scale;
+    }
+}
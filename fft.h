@@ -0,0 +1,37 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * In-place radix-2 complex FFT on power-of-two lengths.
+ *
+ * A plan holds the bit-reversal permutation and per-stage twiddle factors
+ * for one length, so create it once and reuse it for every transform.
+ */
+
+typedef struct {
+    float re;
+    float im;
+} cf32;
+
+struct fft_plan {
+    size_t    n;
+    uint32_t* bitrev;   // Bit-reversed index of each element
+    cf32*     twiddle;  // Stage with half-size m uses twiddle[m .. 2m-1]
+};
+
+struct fft_plan* fft_plan_create(size_t n);
+void fft_plan_destroy(struct fft_plan* plan);
+
+/* Forward transform, X[k] = sum x[n] exp(-2j pi k n / N) */
+void fft_forward(const struct fft_plan* plan, cf32* data);
+
+/* Inverse transform including the 1/N scaling, as numpy.fft.ifft */
+void fft_inverse(const struct fft_plan* plan, cf32* data);
+
+/* 32-byte aligned allocation for FFT buffers, release with free() */
+void* fft_alloc(size_t size);
+
+#endif
@@ -0,0 +1,124 @@
+#include <stdlib.h>
+#include "goldcode.h"
+#include "corr.h"
+
+// G2 stages, numbered from 1, summed to give each PRN's G2 output
+static const uint8_t g2_phase_select[GOLDCODE_N_PRNS][2] = {
+    {2, 6}, {3, 7}, {4, 8}, {5, 9}, {1, 9}, {2, 10}, {1, 8},
+    {2, 9}, {3, 10}, {2, 3}, {3, 4}, {5, 6}, {6, 7}, {7, 8},
+    {8, 9}, {9, 10}, {1, 4}, {2, 5}, {3, 6}, {4, 7}, {5, 8},
+    {6, 9}, {1, 3}, {4, 6}, {5, 7}, {6, 8}, {7, 9}, {8, 10},
+    {1, 6}, {2, 7}, {3, 8}, {4, 9}, {5, 10}, {4, 10}, {1, 7},
+    {2, 8}, {4, 10}
+};
+
+
+int goldcode_generate(int prn, int8_t* chips)
+{
+    // Bit k of each register holds stage k+1, starting all ones
+    unsigned int g1 = 0x3ff, g2 = 0x3ff, s1, s2, out, fb1, fb2;
+    int i;
+
+    if(prn < 1 || prn > GOLDCODE_N_PRNS)
+        return 1;
+
+    s1 = g2_phase_select[prn - 1][0] - 1;
+    s2 = g2_phase_select[prn - 1][1] - 1;
+
+    for(i=0; i<GOLDCODE_LEN; i++) {
+        out = ((g2 >> s1) ^ (g2 >> s2) ^ (g1 >> 9)) & 1;
+        chips[i] = out ? 1 : -1;
+
+        // G1 = 1 + x^3 + x^10, G2 = 1 + x^2 + x^3 + x^6 + x^8 + x^9 + x^10
+        fb1 = ((g1 >> 2) ^ (g1 >> 9)) & 1;
+        fb2 = ((g2 >> 1) ^ (g2 >> 2) ^ (g2 >> 5) ^ (g2 >> 7) ^ (g2 >> 8) ^
+               (g2 >> 9)) & 1;
+        g1 = ((g1 << 1) | fb1) & 0x3ff;
+        g2 = ((g2 << 1) | fb2) & 0x3ff;
+    }
+
+    return 0;
+}
+
+
+void goldcode_modulate(const int8_t* chips, unsigned samples_per_chip,
+                       int16_t amplitude, int16_t* samples, size_t n_samples)
+{
+    size_t i;
+
+    for(i=0; i<n_samples; i++) {
+        if(i / samples_per_chip < GOLDCODE_LEN)
+            samples[2*i] = chips[i / samples_per_chip] * amplitude;
+        else
+            samples[2*i] = 0;
+        samples[2*i + 1] = 0;
+    }
+}
+
+
+void goldcode_reference(const int8_t* chips, unsigned samples_per_chip,
+                        float* code, size_t n)
+{
+    size_t i;
+
+    for(i=0; i<n; i++) {
+        if(i / samples_per_chip < GOLDCODE_LEN)
+            code[i] = chips[i / samples_per_chip];
+        else
+            code[i] = 0.0f;
+    }
+}
+
+
+struct goldcode_cache* goldcode_cache_create(size_t n,
+                                             unsigned samples_per_chip,
+                                             size_t delay)
+{
+    struct goldcode_cache* cache;
+    struct fft_plan* plan;
+    int8_t chips[GOLDCODE_LEN];
+    float* code;
+    float* delayed;
+    size_t i;
+    int prn;
+
+    cache = calloc(1, sizeof(struct goldcode_cache));
+    if(!cache)
+        return NULL;
+
+    cache->n = n;
+    cache->spectra = fft_alloc(GOLDCODE_N_PRNS * n * sizeof(cf32));
+    code = malloc(n * sizeof(float));
+    delayed = malloc(n * sizeof(float));
+    plan = fft_plan_create(n);
+    if(!cache->spectra || !code || !delayed || !plan) {
+        fft_plan_destroy(plan);
+        free(delayed);
+        free(code);
+        goldcode_cache_destroy(cache);
+        return NULL;
+    }
+
+    for(prn=1; prn<=GOLDCODE_N_PRNS; prn++) {
+        goldcode_generate(prn, chips);
+        goldcode_reference(chips, samples_per_chip, code, n);
+        for(i=0; i<n; i++)
+            delayed[(i + delay) % n] = code[i];
+        corr_code_spectrum(plan, delayed,
+                           cache->spectra + (size_t)(prn - 1) * n);
+    }
+
+    fft_plan_destroy(plan);
+    free(delayed);
+    free(code);
+    return cache;
+}
+
+
+void goldcode_cache_destroy(struct goldcode_cache* cache)
+{
+    if(!cache)
+        return;
+    free(cache->spectra);
+    free(cache);
+}
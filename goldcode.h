@@ -0,0 +1,55 @@
+#ifndef GOLDCODE_H
+#define GOLDCODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "fft.h"
+
+/*
+ * GPS C/A Gold codes, the C version of goldcode.py.
+ *
+ * Each code is the sum of the G1 and G2 LFSR sequences, with G2 tapped at
+ * the pair of stages G2CodePhsSlct gives for the PRN.
+ */
+
+#define GOLDCODE_LEN    1023
+#define GOLDCODE_N_PRNS 37
+
+/* Write the PRN's chips as +-1, returns 0 on success or 1 for a bad prn */
+int goldcode_generate(int prn, int8_t* chips);
+
+/*
+ * Modulate chips onto n_samples SC16 I/Q samples, each chip lasting
+ * samples_per_chip samples at +-amplitude on I. Q and any samples past
+ * the end of the code are zero.
+ */
+void goldcode_modulate(const int8_t* chips, unsigned samples_per_chip,
+                       int16_t amplitude, int16_t* samples, size_t n_samples);
+
+/* Real +-1 reference of n samples, laid out as goldcode_modulate does */
+void goldcode_reference(const int8_t* chips, unsigned samples_per_chip,
+                        float* code, size_t n);
+
+/*
+ * Correlator code spectra for every PRN, computed once up front so that
+ * switching codes is just a pointer change (see corr_set_spectrum). The
+ * codes are delayed by delay samples, to line up with samples that were
+ * delayed by a filter on the way in.
+ */
+struct goldcode_cache {
+    size_t n;
+    cf32*  spectra;     // GOLDCODE_N_PRNS spectra of n bins, PRN 1 first
+};
+
+struct goldcode_cache* goldcode_cache_create(size_t n,
+                                             unsigned samples_per_chip,
+                                             size_t delay);
+void goldcode_cache_destroy(struct goldcode_cache* cache);
+
+static inline const cf32* goldcode_spectrum(const struct goldcode_cache* cache,
+                                            int prn)
+{
+    return cache->spectra + (size_t)(prn - 1) * cache->n;
+}
+
+#endif
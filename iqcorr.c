@@ -0,0 +1,207 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "iqcorr.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define IQCORR_X86
+#endif
+
+// Sums over the offset-removed samples of one buffer
+enum { SUM_I, SUM_Q, SUM_II, SUM_QQ, SUM_IQ, N_SUMS };
+
+typedef void (*correct_fn)(int16_t* samples, size_t n, float dc_i,
+                           float dc_q, float k, float g, double* sums);
+
+
+static inline int16_t clip12(long v)
+{
+    return v > 2047 ? 2047 : (v < -2048 ? -2048 : v);
+}
+
+
+static void correct_scalar(int16_t* samples, size_t n, float dc_i,
+                           float dc_q, float k, float g, double* sums)
+{
+    float xi, xq;
+    size_t j;
+
+    for(j=0; j<n; j++) {
+        xi = (int16_t)(samples[2*j] << 4) / 16 - dc_i;
+        xq = (int16_t)(samples[2*j + 1] << 4) / 16 - dc_q;
+        sums[SUM_I] += xi;
+        sums[SUM_Q] += xq;
+        sums[SUM_II] += xi * xi;
+        sums[SUM_QQ] += xq * xq;
+        sums[SUM_IQ] += xi * xq;
+        samples[2*j] = clip12(lrintf(xi));
+        samples[2*j + 1] = clip12(lrintf(g * (xq - k * xi)));
+    }
+}
+
+
+#ifdef IQCORR_X86
+
+// Four samples, I and Q interleaved, through the correction
+__attribute__((target("avx2,fma")))
+static __m256i correct4_avx2(__m256i v, __m256 dc, __m256 a, __m256 b,
+                             __m256* sum_x, __m256* sum_xx, __m256* sum_xs)
+{
+    __m256 x = _mm256_sub_ps(_mm256_cvtepi32_ps(v), dc);
+    __m256 s = _mm256_permute_ps(x, 0xb1);     // Q and I swapped
+
+    *sum_x = _mm256_add_ps(*sum_x, x);
+    *sum_xx = _mm256_fmadd_ps(x, x, *sum_xx);
+    *sum_xs = _mm256_fmadd_ps(x, s, *sum_xs);
+    return _mm256_cvtps_epi32(_mm256_fmadd_ps(s, b, _mm256_mul_ps(x, a)));
+}
+
+
+__attribute__((target("avx2,fma")))
+static void correct_avx2(int16_t* samples, size_t n, float dc_i,
+                         float dc_q, float k, float g, double* sums)
+{
+    // I comes out as is, Q as g * Q - g * k * I
+    __m256 dc = _mm256_setr_ps(dc_i, dc_q, dc_i, dc_q, dc_i, dc_q, dc_i, dc_q);
+    __m256 a = _mm256_setr_ps(1, g, 1, g, 1, g, 1, g);
+    __m256 b = _mm256_setr_ps(0, -g * k, 0, -g * k, 0, -g * k, 0, -g * k);
+    __m256 sum_x = _mm256_setzero_ps(), sum_xx = _mm256_setzero_ps();
+    __m256 sum_xs = _mm256_setzero_ps();
+    __m256i lo = _mm256_set1_epi16(-2048), hi = _mm256_set1_epi16(2047);
+    __m256i v, y0, y1;
+    float x[8], xx[8], xs[8];
+    size_t j;
+    int l;
+
+    for(j=0; j+8<=n; j+=8) {
+        v = _mm256_loadu_si256((const __m256i*)(samples + 2*j));
+        v = _mm256_srai_epi16(_mm256_slli_epi16(v, 4), 4);
+        y0 = correct4_avx2(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(v)),
+                           dc, a, b, &sum_x, &sum_xx, &sum_xs);
+        y1 = correct4_avx2(_mm256_cvtepi16_epi32(
+                               _mm256_extracti128_si256(v, 1)),
+                           dc, a, b, &sum_x, &sum_xx, &sum_xs);
+        // packs works within 128-bit lanes, so put the quarters back
+        v = _mm256_permute4x64_epi64(_mm256_packs_epi32(y0, y1), 0xd8);
+        v = _mm256_min_epi16(_mm256_max_epi16(v, lo), hi);
+        _mm256_storeu_si256((__m256i*)(samples + 2*j), v);
+    }
+
+    _mm256_storeu_ps(x, sum_x);
+    _mm256_storeu_ps(xx, sum_xx);
+    _mm256_storeu_ps(xs, sum_xs);
+    for(l=0; l<8; l+=2) {
+        sums[SUM_I] += x[l];
+        sums[SUM_Q] += x[l + 1];
+        sums[SUM_II] += xx[l];
+        sums[SUM_QQ] += xx[l + 1];
+        sums[SUM_IQ] += xs[l];
+    }
+
+    correct_scalar(samples + 2*j, n - j, dc_i, dc_q, k, g, sums);
+}
+
+#endif
+
+
+static correct_fn correct = correct_scalar;
+
+
+struct iq_corrector* iq_corrector_create(double time_constant)
+{
+    struct iq_corrector* iq;
+
+    if(time_constant < 1)
+        return NULL;
+
+    iq = calloc(1, sizeof(struct iq_corrector));
+    if(!iq)
+        return NULL;
+    iq->alpha = 1 / time_constant;
+    iq_corrector_reset(iq);
+
+#ifdef IQCORR_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        correct = correct_avx2;
+#endif
+
+    return iq;
+}
+
+
+void iq_corrector_destroy(struct iq_corrector* iq)
+{
+    free(iq);
+}
+
+
+void iq_corrector_reset(struct iq_corrector* iq)
+{
+    iq->buffers = 0;
+    iq->circular = 0;
+    iq->dc_i = 0;
+    iq->dc_q = 0;
+    iq->p_ii = 0;
+    iq->p_qq = 0;
+    iq->p_iq = 0;
+    iq->k = 0;
+    iq->g = 1;
+}
+
+
+void iq_correct(struct iq_corrector* iq, int16_t* samples, size_t n)
+{
+    double sums[N_SUMS] = { 0 };
+    double m_i, m_q, v_ii, v_qq, v_iq, a, d;
+
+    if(!n)
+        return;
+
+    correct(samples, n, iq->dc_i, iq->dc_q, iq->k, iq->g, sums);
+
+    // Plain averages until there are enough buffers for the time constant
+    iq->buffers++;
+    a = 1.0 / iq->buffers > iq->alpha ? 1.0 / iq->buffers : iq->alpha;
+
+    m_i = sums[SUM_I] / n;
+    m_q = sums[SUM_Q] / n;
+    iq->dc_i += a * m_i;
+    iq->dc_q += a * m_q;
+
+    // A buffer far from circular says more about the signal than the
+    // front end, so it is left out of the imbalance
+    v_ii = sums[SUM_II] / n - m_i * m_i;
+    v_qq = sums[SUM_QQ] / n - m_q * m_q;
+    v_iq = sums[SUM_IQ] / n - m_i * m_q;
+    if(v_ii + v_qq <= 0 ||
+       hypot(v_ii - v_qq, 2 * v_iq) > IQ_MAX_NONCIRC * (v_ii + v_qq))
+        return;
+
+    iq->circular++;
+    a = 1.0 / iq->circular > iq->alpha ? 1.0 / iq->circular : iq->alpha;
+    iq->p_ii += a * (v_ii - iq->p_ii);
+    iq->p_qq += a * (v_qq - iq->p_qq);
+    iq->p_iq += a * (v_iq - iq->p_iq);
+
+    // Leave the correction alone while there is nothing to go on
+    if(iq->p_ii > 0) {
+        d = iq->p_qq - iq->p_iq * iq->p_iq / iq->p_ii;
+        if(d > 0) {
+            iq->k = fmax(-IQ_MAX_SKEW, fmin(IQ_MAX_SKEW,
+                                            iq->p_iq / iq->p_ii));
+            iq->g = fmax(1 / IQ_MAX_GAIN, fmin(IQ_MAX_GAIN,
+                                               sqrt(iq->p_ii / d)));
+        }
+    }
+}
+
+
+void iq_corrector_imbalance(const struct iq_corrector* iq, double* phase,
+                            double* gain)
+{
+    // Q = k * I plus a part orthogonal to it with 1 / g of I's amplitude
+    *phase = atan(iq->k * iq->g) * 180 / M_PI;
+    *gain = 10 * log10(iq->k * iq->k + 1 / (iq->g * iq->g));
+}
@@ -0,0 +1,67 @@
+#ifndef IQCORR_H
+#define IQCORR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Streaming DC offset and IQ imbalance correction for SC16_Q12 I/Q.
+ *
+ * Each buffer is corrected in place, in one pass, with the estimates from
+ * the buffers before it: the DC offset is subtracted, then Q is made
+ * orthogonal to I and scaled to the same power (Gram-Schmidt), which
+ * undoes gain and phase imbalance between the two. The same pass sums
+ * the offset-removed samples, their powers and their cross product, and
+ * those sums move the running estimates, exponentially averaged over
+ * about time_constant buffers, once the buffer is done. Until that many
+ * buffers have been seen the estimates are plain averages, so the first
+ * buffers settle quickly.
+ *
+ * The imbalance estimate assumes the signal is circular, as noise and
+ * anything off the carrier frequency are over time. A coherent return,
+ * such as the radar's own code, is not, and would be taken for a large
+ * imbalance, so a buffer only moves the powers when its own are nearly
+ * circular (within IQ_MAX_NONCIRC), and the corrections are held within
+ * IQ_MAX_GAIN and IQ_MAX_SKEW, about what a real front end needs, so
+ * that a weak return that gets past the test cannot do much harm.
+ *
+ * Samples may be raw or sign-extended, and come out sign-extended,
+ * rounded and clipped to 12 bits. The work is done eight samples at a time
+ * with AVX2 where the CPU has it.
+ */
+
+#define IQ_TIME_CONSTANT 0.01   // Seconds radar averages the estimates over
+#define IQ_MAX_GAIN      1.122  // Largest Q scaling either way, 1 dB
+#define IQ_MAX_SKEW      0.052  // Largest share of I taken out of Q, 3 deg
+#define IQ_MAX_NONCIRC   0.25   // Of a buffer used for the imbalance
+
+struct iq_corrector {
+    double        alpha;        // 1 / time constant
+    unsigned long buffers;      // Seen so far
+    unsigned long circular;     // Of those, used for the imbalance
+    double        dc_i;         // Running estimates, in LSBs
+    double        dc_q;
+    double        p_ii;         // Powers and cross power after DC removal
+    double        p_qq;
+    double        p_iq;
+    float         k;            // Q -= k * I, then Q *= g
+    float         g;
+};
+
+struct iq_corrector* iq_corrector_create(double time_constant);
+void iq_corrector_destroy(struct iq_corrector* iq);
+
+/* Forget the estimates */
+void iq_corrector_reset(struct iq_corrector* iq);
+
+/* Correct n I/Q pairs in place, then update the estimates from them */
+void iq_correct(struct iq_corrector* iq, int16_t* samples, size_t n);
+
+/*
+ * Phase imbalance in degrees and gain imbalance (Q / I) in dB that the
+ * correction in use undoes, clamps and all
+ */
+void iq_corrector_imbalance(const struct iq_corrector* iq, double* phase,
+                            double* gain);
+
+#endif
@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <signal.h>
 #include <string.h>
 #include <unistd.h>
@@ -8,30 +9,45 @@
 #include <errno.h>
 #include <math.h>
 #include <pthread.h>
-#include "libbladeRF.h"
-
-#define TXFREQ 3410000000
-#define TXBW   28000000
-#define TXSR   20000000
-#define TXVGA1 -4
-#define TXVGA2 25
-
-#define RXFREQ 3410000000
-#define RXBW   28000000
-#define RXSR   40000000
-#define RXVGA1 30
-#define RXVGA2 30
-#define LNA BLADERF_LNA_GAIN_MAX
-
-#define TX_N_BUFFERS          32
-#define TX_SAMPLES_PER_BUFFER 1024
-#define TX_N_SAMPLES          (130*1024)
-#define TX_N_TRANSFERS        32
-
-#define RX_SAMPLES_PER_BUFFER 2048
-#define RX_N_SAMPLES          (250*1024)
-#define RX_N_BUFFERS          (RX_N_SAMPLES / RX_SAMPLES_PER_BUFFER)
-#define RX_N_TRANSFERS        32
+#include <stdatomic.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include "backend.h"
+#include "rxqueue.h"
+#include "pool.h"
+#include "corr.h"
+#include "rdmap.h"
+#include "goldcode.h"
+#include "acq.h"
+#include "cfar.h"
+#include "resample.h"
+#include "shmring.h"
+#include "waveform.h"
+#include "rt.h"
+#include "iqcorr.h"
+#include "convert.h"
+#include "writer.h"
+#include "config.h"
+#include "stats.h"
+
+// Time given to get the threads going before the first sample, in seconds
+#define START_DELAY           0.1
+
+// Recording keeps only this many RX buffers in memory, however long it runs
+#define RECORD_N_BUFFERS      512
+#define RECORD_BATCH          64
+
+#define TX_AMPLITUDE          2047
+
+// Most CFAR detections kept from one frame
+#define CFAR_MAX_DETECTIONS   1024
+
+// Correlation jobs in flight, enough for every buffer continuous mode has
+#define CORR_MAX_JOBS(cfg)    (2 * RX_N_BUFFERS(cfg))
+
+// Most radios one process drives, each given with its own -d
+#define MAX_DEVICES           8
 
 #define KNRM "\x1B[0m"
 #define KRED "\x1B[31m"
@@ -39,23 +55,21 @@
 
 char* output_samples_filename = "./bladerf_samples.dat";
 char* output_config_filename  = "./bladerf_config.json";
+char* output_profile_filename = "./bladerf_corr.dat";
+char* output_rdmap_filename   = "./bladerf_rdmap.dat";
+char* output_stats_filename   = "./bladerf_stats.json";
+char* output_detections_filename = "./bladerf_detections.dat";
 
-uint16_t gc1[2048] = { 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, 2047, 0, 2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, 2047, 0, -2047, 0, -2047, 0, -2047, 0, -2047, 0, 0, 0 }; 
-
-struct bladerf_config
-{
-    unsigned int tx_freq; // TX Frequency,   300MHz  to 3.8GHz, in Hz
-    unsigned int rx_freq; // RX Frequency,   300MHz  to 3.8GHz, in Hz
-    unsigned int tx_bw;   // TX Bandwidth,   1.5MHz  to  28MHz, in Hz
-    unsigned int rx_bw;   // RX Bandwidth,   1.5MHz  to  28MHz, in Hz
-    unsigned int tx_sr;   // TX Sample rate, 400kS/s to 40MS/s, in S/s
-    unsigned int rx_sr;   // RX Sample rate, 400kS/s to 40MS/s, in S/s
-    int txvga1; // Post-LPF gain, default -14dB, -35dB to -4dB, 1dB steps
-    int txvga2; // PA gain,       default   0dB,   0dB to 25dB, 1dB steps
-    int rxvga1; // Mixer gain,    default  30dB,   5dB to 30dB
-    int rxvga2; // Post-LPF gain, default   3dB,   0dB to 60dB, 3dB steps
-    int lna;    // BLADERF_LNA_GAIN_BYPASS/MID/MAX, default MAX
-};
+volatile sig_atomic_t stop_streaming = 0;
+
+// Each device's TX waveforms, for SIGUSR1 to step through while streaming
+struct waveform_lib* tx_waveforms[MAX_DEVICES];
+
+#ifdef NO_BLADERF
+char* device_spec = "sim";
+#else
+char* device_spec = "bladerf";
+#endif
 
 struct bladerf_stream_data
 {
@@ -64,222 +78,322 @@ struct bladerf_stream_data
     size_t         samples_per_buffer;
     size_t         num_transfers;
     unsigned int   next_buffer;
-    bladerf_module module;
+    radio_module   module;
     int            samples_left;
+    unsigned long  samples_lost;    // RX, by the device, spoiling a capture
+
+    // Continuous mode: stream until stop_streaming, or done, instead of
+    // samples_left, and pass filled RX buffers through the queue.
+    bool            continuous;
+    struct rx_queue *queue;
+    atomic_bool     *done;      // The device's, set once RX has enough
+
+    // TX: send blocks from the waveform library instead of buffers
+    struct waveform_lib *waveforms;
+
+    struct stats_stream *stats; // Written by stream_cb only
+};
+
+struct acquisition
+{
+    struct acq* acq;
+    struct goldcode_cache* codes;
+    int prns[GOLDCODE_N_PRNS];
+    int n_prns;
+};
+
+struct frame_thread_data
+{
+    const struct bladerf_config* cfg;
+    const char* label;      // Starts each message, for telling devices apart
+    const char* samples_filename;
+    const char* profile_filename;
+    const char* rdmap_filename;
+    struct capture_header capture;      // Template for each frame's file
+    struct rx_queue* queue;
+    struct rx_buffer** pending;         // Buffers held until correlated
+    struct corr_job** pending_jobs;
+    size_t max_pending;
+    size_t buffers_per_frame;
+    struct corr_pool* corr; // Correlate each frame if not NULL
+    float* profile;
+    struct rdmap* rdmap;    // Range-Doppler map of each frame if not NULL
+    struct acquisition* acquisition; // Search each frame if not NULL
+    struct cfar* cfar;      // Detect in each frame if not NULL
+    FILE* detections;       // Where cfar's detections go
+    struct resampler* decimator;    // Ahead of the correlator if not NULL
+    int16_t* decimated;     // A decimated copy of each of the queue's buffers
+    struct shm_ring* shm;   // Where to publish each frame, or NULL
+    struct iq_corrector* iq;    // Correct each buffer first if not NULL
+    struct waveform_lib* waveforms;     // Being sent, to follow changes
+    struct goldcode_cache* codes;       // For the correlator to switch to
+    bool save_samples;
+    struct stats* stats;    // Times each stage
+    unsigned long frames_saved;
+    unsigned long frames_dropped;
+};
+
+struct record_thread_data
+{
+    struct rx_queue* queue;
+    struct writer* writer;
+    struct stats* stats;
+    unsigned long buffers_written;
+    unsigned long gaps;     // Places where dropped buffers are missing
+    int error;              // errno of the first failed write, or 0
 };
 
 struct bladerf_thread_data
 {
-    struct bladerf* dev;
-    struct bladerf_stream* stream;
+    struct radio_dev* dev;
+    struct radio_stream* stream;
     struct bladerf_stream_data* stream_data;
-    int *waiting;
+    uint64_t start;         // Device time of the first sample
     int rv;
 };
 
+/*
+ * Everything one radio has to itself. Devices share the settings, the
+ * worker pool and the code spectra; each has its own streams, threads,
+ * buffers, queue and processing state, so none waits on another.
+ */
+struct device
+{
+    const char* spec;
+    char label[32];         // Starts its messages, empty when it is alone
+    char samples_filename[1024];
+    char profile_filename[1024];
+    char rdmap_filename[1024];
+    char detections_filename[1024];
+    char stats_filename[1024];
+    char shm_name[256];
+    struct rt_sched tx_sched;
+    struct rt_sched rx_sched;
+    struct rt_sched frame_sched;
+
+    struct radio_dev* dev;
+    struct radio_stream* tx_stream;
+    struct radio_stream* rx_stream;
+    struct bladerf_stream_data tx_stream_data;
+    struct bladerf_stream_data rx_stream_data;
+    struct bladerf_thread_data tx_thread_data;
+    struct bladerf_thread_data rx_thread_data;
+    atomic_bool done;       // Stops both streams, as stop_streaming does all
+    bool enabled;
+    uint64_t start_time;    // When the first sample comes, on CLOCK_REALTIME
+    struct capture_header capture;
+    struct stats stats;
+
+    struct iq_corrector* iq;
+    struct corr_pool* corr;
+    float* profile;
+    struct resampler* decimator;
+    int16_t* decimated;
+    struct rdmap* rdmap;
+    struct acquisition acquisition;
+    struct cfar* cfar;
+    FILE* detections;
+    struct shm_ring* shm;
+
+    // Continuous mode's consumer, the frame or the record thread
+    struct rx_queue rx_queue;
+    bool queued;            // rx_queue is set up
+    struct writer writer;
+    struct frame_thread_data frame_thread_data;
+    struct record_thread_data record_thread_data;
+    pthread_t tx_thread_pth;
+    pthread_t rx_thread_pth;
+    pthread_t frame_thread_pth;
+    bool tx_running;
+    bool rx_running;
+    bool frame_running;
+};
+
 
 int write_config(struct bladerf_config* config)
 {
     printf("%-20s %-29s", "Writing config to", output_config_filename);
     fflush(stdout);
-    FILE* fout = fopen(output_config_filename, "w");
-    if(!fout) {
+    if(config_write(config, output_config_filename)) {
         printf(KRED "Failed: %s" KNRM "\n", strerror(errno));
         return 1;
     }
-
-    fprintf(fout, "{\n");
-    fprintf(fout, "    \"tx_freq\": %u,\n", config->tx_freq);
-    fprintf(fout, "    \"rx_freq\": %u,\n", config->rx_freq);
-    fprintf(fout, "    \"tx_bw\": %u,\n", config->tx_bw);
-    fprintf(fout, "    \"rx_bw\": %u,\n", config->rx_bw);
-    fprintf(fout, "    \"tx_sr\": %u,\n", config->tx_sr);
-    fprintf(fout, "    \"rx_sr\": %u,\n", config->rx_sr);
-    fprintf(fout, "    \"txvga1\": %d,\n", config->txvga1);
-    fprintf(fout, "    \"txvga2\": %d,\n", config->txvga2);
-    fprintf(fout, "    \"rxvga1\": %d,\n", config->rxvga1);
-    fprintf(fout, "    \"rxvga2\": %d\n", config->rxvga2);
-    fprintf(fout, "}\n");
-
-    fclose(fout);
-
     printf(KGRN "OK" KNRM "\n");
 
     return 0;
 }
 
 
-int configure_bladerf(struct bladerf** dev, struct bladerf_config* config)
+int open_device(struct radio_dev** dev, const char* device_spec)
 {
-    unsigned int abw, asr;
+    const struct radio_backend* backend;
+    const char* args;
     int status;
 
-    setlocale(LC_NUMERIC, "");
-
     printf("%-50s", "Connecting to device... ");
     fflush(stdout);
-    status = bladerf_open(dev, NULL);
+    backend = radio_find_backend(device_spec, &args);
+    status = radio_open(backend, dev, args);
     if(status) {
-        printf(KRED "Failed: %s" KNRM "\n", bladerf_strerror(status));
+        printf(KRED "Failed: %s" KNRM "\n", radio_strerror(backend, status));
         return 1;
     }
     printf(KGRN "OK" KNRM "\n");
 
-    printf("%-50s", "Checking FPGA status... ");
-    fflush(stdout);
-    status = bladerf_is_fpga_configured(*dev);
-    if(status < 0) {
-        printf(KRED "Failed: %s" KNRM "\n", bladerf_strerror(status));
-        bladerf_close(*dev);
-        return 1;
-    } else if(status == 0) {
-        printf(KRED "Failed: FPGA not loaded" KNRM "\n");
-        bladerf_close(*dev);
-        return 1;
-    }
-    printf(KGRN "OK" KNRM "\n");
+    return 0;
+}
 
-    printf("%-30s %'13uHz... ", "Tuning TX to:", config->tx_freq);
-    fflush(stdout);
-    status = bladerf_set_frequency(*dev, BLADERF_MODULE_TX, config->tx_freq);
-    if(status) {
-        printf(KRED "Failed: %s" KNRM "\n", bladerf_strerror(status));
-        bladerf_close(*dev);
-        return 1;
-    }
-    printf(KGRN "OK" KNRM "\n");
 
-    printf("%-30s %'13uHz... ", "Tuning RX to:", config->rx_freq);
-    fflush(stdout);
-    status = bladerf_set_frequency(*dev, BLADERF_MODULE_RX, config->rx_freq);
-    if(status) {
-        printf(KRED "Failed: %s" KNRM "\n", bladerf_strerror(status));
-        bladerf_close(*dev);
-        return 1;
-    }
-    printf(KGRN "OK" KNRM "\n");
+/*
+ * Each of these reads the setting back from the device first and only
+ * writes it if it differs, so rerunning with one setting changed costs a
+ * single write. They print their own progress and return 0 on success.
+ */
+int apply_frequency(struct radio_dev* dev, radio_module module,
+                    const char* label, unsigned int freq)
+{
+    unsigned int current;
+    int status;
 
-    printf("%-30s %'13uHz... ", "Setting TX bandwidth to:", config->tx_bw);
+    printf("%-30s %'13uHz... ", label, freq);
     fflush(stdout);
-    status = bladerf_set_bandwidth(*dev, BLADERF_MODULE_TX,
-                                   config->tx_bw, &abw);
+    if(!radio_get_frequency(dev, module, &current) && current == freq) {
+        printf(KGRN "Unchanged" KNRM "\n");
+        return 0;
+    }
+    status = radio_tune(dev, module, freq);
     if(status) {
-        printf(KRED "Failed: %s" KNRM "\n", bladerf_strerror(status));
-        bladerf_close(*dev);
+        printf(KRED "Failed: %s" KNRM "\n",
+               radio_strerror(dev->backend, status));
         return 1;
     }
     printf(KGRN "OK" KNRM "\n");
 
-    printf("%-30s %'13uHz\n", "Actual bandwidth:", abw);
-    if(abw != config->tx_bw) {
-        printf("Actual bandwidth not equal to desired bandwidth, quitting.\n");
-        return 1;
-    }
+    return 0;
+}
+
+
+int apply_bandwidth(struct radio_dev* dev, radio_module module,
+                    const char* label, unsigned int bw)
+{
+    unsigned int current, abw;
+    int status;
 
-    printf("%-30s %'13uHz... ", "Setting RX bandwidth to:", config->rx_bw);
+    printf("%-30s %'13uHz... ", label, bw);
     fflush(stdout);
-    status = bladerf_set_bandwidth(*dev, BLADERF_MODULE_RX,
-                                   config->rx_bw, &abw);
+    if(!radio_get_bandwidth(dev, module, &current) && current == bw) {
+        printf(KGRN "Unchanged" KNRM "\n");
+        return 0;
+    }
+    status = radio_set_bandwidth(dev, module, bw, &abw);
     if(status) {
-        printf(KRED "Failed: %s" KNRM "\n", bladerf_strerror(status));
-        bladerf_close(*dev);
+        printf(KRED "Failed: %s" KNRM "\n",
+               radio_strerror(dev->backend, status));
         return 1;
     }
     printf(KGRN "OK" KNRM "\n");
 
     printf("%-30s %'13uHz\n", "Actual bandwidth:", abw);
-    if(abw != config->rx_bw) {
+    if(abw != bw) {
         printf("Actual bandwidth not equal to desired bandwidth, quitting.\n");
         return 1;
     }
 
-    printf("%-30s %'12usps... ", "Setting TX sampling rate to:",
-           config->tx_sr);
-    fflush(stdout);
-    status = bladerf_set_sample_rate(*dev, BLADERF_MODULE_TX,
-                                     config->tx_sr, &asr);
-    if(status) {
-        printf(KRED "Failed: %s" KNRM "\n", bladerf_strerror(status));
-        bladerf_close(*dev);
-        return 1;
-    }
-    printf(KGRN "OK" KNRM "\n");
+    return 0;
+}
 
-    printf("%-30s %'12usps\n", "Actual sampling rate:", asr);
-    if(asr != config->tx_sr) {
-        printf("Actual sampling rate not equal to desired sampling rate, "
-               "quitting.\n");
-        return 1;
-    }
 
-    printf("%-30s %'12usps... ", "Setting RX sampling rate to:",
-           config->rx_sr);
+int apply_sample_rate(struct radio_dev* dev, radio_module module,
+                      const char* label, unsigned int sr)
+{
+    unsigned int current, asr;
+    int status;
+
+    printf("%-30s %'12usps... ", label, sr);
     fflush(stdout);
-    status = bladerf_set_sample_rate(*dev, BLADERF_MODULE_RX,
-                                     config->rx_sr, &asr);
+    if(!radio_get_sample_rate(dev, module, &current) && current == sr) {
+        printf(KGRN "Unchanged" KNRM "\n");
+        return 0;
+    }
+    status = radio_set_sample_rate(dev, module, sr, &asr);
     if(status) {
-        printf(KRED "Failed: %s" KNRM "\n", bladerf_strerror(status));
-        bladerf_close(*dev);
+        printf(KRED "Failed: %s" KNRM "\n",
+               radio_strerror(dev->backend, status));
         return 1;
     }
     printf(KGRN "OK" KNRM "\n");
 
     printf("%-30s %'12usps\n", "Actual sampling rate:", asr);
-    if(asr != config->rx_sr) {
+    if(asr != sr) {
         printf("Actual sampling rate not equal to desired sampling rate, "
                "quitting.\n");
         return 1;
     }
 
-    printf("%-30s %+13ddB... ", "Setting TXVGA1 gain to:", config->txvga1);
-    fflush(stdout);
-    status = bladerf_set_txvga1(*dev, config->txvga1);
-    if(status) {
-        printf(KRED "Failed: %s" KNRM "\n", bladerf_strerror(status));
-        bladerf_close(*dev);
-        return 1;
-    }
-    printf(KGRN "OK" KNRM "\n");
+    return 0;
+}
 
-    printf("%-30s %+13ddB... ", "Setting TXVGA2 gain to:", config->txvga2);
-    fflush(stdout);
-    status = bladerf_set_txvga2(*dev, config->txvga2);
-    if(status) {
-        printf(KRED "Failed: %s" KNRM "\n", bladerf_strerror(status));
-        bladerf_close(*dev);
-        return 1;
-    }
-    printf(KGRN "OK" KNRM "\n");
 
-    printf("%-30s %+13ddB... ", "Setting RXVGA1 gain to:", config->rxvga1);
+int apply_gain(struct radio_dev* dev, radio_gain gain, const char* label,
+               int value)
+{
+    int current, status;
+
+    if(gain == RADIO_GAIN_LNA)
+        printf("%-30s %15d... ", label, value);
+    else
+        printf("%-30s %+13ddB... ", label, value);
     fflush(stdout);
-    status = bladerf_set_rxvga1(*dev, config->rxvga1);
+    if(!radio_get_gain(dev, gain, &current) && current == value) {
+        printf(KGRN "Unchanged" KNRM "\n");
+        return 0;
+    }
+    status = radio_set_gain(dev, gain, value);
     if(status) {
-        printf(KRED "Failed: %s" KNRM "\n", bladerf_strerror(status));
-        bladerf_close(*dev);
+        printf(KRED "Failed: %s" KNRM "\n",
+               radio_strerror(dev->backend, status));
         return 1;
     }
     printf(KGRN "OK" KNRM "\n");
 
-    printf("%-30s %+13ddB... ", "Setting RXVGA2 gain to:", config->rxvga2);
-    fflush(stdout);
-    status = bladerf_set_rxvga2(*dev, config->rxvga2);
-    if(status) {
-        printf(KRED "Failed: %s" KNRM "\n", bladerf_strerror(status));
-        bladerf_close(*dev);
+    return 0;
+}
+
+
+int configure_bladerf(struct radio_dev** dev, struct bladerf_config* config,
+                      const char* device_spec)
+{
+    setlocale(LC_NUMERIC, "");
+
+    if(open_device(dev, device_spec)) {
         return 1;
     }
-    printf(KGRN "OK" KNRM "\n");
 
-    printf("%-30s %15d... ", "Setting LNA gain to:", config->lna);
-    fflush(stdout);
-    status = bladerf_set_lna_gain(*dev, config->lna);
-    if(status) {
-        printf(KRED "Failed: %s" KNRM "\n", bladerf_strerror(status));
-        bladerf_close(*dev);
+    if(apply_frequency(*dev, RADIO_MODULE_TX, "Tuning TX to:",
+                       config->tx_freq) ||
+       apply_frequency(*dev, RADIO_MODULE_RX, "Tuning RX to:",
+                       config->rx_freq) ||
+       apply_bandwidth(*dev, RADIO_MODULE_TX, "Setting TX bandwidth to:",
+                       config->tx_bw) ||
+       apply_bandwidth(*dev, RADIO_MODULE_RX, "Setting RX bandwidth to:",
+                       config->rx_bw) ||
+       apply_sample_rate(*dev, RADIO_MODULE_TX,
+                         "Setting TX sampling rate to:", config->tx_sr) ||
+       apply_sample_rate(*dev, RADIO_MODULE_RX,
+                         "Setting RX sampling rate to:", config->rx_sr) ||
+       apply_gain(*dev, RADIO_GAIN_TXVGA1, "Setting TXVGA1 gain to:",
+                  config->txvga1) ||
+       apply_gain(*dev, RADIO_GAIN_TXVGA2, "Setting TXVGA2 gain to:",
+                  config->txvga2) ||
+       apply_gain(*dev, RADIO_GAIN_RXVGA1, "Setting RXVGA1 gain to:",
+                  config->rxvga1) ||
+       apply_gain(*dev, RADIO_GAIN_RXVGA2, "Setting RXVGA2 gain to:",
+                  config->rxvga2) ||
+       apply_gain(*dev, RADIO_GAIN_LNA, "Setting LNA gain to:",
+                  config->lna)) {
+        radio_close(*dev);
         return 1;
     }
-    printf(KGRN "OK" KNRM "\n");
 
     printf("All set up.\n");
 
@@ -287,7 +401,7 @@ int configure_bladerf(struct bladerf** dev, struct bladerf_config* config)
 }
 
 
-int enable(struct bladerf* dev, bool enabled)
+int enable(struct radio_dev* dev, bool enabled)
 {
     int status;
 
@@ -296,10 +410,10 @@ int enable(struct bladerf* dev, bool enabled)
     else
         printf("%-50s", "Disabling TX... ");
     fflush(stdout);
-    status = bladerf_enable_module(dev, BLADERF_MODULE_TX, enabled);
+    status = radio_enable(dev, RADIO_MODULE_TX, enabled);
     if(status) {
-        printf(KRED "Failed: %s" KNRM "\n", bladerf_strerror(status));
-        bladerf_close(dev);
+        printf(KRED "Failed: %s" KNRM "\n",
+               radio_strerror(dev->backend, status));
         return 1;
     }
     printf(KGRN "OK" KNRM "\n");
@@ -309,10 +423,10 @@ int enable(struct bladerf* dev, bool enabled)
     else
         printf("%-50s", "Disabling RX... ");
     fflush(stdout);
-    status = bladerf_enable_module(dev, BLADERF_MODULE_RX, enabled);
+    status = radio_enable(dev, RADIO_MODULE_RX, enabled);
     if(status) {
-        printf(KRED "Failed: %s" KNRM "\n", bladerf_strerror(status));
-        bladerf_close(dev);
+        printf(KRED "Failed: %s" KNRM "\n",
+               radio_strerror(dev->backend, status));
         return 1;
     }
     printf(KGRN "OK" KNRM "\n");
@@ -321,15 +435,32 @@ int enable(struct bladerf* dev, bool enabled)
 }
 
 
-void* stream_cb(struct bladerf *dev, struct bladerf_stream *stream,
-                struct bladerf_metadata *md, void *samples, size_t n_samples,
-                void *user_data)
+void* next_buffer(struct bladerf_stream_data *data, void *samples,
+                  size_t n_samples, size_t n_lost)
 {
-    struct bladerf_stream_data *data = user_data; 
 
-    data->samples_left -= n_samples;
-    if(data->samples_left <= 0) {
-        return NULL;
+    if(data->continuous) {
+        if(stop_streaming || atomic_load(data->done)) {
+            return NULL;
+        }
+        if(samples && data->queue) {
+            void *rv = rx_queue_cb(data->queue,
+                                   n_lost / data->samples_per_buffer);
+            if(!rv) {
+                atomic_store(data->done, true);
+            }
+            return rv;
+        }
+    } else {
+        data->samples_lost += n_lost;
+        data->samples_left -= n_samples;
+        if(data->samples_left <= 0) {
+            return NULL;
+        }
+    }
+
+    if(data->waveforms) {
+        return waveform_next(data->waveforms);
     }
 
     void *rv = data->buffers[data->next_buffer];
@@ -338,25 +469,71 @@ void* stream_cb(struct bladerf *dev, struct bladerf_stream *stream,
 }
 
 
-int setup_rx_stream(struct bladerf* dev, struct bladerf_stream** stream,
-                    struct bladerf_stream_data* stream_data)
+void* stream_cb(struct radio_stream *stream, void *samples, size_t n_samples,
+                size_t n_lost, void *user_data)
+{
+    struct bladerf_stream_data *data = user_data;
+    uint64_t start = stats_now();
+    unsigned long dropped = data->queue ? data->queue->buffers_dropped : 0;
+    void *rv = next_buffer(data, samples, n_samples, n_lost);
+
+    if(data->queue) {
+        stats_add(&data->stats->dropped,
+                  data->queue->buffers_dropped - dropped);
+    }
+    stats_stream_cb(data->stats, start, n_samples);
+    return rv;
+}
+
+
+struct init_stream_call
 {
+    struct radio_dev* dev;
+    struct radio_stream** stream;
+    struct bladerf_stream_data* stream_data;
     int status;
+};
 
-    stream_data->next_buffer = 0;
-    stream_data->module = BLADERF_MODULE_RX;
 
-    printf("%-50s", "Initialising RX data stream... ");
-    fflush(stdout);
-    status = bladerf_init_stream(stream, dev, stream_cb,
-                                 &stream_data->buffers,
-                                 stream_data->num_buffers,
-                                 BLADERF_FORMAT_SC16_Q12,
-                                 stream_data->samples_per_buffer,
-                                 stream_data->num_transfers, stream_data);
+void* init_stream_call(void* arg)
+{
+    struct init_stream_call* call = arg;
+    struct bladerf_stream_data* stream_data = call->stream_data;
+
+    call->status = radio_init_stream(call->stream, call->dev,
+                                     stream_data->module, stream_cb,
+                                     &stream_data->buffers,
+                                     stream_data->num_buffers,
+                                     stream_data->samples_per_buffer,
+                                     stream_data->num_transfers,
+                                     stream_data);
+    return NULL;
+}
+
+
+/*
+ * Initialise the stream under sched, as the thread that will run it is, so
+ * that any worker the backend starts for it (libbladeRF's sync interface
+ * services its transfers from one) gets the same priority and CPU.
+ * Prints the outcome; returns 0 or 1.
+ */
+int init_stream(struct radio_dev* dev, struct radio_stream** stream,
+                struct bladerf_stream_data* stream_data,
+                const struct rt_sched* sched)
+{
+    struct init_stream_call call = { dev, stream, stream_data, 0 };
+    int status;
+
+    status = rt_call(sched, init_stream_call, &call);
     if(status) {
-        printf(KRED "Failed: %s" KNRM "\n", bladerf_strerror(status));
-        bladerf_close(dev);
+        printf(KRED "Failed: %s" KNRM "\n", strerror(status));
+        *stream = NULL;
+        return 1;
+    }
+    if(call.status) {
+        printf(KRED "Failed: %s" KNRM "\n",
+               radio_strerror(dev->backend, call.status));
+        *stream = NULL;
         return 1;
     }
     printf(KGRN "OK" KNRM "\n");
@@ -364,49 +541,84 @@ int setup_rx_stream(struct bladerf* dev, struct bladerf_stream** stream,
 }
 
 
-void fill_tx_buffers(struct bladerf_stream_data* stream_data)
+int setup_rx_stream(struct radio_dev* dev, struct radio_stream** stream,
+                    struct bladerf_stream_data* stream_data,
+                    const struct rt_sched* sched)
 {
-    size_t i, j;
-    int16_t* samples;
-    for(i=0; i<stream_data->num_buffers; i++) {
-        samples = stream_data->buffers[i];
-        memcpy(samples, gc1, sizeof(*samples) * 2048); 
-        /*
-        memset(samples, 0,
-               stream_data->samples_per_buffer * sizeof(*samples) * 2);
-        for(j=0; j<(stream_data->samples_per_buffer / 256); j++) {
-            samples[j*2*256] = 2047;
-        }
-        */
-    }
+
+    // The first num_transfers buffers are submitted by the stream itself, so
+    // hand out buffers from there on to keep them in capture order.
+    stream_data->next_buffer = stream_data->num_transfers;
+    stream_data->module = RADIO_MODULE_RX;
+
+    printf("%-50s", "Initialising RX data stream... ");
+    fflush(stdout);
+    return init_stream(dev, stream, stream_data, sched);
 }
 
 
-int setup_tx_stream(struct bladerf* dev, struct bladerf_stream** stream,
-                    struct bladerf_stream_data* stream_data)
+/*
+ * Set up the TX stream to send blocks from a library of the given
+ * waveforms, all built here, starting with the first.
+ */
+int setup_tx_stream(struct radio_dev* dev, struct radio_stream** stream,
+                    struct bladerf_stream_data* stream_data,
+                    const struct bladerf_config* cfg,
+                    const struct waveform* waveforms, int n_waveforms,
+                    const struct rt_sched* sched)
 {
-    int status;
-
     stream_data->next_buffer = 0;
-    stream_data->module = BLADERF_MODULE_TX;
+    stream_data->module = RADIO_MODULE_TX;
 
     printf("%-50s", "Initialising TX data stream... ");
     fflush(stdout);
-    status = bladerf_init_stream(stream, dev, stream_cb,
-                                 &stream_data->buffers,
-                                 stream_data->num_buffers,
-                                 BLADERF_FORMAT_SC16_Q12,
-                                 stream_data->samples_per_buffer,
-                                 stream_data->num_transfers, stream_data);
+    if(init_stream(dev, stream, stream_data, sched)) {
+        return 1;
+    }
+
+    printf("%-50s", "Building TX waveforms... ");
+    fflush(stdout);
+    stream_data->waveforms =
+        waveform_lib_create(waveforms, n_waveforms,
+                            stream_data->samples_per_buffer, cfg->tx_sr,
+                            TX_AMPLITUDE);
+    if(!stream_data->waveforms) {
+        printf(KRED "Failed: %s" KNRM "\n", strerror(errno));
+        radio_deinit_stream(*stream);
+        *stream = NULL;
+        return 1;
+    }
+    printf(KGRN "%d" KNRM "\n", n_waveforms);
+    return 0;
+}
+
+
+/*
+ * Pick the device time at which both streams start, START_DELAY from now
+ * and on a code period boundary, so that TX and RX line up the same way on
+ * every run. *start_time is when that will be on CLOCK_REALTIME, in ns.
+ */
+int schedule_start(struct radio_dev* dev, const struct bladerf_config* cfg,
+                   uint64_t* start, uint64_t* start_time)
+{
+    uint64_t now, period = CODE_LEN_RX(cfg);
+    int status;
+
+    printf("%-50s", "Scheduling start... ");
+    fflush(stdout);
+    status = radio_get_time(dev, &now);
     if(status) {
-        printf(KRED "Failed: %s" KNRM "\n", bladerf_strerror(status));
-        bladerf_close(dev);
+        printf(KRED "Failed: %s" KNRM "\n",
+               radio_strerror(dev->backend, status));
         return 1;
     }
+    *start_time = capture_time_now();
 
-    fill_tx_buffers(stream_data);
+    *start = now + (uint64_t)(START_DELAY * cfg->rx_sr);
+    *start = (*start + period - 1) / period * period;
+    *start_time += (*start - now) * 1000000000ULL / cfg->rx_sr;
+    printf(KGRN "%" PRIu64 KNRM "\n", *start);
 
-    printf(KGRN "OK" KNRM "\n");
     return 0;
 }
 
@@ -415,28 +627,24 @@ void* txrx_thread(void* arg)
 {
     struct bladerf_thread_data* thread_data = (struct bladerf_thread_data*)arg;
 
-    /*
-    while(*(thread_data->waiting))
-        usleep(1);
-    */
-
-    thread_data->rv = bladerf_stream(thread_data->stream,
-                                     thread_data->stream_data->module);
+    thread_data->rv = radio_stream_at(thread_data->stream,
+                                      thread_data->stream_data->module,
+                                      thread_data->start);
 
     return NULL;
 }
 
 
-int save_rx_data(struct bladerf_stream_data* stream_data)
+int save_rx_data(struct bladerf_stream_data* stream_data,
+                 const struct capture_header* capture, const char* filename)
 {
-    FILE* fout;
-    size_t i, j, written;
-    int16_t* samples;
+    struct writer writer;
+    size_t i;
+    int status;
 
-    printf("%-10s %-39s", "Opening", output_samples_filename);
+    printf("%-10s %-39s", "Opening", filename);
     fflush(stdout);
-    fout = fopen(output_samples_filename, "wb");
-    if(!fout) {
+    if(writer_open(&writer, filename, false, capture)) {
         printf(KRED "Failed: %s" KNRM "\n", strerror(errno));
         return 1;
     }
@@ -444,260 +652,1869 @@ int save_rx_data(struct bladerf_stream_data* stream_data)
 
     printf("%-50s", "Writing data... ");
 
-    for(i=0; i<stream_data->num_buffers; i++) {
-        samples = stream_data->buffers[i];
-        for(j=0; j<stream_data->samples_per_buffer; j++) {
-            *samples &= 0x0fff;
-            if(*samples & 0x0800)
-                *samples |= 0xf000;
-            *(samples+1) &= 0x0fff;
-            if(*(samples+1) & 0x0800)
-                *(samples+1) |= 0xf000;
-            samples += 2;
-        }
-        samples = stream_data->buffers[i];
-
-        written = fwrite(samples, sizeof(*samples),
-                         stream_data->samples_per_buffer * 2, fout);
-        if(written != stream_data->samples_per_buffer * 2) {
-            printf(KRED "Failed: %s" KNRM "\n", strerror(errno));
+    // Packing sign-extends as it goes
+    if(capture->format == CAPTURE_FORMAT_SC16) {
+        for(i=0; i<stream_data->num_buffers; i++) {
+            sc16_sign_extend(stream_data->buffers[i],
+                             stream_data->samples_per_buffer);
         }
-
+    }
+    status = writer_write(&writer, stream_data->buffers,
+                          stream_data->num_buffers,
+                          stream_data->samples_per_buffer * 2 *
+                          sizeof(int16_t), 0);
+    status |= writer_close(&writer);
+    if(status) {
+        printf(KRED "Failed: %s" KNRM "\n", strerror(errno));
+    } else {
+        printf(KGRN "OK" KNRM "\n");
     }
 
+    return status;
+}
 
-    printf(KGRN "OK" KNRM "\n");
 
-    fclose(fout);
+/*
+ * Computes the spectra of every PRN's code as received, each TX sample
+ * lasting rx_sr/tx_sr RX samples less any decimation, unless *codes holds
+ * them already, and sets the correlator up for prn. The codes are delayed
+ * to match the decimator's.
+ */
+struct corr_pool* create_correlator(struct bladerf_config* cfg,
+                                    struct pool* pool,
+                                    struct goldcode_cache** codes, int prn)
+{
+    struct corr_pool* corr;
 
-    return 0;
-}
+    printf("%-50s", "Creating correlator... ");
+    fflush(stdout);
+    if(!*codes) {
+        *codes = goldcode_cache_create(CODE_LEN_CORR(cfg),
+                                       CORR_SAMPLES_PER_CHIP(cfg),
+                                       CORR_DELAY(cfg));
+    }
+    if(!*codes) {
+        printf(KRED "Failed: %s" KNRM "\n", strerror(ENOMEM));
+        return NULL;
+    }
+    corr = corr_pool_create(goldcode_spectrum(*codes, prn),
+                            CODE_LEN_CORR(cfg), pool, CORR_MAX_JOBS(cfg));
+    if(!corr) {
+        printf(KRED "Failed: %s" KNRM "\n", strerror(ENOMEM));
+        return NULL;
+    }
+    printf(KGRN "OK" KNRM "\n");
 
-void ignore_sigint(int sig)
-{
-    return;
+    return corr;
 }
 
 
-int main(int argc, char** argv) {
-    int status, threads_waiting = 1, quick;
-    struct bladerf* dev;
-    struct bladerf_config* cfg;
-    struct bladerf_stream* tx_stream;
-    struct bladerf_stream* rx_stream;
-    struct bladerf_stream_data* tx_stream_data;
-    struct bladerf_stream_data* rx_stream_data;
-    struct bladerf_thread_data* tx_thread_data;
-    struct bladerf_thread_data* rx_thread_data;
-    pthread_t tx_thread_pth;
-    pthread_t rx_thread_pth;
-
-    signal(SIGINT, ignore_sigint);
+/*
+ * Lowpass filter and decimate RX buffers by rx_decimation before they are
+ * correlated, along with room for a decimated copy of every buffer the
+ * correlator can have in flight.
+ */
+struct resampler* create_decimator(const struct bladerf_config* cfg,
+                                   int16_t** decimated)
+{
+    struct resampler* rs;
 
-    cfg = malloc(sizeof(struct bladerf_config));
-    tx_stream_data = malloc(sizeof(struct bladerf_stream_data));
-    rx_stream_data = malloc(sizeof(struct bladerf_stream_data));
-    tx_thread_data = malloc(sizeof(struct bladerf_thread_data));
-    rx_thread_data = malloc(sizeof(struct bladerf_thread_data));
-
-    cfg->tx_freq = TXFREQ;
-    cfg->rx_freq = RXFREQ;
-    cfg->tx_bw = TXBW;
-    cfg->rx_bw = RXBW;
-    cfg->tx_sr = TXSR;
-    cfg->rx_sr = RXSR;
-    cfg->txvga1 = TXVGA1;
-    cfg->txvga2 = TXVGA2;
-    cfg->rxvga1 = RXVGA1;
-    cfg->rxvga2 = RXVGA2;
-    cfg->lna = LNA;
-
-    if(argc == 2 && argv[1][0] == 'q') {
-        quick = 1;
-    } else {
-        quick = 0;
+    printf("%-50s", "Creating decimator... ");
+    fflush(stdout);
+    rs = resampler_create(1, cfg->rx_decimation,
+                          DECIMATION_HALF_LEN * cfg->rx_decimation,
+                          cfg->rx_samples_per_buffer);
+    *decimated = rt_alloc((size_t)CORR_MAX_JOBS(cfg) *
+                          cfg->rx_samples_per_buffer / cfg->rx_decimation *
+                          2 * sizeof(int16_t));
+    if(!rs || !*decimated) {
+        printf(KRED "Failed: %s" KNRM "\n", strerror(ENOMEM));
+        resampler_destroy(rs);
+        rt_free(*decimated);
+        *decimated = NULL;
+        return NULL;
     }
+    printf(KGRN "%u taps" KNRM "\n", (unsigned int)rs->taps);
 
-    if(!quick) {
-        if(write_config(cfg)) {
-            if(cfg) free(cfg);
-            if(tx_stream_data) free(tx_stream_data);
-            if(rx_stream_data) free(rx_stream_data);
-            if(tx_thread_data) free(tx_thread_data);
-            if(rx_thread_data) free(rx_thread_data);
-            return 1;
-        }
+    return rs;
+}
 
-        if(configure_bladerf(&dev, cfg)) {
-            if(cfg) free(cfg);
-            if(tx_stream_data) free(tx_stream_data);
-            if(rx_stream_data) free(rx_stream_data);
-            if(tx_thread_data) free(tx_thread_data);
-            if(rx_thread_data) free(rx_thread_data);
-            return 1;
-        }
-    } else {
-        status = bladerf_open(&dev, NULL);
-        if(status) {
-            return 1;
-        }
-    }
 
-    tx_stream_data->num_buffers        = TX_N_BUFFERS;
-    tx_stream_data->samples_per_buffer = TX_SAMPLES_PER_BUFFER;
-    tx_stream_data->samples_left       = TX_N_SAMPLES;
-    tx_stream_data->num_transfers      = TX_N_TRANSFERS;
+/*
+ * Write the averaged correlation profile as float32 values, via a temporary
+ * file renamed into place like the sample frames.
+ */
+int save_profile(const float* profile, size_t n, const char* filename)
+{
+    char tmp_filename[1024];
+    FILE* fout;
+    size_t written;
 
-    if(setup_tx_stream(dev, &tx_stream, tx_stream_data)) {
-        if(cfg) free(cfg);
-        if(tx_stream_data) free(tx_stream_data);
-        if(rx_stream_data) free(rx_stream_data);
-        if(tx_thread_data) free(tx_thread_data);
-        if(rx_thread_data) free(rx_thread_data);
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", filename);
+    fout = fopen(tmp_filename, "wb");
+    if(!fout) {
         return 1;
     }
 
-    rx_stream_data->num_buffers        = RX_N_BUFFERS;
-    rx_stream_data->samples_per_buffer = RX_SAMPLES_PER_BUFFER;
-    rx_stream_data->samples_left       = RX_N_SAMPLES;
-    rx_stream_data->num_transfers      = RX_N_TRANSFERS;
-
-    if(setup_rx_stream(dev, &rx_stream, rx_stream_data)) {
-        bladerf_deinit_stream(tx_stream);
-        if(cfg) free(cfg);
-        if(tx_stream_data) free(tx_stream_data);
-        if(rx_stream_data) free(rx_stream_data);
-        if(tx_thread_data) free(tx_thread_data);
-        if(rx_thread_data) free(rx_thread_data);
+    written = fwrite(profile, sizeof(*profile), n, fout);
+    if(fclose(fout) || written != n) {
+        unlink(tmp_filename);
         return 1;
     }
 
-    if(enable(dev, true)) {
-        enable(dev, false);
-        bladerf_deinit_stream(rx_stream);
-        bladerf_deinit_stream(tx_stream);
-        bladerf_close(dev);
-        if(cfg) free(cfg);
-        if(tx_stream_data) free(tx_stream_data);
-        if(rx_stream_data) free(rx_stream_data);
-        if(tx_thread_data) free(tx_thread_data);
-        if(rx_thread_data) free(rx_thread_data);
-        return 1;
-    }
+    return rename(tmp_filename, filename) ? 1 : 0;
+}
 
-    tx_thread_data->dev = dev;
-    tx_thread_data->stream = tx_stream;
-    tx_thread_data->stream_data = tx_stream_data;
-    tx_thread_data->waiting = &threads_waiting;
-    tx_thread_data->rv = 1;
 
-    printf("%-50s", "Creating TX thread... ");
-    status = pthread_create(&tx_thread_pth, NULL, txrx_thread,
-                            tx_thread_data);
-    if(status) {
-        printf(KRED "Failed: %s" KNRM "\n", strerror(status));
-        bladerf_deinit_stream(rx_stream);
-        bladerf_close(dev);
-        if(cfg) free(cfg);
-        if(tx_stream_data) free(tx_stream_data);
-        if(rx_stream_data) free(rx_stream_data);
-        if(tx_thread_data) free(tx_thread_data);
-        if(rx_thread_data) free(rx_thread_data);
-        return 1;
-    }
-    printf(KGRN "OK" KNRM "\n");
+void rdmap_chunk(void* user_data, unsigned long period, const cf32* chunk)
+{
+    rdmap_add_profile(user_data, period, chunk);
+}
 
-    usleep(100);
 
-    rx_thread_data->dev = dev;
-    rx_thread_data->stream = rx_stream;
-    rx_thread_data->stream_data = rx_stream_data;
-    rx_thread_data->waiting = &threads_waiting;
-    rx_thread_data->rv = 1;
+/*
+ * The map's Doppler axis covers the code periods in a frame, rounded up to
+ * a power of two.
+ */
+struct rdmap* create_rdmap(const struct bladerf_config* cfg,
+                           struct corr_pool* corr)
+{
+    struct rdmap* rdmap;
+    size_t n_doppler = 1;
 
-    printf("%-50s", "Creating RX thread... ");
-    status = pthread_create(&rx_thread_pth, NULL, txrx_thread,
-                            rx_thread_data);
-    if(status) {
-        printf(KRED "Failed: %s" KNRM "\n", strerror(status));
-        bladerf_deinit_stream(rx_stream);
-        bladerf_deinit_stream(tx_stream);
-        bladerf_close(dev);
-        if(cfg) free(cfg);
-        if(tx_stream_data) free(tx_stream_data);
-        if(rx_stream_data) free(rx_stream_data);
-        if(tx_thread_data) free(tx_thread_data);
-        if(rx_thread_data) free(rx_thread_data);
-        return 1;
+    while(n_doppler < cfg->rx_n_samples / CODE_LEN_RX(cfg)) {
+        n_doppler *= 2;
     }
-    printf(KGRN "OK" KNRM "\n");
-
-    printf("%-50s", "Starting processing... ");
-    threads_waiting = 0;
-    printf(KGRN "OK" KNRM "\n");
 
-    printf("%-50s", "Waiting for completion... ");
-    fflush(stdout);
-    pthread_join(rx_thread_pth, NULL);
-    pthread_join(tx_thread_pth, NULL);
-    printf(KGRN "OK" KNRM "\n");
-
-    printf("%-50s", "All done, checking TX results... ");
+    printf("%-50s", "Creating range-Doppler map... ");
     fflush(stdout);
-    if(tx_thread_data->rv < 0) {
-        printf(KRED "Failed: %s" KNRM "\n",
-               bladerf_strerror(tx_thread_data->rv));
-        enable(dev, false);
-        bladerf_deinit_stream(rx_stream);
-        bladerf_close(dev);
-        if(cfg) free(cfg);
-        if(tx_stream_data) free(tx_stream_data);
-        if(rx_stream_data) free(rx_stream_data);
-        if(tx_thread_data) free(tx_thread_data);
-        if(rx_thread_data) free(rx_thread_data);
-        return 1;
+    rdmap = rdmap_create(CODE_LEN_CORR(cfg), n_doppler, corr->pool);
+    if(!rdmap) {
+        printf(KRED "Failed: %s" KNRM "\n", strerror(ENOMEM));
+        return NULL;
     }
+    corr_pool_set_chunk_cb(corr, rdmap_chunk, rdmap);
     printf(KGRN "OK" KNRM "\n");
 
+    return rdmap;
+}
 
-    printf("%-50s", "          checking RX results... ");
-    fflush(stdout);
-    if(rx_thread_data->rv < 0) {
-        printf(KRED "Failed: %s" KNRM "\n",
-               bladerf_strerror(tx_thread_data->rv));
-        enable(dev, false);
-        bladerf_deinit_stream(rx_stream);
-        bladerf_close(dev);
-        if(cfg) free(cfg);
-        if(tx_stream_data) free(tx_stream_data);
-        if(rx_stream_data) free(rx_stream_data);
-        if(tx_thread_data) free(tx_thread_data);
-        if(rx_thread_data) free(rx_thread_data);
-        return 1;
-    }
-    printf(KGRN "OK" KNRM "\n");
 
-    printf(KGRN "Success!" KNRM "\n");
+/*
+ * Transform the code periods correlated so far and write the map, preceded
+ * by a struct rdmap_header, via a temporary file renamed into place.
+ */
+int save_rdmap(const struct bladerf_config* cfg, struct rdmap* rdmap,
+               struct corr_pool* corr, unsigned long frame,
+               const char* filename)
+{
+    char tmp_filename[1024];
+    struct rdmap_header header;
+    FILE* fout;
+    size_t n = rdmap->n_range * rdmap->n_doppler, written;
+
+    rdmap_compute(rdmap, corr->periods, corr->pool);
+
+    memcpy(header.magic, RDMAP_MAGIC, sizeof(header.magic));
+    header.n_range = rdmap->n_range;
+    header.n_doppler = rdmap->n_doppler;
+    header.n_periods = rdmap->periods;
+    header.frame = frame;
+    header.prf = (float)cfg->rx_sr / CODE_LEN_RX(cfg);
+    header.range_bin = 1.0f / CORR_SR(cfg);
+
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", filename);
+    fout = fopen(tmp_filename, "wb");
+    if(!fout) {
+        return 1;
+    }
+
+    written = fwrite(&header, sizeof(header), 1, fout);
+    written += fwrite(rdmap->map, sizeof(float), n, fout);
+    if(fclose(fout) || written != n + 1) {
+        unlink(tmp_filename);
+        return 1;
+    }
+
+    return rename(tmp_filename, filename) ? 1 : 0;
+}
+
+
+/*
+ * Shared memory ring for live viewers, with room for a frame of samples and
+ * whatever processing results there are.
+ */
+struct shm_ring* create_publisher(const struct bladerf_config* cfg,
+                                  const char* name, struct corr_pool* corr,
+                                  struct rdmap* rdmap)
+{
+    struct shm_ring* shm;
+    struct shm_ring_header header;
+
+    memset(&header, 0, sizeof(header));
+    header.frame_samples = cfg->rx_n_samples;
+    header.rx_sr = cfg->rx_sr;
+    header.sections[SHM_SECTION_SAMPLES].size =
+        (uint64_t)cfg->rx_n_samples * 2 * sizeof(int16_t);
+    if(corr) {
+        header.n_range = corr->n;
+        header.prf = (float)cfg->rx_sr / CODE_LEN_RX(cfg);
+        header.range_bin = 1.0f / CORR_SR(cfg);
+        header.sections[SHM_SECTION_PROFILE].size = corr->n * sizeof(float);
+    }
+    if(rdmap) {
+        header.n_doppler = rdmap->n_doppler;
+        header.sections[SHM_SECTION_MAP].size =
+            rdmap->n_range * rdmap->n_doppler * sizeof(float);
+    }
+
+    printf("%-10s %-39s", "Publishing", name);
+    fflush(stdout);
+    shm = shm_ring_create(name, &header, SHM_RING_SLOTS);
+    if(!shm) {
+        printf(KRED "Failed: %s" KNRM "\n", strerror(errno));
+        return NULL;
+    }
+    printf(KGRN "OK" KNRM "\n");
+
+    return shm;
+}
+
+
+// Copy a buffer into its place in the frame being published, sign-extended
+void publish_buffer(struct shm_ring* shm, const struct rx_buffer* buf,
+                    size_t samples_per_buffer, size_t buffers_per_frame)
+{
+    int16_t* samples = shm_ring_section(shm, SHM_SECTION_SAMPLES);
+
+    samples += buf->seq % buffers_per_frame * samples_per_buffer * 2;
+    memcpy(samples, buf->samples, samples_per_buffer * 2 * sizeof(int16_t));
+    sc16_sign_extend(samples, samples_per_buffer);
+    shm->slot->n_samples += samples_per_buffer;
+}
+
+
+// Add the frame's profile and map, if published, and make it the newest
+void publish_frame(struct shm_ring* shm, const float* profile,
+                   const struct rdmap* rdmap)
+{
+    const struct shm_section* sections = shm->header->sections;
+
+    if(sections[SHM_SECTION_PROFILE].size) {
+        memcpy(shm_ring_section(shm, SHM_SECTION_PROFILE), profile,
+               sections[SHM_SECTION_PROFILE].size);
+    }
+    if(sections[SHM_SECTION_MAP].size) {
+        memcpy(shm_ring_section(shm, SHM_SECTION_MAP), rdmap->map,
+               sections[SHM_SECTION_MAP].size);
+    }
+    shm_ring_commit(shm);
+}
+
+
+/*
+ * Parse a comma separated list of up to max CPUs into cpus, repeating the
+ * last for any not given. Returns 0 if the list is not valid.
+ */
+int parse_cpus(const char* arg, int* cpus, int max)
+{
+    int n = 0;
+    long cpu;
+    char* end;
+
+    while(*arg && n < max) {
+        cpu = strtol(arg, &end, 10);
+        if(end == arg || cpu < 0 || cpu >= sysconf(_SC_NPROCESSORS_CONF) ||
+           (*end && *end != ',')) {
+            return 0;
+        }
+        cpus[n++] = cpu;
+        arg = *end ? end + 1 : end;
+    }
+    if(*arg || !n) {
+        return 0;
+    }
+    for(; n<max; n++) {
+        cpus[n] = cpus[n - 1];
+    }
+
+    return max;
+}
+
+
+/*
+ * Bytes of buffers taken from the rt arena: both streams', the TX
+ * waveforms' and the decimator's, each a whole number of pages.
+ */
+size_t arena_size(const struct bladerf_config* cfg, size_t rx_buffers,
+                  int n_waveforms, bool decimate)
+{
+    size_t tx = (cfg->tx_samples_per_buffer * 2 * sizeof(int16_t) +
+                 RT_PAGE_SIZE - 1) / RT_PAGE_SIZE * RT_PAGE_SIZE;
+    size_t rx = (cfg->rx_samples_per_buffer * 2 * sizeof(int16_t) +
+                 RT_PAGE_SIZE - 1) / RT_PAGE_SIZE * RT_PAGE_SIZE;
+    size_t size;
+
+    // Waveforms have a block each, and there may be one of silence
+    size = (cfg->tx_n_buffers + n_waveforms + 1) * tx + rx_buffers * rx;
+    if(decimate) {
+        size += CORR_MAX_JOBS(cfg) * rx / cfg->rx_decimation + RT_PAGE_SIZE;
+    }
+
+    return size;
+}
+
+
+/*
+ * Run the detector over the range-Doppler map, one Doppler bin at a time,
+ * or else over the averaged profile, and append the frame's detections to
+ * fout.
+ */
+int save_detections(FILE* fout, const struct bladerf_config* cfg,
+                    struct cfar* cfar, const float* profile,
+                    const struct rdmap* rdmap, unsigned long frame)
+{
+    struct cfar_header header;
+    size_t d, written;
+
+    cfar_reset(cfar);
+    if(rdmap) {
+        for(d=0; d<rdmap->n_doppler; d++) {
+            cfar_run(cfar, rdmap->map + d, rdmap->n_range, rdmap->n_doppler,
+                     (int32_t)d - (int32_t)(rdmap->n_doppler / 2));
+        }
+    } else {
+        cfar_run(cfar, profile, CODE_LEN_CORR(cfg), 1, 0);
+    }
+
+    memcpy(header.magic, CFAR_MAGIC, sizeof(header.magic));
+    header.n_detections = cfar->n_detections;
+    header.frame = frame;
+    header.prf = (float)cfg->rx_sr / CODE_LEN_RX(cfg);
+    header.range_bin = 1.0f / CORR_SR(cfg);
+    header.n_range = rdmap ? rdmap->n_range : CODE_LEN_CORR(cfg);
+    header.n_doppler = rdmap ? rdmap->n_doppler : 1;
+    header.missed = cfar->missed;
+    header.reserved = 0;
+
+    written = fwrite(&header, sizeof(header), 1, fout);
+    written += fwrite(cfar->detections, sizeof(struct cfar_detection),
+                      cfar->n_detections, fout);
+    if(fflush(fout) || written != cfar->n_detections + 1) {
+        return 1;
+    }
+
+    return 0;
+}
+
+
+struct cfar* create_detector(const struct bladerf_config* cfg,
+                             const struct cfar_config* config, FILE** fout,
+                             const char* filename)
+{
+    struct cfar* cfar;
+
+    printf("%-50s", "Creating detector... ");
+    fflush(stdout);
+    cfar = cfar_create(config, CODE_LEN_CORR(cfg), CFAR_MAX_DETECTIONS);
+    if(!cfar) {
+        printf(KRED "Failed: %s" KNRM "\n", strerror(ENOMEM));
+        return NULL;
+    }
+    *fout = fopen(filename, "wb");
+    if(!*fout) {
+        printf(KRED "Failed: %s: %s" KNRM "\n", filename, strerror(errno));
+        cfar_destroy(cfar);
+        return NULL;
+    }
+    printf(KGRN "%s" KNRM "\n", config->type == CFAR_OS ? "OS" : "CA");
+
+    return cfar;
+}
+
+
+/*
+ * Parse a comma separated list of PRNs, or "all", into prns.
+ * Returns how many there are, or 0 if the list is not valid.
+ */
+int parse_prns(const char* arg, int* prns)
+{
+    int n = 0;
+    long prn;
+    char* end;
+
+    if(!strcmp(arg, "all")) {
+        for(n=0; n<GOLDCODE_N_PRNS; n++) {
+            prns[n] = n + 1;
+        }
+        return n;
+    }
+
+    while(*arg && n < GOLDCODE_N_PRNS) {
+        prn = strtol(arg, &end, 10);
+        if(end == arg || prn < 1 || prn > GOLDCODE_N_PRNS ||
+           (*end && *end != ',')) {
+            return 0;
+        }
+        prns[n++] = prn;
+        arg = *end ? end + 1 : end;
+    }
+
+    return *arg ? 0 : n;
+}
+
+
+struct acq* create_acquisition(const struct bladerf_config* config,
+                               struct pool* pool)
+{
+    struct acq* acq;
+    struct acq_config cfg = {
+        .n = CODE_LEN_CORR(config),
+        .sample_rate = CORR_SR(config),
+        .doppler_min = ACQ_DOPPLER_MIN,
+        .doppler_step = ACQ_DOPPLER_STEP,
+        .n_doppler = ACQ_N_DOPPLER,
+        .max_codes = GOLDCODE_N_PRNS,
+        .threshold = ACQ_THRESHOLD,
+    };
+
+    printf("%-50s", "Creating acquisition engine... ");
+    fflush(stdout);
+    acq = acq_create(&cfg, pool);
+    if(!acq) {
+        printf(KRED "Failed: %s" KNRM "\n", strerror(ENOMEM));
+        return NULL;
+    }
+    printf(KGRN "OK" KNRM "\n");
+
+    return acq;
+}
+
+
+/*
+ * Search one code period of samples for each of the chosen PRNs and print
+ * a line, starting with label, for each one detected.
+ */
+void acquire(struct acquisition* acquisition, const int16_t* samples,
+             const char* label)
+{
+    const cf32* codes[GOLDCODE_N_PRNS];
+    struct acq_result results[GOLDCODE_N_PRNS];
+    int i;
+
+    for(i=0; i<acquisition->n_prns; i++) {
+        codes[i] = goldcode_spectrum(acquisition->codes,
+                                     acquisition->prns[i]);
+    }
+    acq_search(acquisition->acq, samples, codes, acquisition->n_prns,
+               results);
+
+    for(i=0; i<acquisition->n_prns; i++) {
+        if(results[i].detected) {
+            printf("%sAcquired PRN %d: Doppler %+.0f Hz, code phase %zu, "
+                   "peak/mean %.1f\n", label, acquisition->prns[i],
+                   results[i].doppler, results[i].code_phase,
+                   results[i].metric);
+        }
+    }
+}
+
+
+/*
+ * Frame consumer for continuous mode. Takes filled buffers off the RX queue
+ * in capture order and writes each frame of buffers_per_frame buffers to a
+ * temporary file, which is renamed over samples_filename once the frame is
+ * complete, so readers never see a partly written frame. With a
+ * correlator, each buffer is also queued for correlation on the worker pool
+ * as it arrives, and held until that is done; the frame's averaged profile
+ * is saved to profile_filename, along with its range-Doppler map if rdmap
+ * is set. With acquisition set, the frame's last code period is
+ * searched too. With a decimator, each buffer is filtered and decimated
+ * first, and the correlator and everything after it work on that instead.
+ * Each saved frame is announced on stdout as "Frame N". Frames with
+ * buffers dropped by stream_cb are discarded, and every frame of stream
+ * time not saved is counted as dropped.
+ */
+void* frame_thread(void* arg)
+{
+    struct frame_thread_data* thread_data = arg;
+    struct rx_queue* queue = thread_data->queue;
+    struct corr_pool* corr = thread_data->corr;
+    struct rx_buffer* buf;
+    struct resampler* decimator = thread_data->decimator;
+    int16_t* samples;
+    size_t corr_samples;
+    struct rx_buffer** pending = thread_data->pending;
+    struct corr_job** pending_jobs = thread_data->pending_jobs;
+    char tmp_filename[1024];
+    struct writer writer;
+    bool open = false;
+    unsigned long frame = 0, expected = 0, frames;
+    size_t bpf = thread_data->buffers_per_frame;
+    size_t max_pending = thread_data->max_pending;
+    size_t pending_head = 0, n_pending = 0;
+    struct stats_hist* stages = thread_data->stats->stages;
+    struct shm_ring* shm = thread_data->shm;
+    const struct waveform* sent = NULL;
+    const struct waveform* waveform;
+    char name[64];
+    uint64_t t;
+    bool failed = false;
+
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp",
+             thread_data->samples_filename);
+
+    while(rx_queue_pop(queue, &buf)) {
+        // Estimates carry across gaps; the front end has not changed
+        if(thread_data->iq) {
+            t = stats_now();
+            iq_correct(thread_data->iq, buf->samples,
+                       queue->samples_per_buffer);
+            stats_hist_add(&stages[STATS_STAGE_IQ], stats_now() - t);
+        }
+
+        // Filter across every buffer in a run, so frames start with history
+        if(corr && decimator) {
+            if(buf->seq != expected) {
+                resampler_reset(decimator);
+            }
+            t = stats_now();
+            corr_samples = queue->samples_per_buffer /
+                           thread_data->cfg->rx_decimation;
+            samples = thread_data->decimated +
+                      (buf - queue->descs) * corr_samples * 2;
+            resampler_run(decimator, buf->samples, queue->samples_per_buffer,
+                          samples);
+            stats_hist_add(&stages[STATS_STAGE_RESAMPLE], stats_now() - t);
+        } else {
+            samples = buf->samples;
+            corr_samples = queue->samples_per_buffer;
+        }
+
+        // A gap in the sequence means stream_cb dropped buffers
+        if(buf->seq != expected && open) {
+            if(thread_data->save_samples) {
+                writer_close(&writer);
+                unlink(tmp_filename);
+            }
+            open = false;
+        }
+        expected = buf->seq + 1;
+
+        if(buf->seq % bpf == 0) {
+            frame = buf->seq / bpf;
+            open = !thread_data->save_samples ||
+                   !writer_open(&writer, tmp_filename, false,
+                                &thread_data->capture);
+            failed = false;
+            if(corr) {
+                corr_pool_reset(corr);
+            }
+            // The first frame after a change may still hold some of the old
+            // waveform, as the TX runs a few buffers ahead
+            waveform = waveform_active(thread_data->waveforms);
+            if(waveform != sent) {
+                if(corr && waveform->type == WAVEFORM_PRN) {
+                    corr_pool_set_spectrum(corr,
+                        goldcode_spectrum(thread_data->codes,
+                                          waveform->param));
+                }
+                waveform_describe(waveform, name, sizeof(name));
+                printf("%sTransmitting %s\n", thread_data->label, name);
+                fflush(stdout);
+                sent = waveform;
+            }
+            if(open && shm) {
+                shm_ring_begin(shm, frame);
+            }
+            if(!open) {
+                printf(KRED "%sFailed to save frame %lu: %s" KNRM "\n",
+                       thread_data->label, frame, strerror(errno));
+                fflush(stdout);
+            }
+        }
+
+        if(open && thread_data->save_samples) {
+            t = stats_now();
+            if(thread_data->capture.format == CAPTURE_FORMAT_SC16) {
+                sc16_sign_extend(buf->samples, queue->samples_per_buffer);
+            }
+            if(writer_write(&writer, (void**)&buf->samples, 1,
+                            queue->samples_per_buffer * 2 * sizeof(int16_t),
+                            (uint64_t)buf->seq * queue->samples_per_buffer)) {
+                failed = true;
+            }
+            stats_hist_add(&stages[STATS_STAGE_WRITE], stats_now() - t);
+        }
+
+        if(open && shm) {
+            t = stats_now();
+            publish_buffer(shm, buf, queue->samples_per_buffer, bpf);
+            stats_hist_add(&stages[STATS_STAGE_PUBLISH], stats_now() - t);
+        }
+
+        if(open && corr) {
+            pending[(pending_head + n_pending) % max_pending] = buf;
+            pending_jobs[(pending_head + n_pending) % max_pending] =
+                corr_pool_add(corr, samples, corr_samples);
+            n_pending++;
+        } else {
+            rx_queue_release(queue, buf);
+        }
+
+        if(open && buf->seq % bpf == bpf - 1) {
+            if(corr) {
+                t = stats_now();
+                corr_pool_result(corr, thread_data->profile);
+                failed |= save_profile(thread_data->profile, corr->n,
+                                       thread_data->profile_filename);
+                stats_hist_add(&stages[STATS_STAGE_CORRELATE],
+                               stats_now() - t);
+            }
+            if(thread_data->rdmap && thread_data->save_samples) {
+                t = stats_now();
+                failed |= save_rdmap(thread_data->cfg, thread_data->rdmap,
+                                     corr, frame,
+                                     thread_data->rdmap_filename);
+                stats_hist_add(&stages[STATS_STAGE_RDMAP], stats_now() - t);
+            } else if(thread_data->rdmap) {
+                t = stats_now();
+                rdmap_compute(thread_data->rdmap, corr->periods, corr->pool);
+                stats_hist_add(&stages[STATS_STAGE_RDMAP], stats_now() - t);
+            }
+            if(thread_data->cfar) {
+                t = stats_now();
+                failed |= save_detections(thread_data->detections,
+                                          thread_data->cfg, thread_data->cfar,
+                                          thread_data->profile,
+                                          thread_data->rdmap, frame);
+                stats_hist_add(&stages[STATS_STAGE_DETECT], stats_now() - t);
+            }
+            if(thread_data->acquisition) {
+                t = stats_now();
+                acquire(thread_data->acquisition, samples,
+                        thread_data->label);
+                stats_hist_add(&stages[STATS_STAGE_ACQUIRE],
+                               stats_now() - t);
+            }
+            if(shm) {
+                t = stats_now();
+                publish_frame(shm, thread_data->profile, thread_data->rdmap);
+                stats_hist_add(&stages[STATS_STAGE_PUBLISH], stats_now() - t);
+            }
+            if(thread_data->save_samples &&
+               (writer_close(&writer) || failed ||
+                rename(tmp_filename, thread_data->samples_filename))) {
+                failed = true;
+            }
+            if(failed) {
+                printf(KRED "%sFailed to save frame %lu: %s" KNRM "\n",
+                       thread_data->label, frame, strerror(errno));
+                unlink(tmp_filename);
+            } else {
+                printf("%sFrame %lu\n", thread_data->label, frame);
+                thread_data->frames_saved++;
+            }
+            fflush(stdout);
+            open = false;
+        }
+
+        // Hand back buffers, oldest first, once they have been correlated
+        while(n_pending && corr_job_done(pending_jobs[pending_head])) {
+            rx_queue_release(queue, pending[pending_head]);
+            pending_head = (pending_head + 1) % max_pending;
+            n_pending--;
+        }
+    }
+
+    if(corr) {
+        corr_pool_reset(corr);
+    }
+
+    if(open && thread_data->save_samples) {
+        writer_close(&writer);
+        unlink(tmp_filename);
+    }
 
-    save_rx_data(rx_stream_data);
+    // The stream has stopped, so its count is settled. Every whole frame
+    // it covered and that was not saved counts as dropped, including those
+    // whose first buffers never arrived.
+    frames = queue->seq / bpf;
+    if(queue->max_buffers && frames > queue->max_buffers / bpf) {
+        frames = queue->max_buffers / bpf;
+    }
+    thread_data->frames_dropped = frames > thread_data->frames_saved ?
+                                  frames - thread_data->frames_saved : 0;
+
+    return NULL;
+}
+
+
+/*
+ * Write-behind consumer for recordings. Takes filled buffers off the RX
+ * queue in batches, sign-extends or packs them and writes each batch with
+ * one call while the stream carries on, so memory use is bounded by the
+ * buffer pool rather than the recording length.
+ */
+void* record_thread(void* arg)
+{
+    struct record_thread_data* thread_data = arg;
+    struct rx_queue* queue = thread_data->queue;
+    struct rx_buffer* bufs[RECORD_BATCH];
+    void* samples[RECORD_BATCH];
+    unsigned long expected = 0;
+    size_t i, j, n;
+    uint64_t t;
+
+    while(rx_queue_pop(queue, &bufs[0])) {
+        n = 1;
+        while(n < RECORD_BATCH && rx_queue_try_pop(queue, &bufs[n])) {
+            n++;
+        }
+
+        t = stats_now();
+        for(i=0; i<n; i++) {
+            if(bufs[i]->seq != expected) {
+                thread_data->gaps++;
+            }
+            expected = bufs[i]->seq + 1;
+            if(thread_data->writer->header.format == CAPTURE_FORMAT_SC16) {
+                sc16_sign_extend(bufs[i]->samples, queue->samples_per_buffer);
+            }
+            samples[i] = bufs[i]->samples;
+        }
+
+        // One write per run of consecutive buffers, so gaps start frames
+        for(i=0; i<n && !thread_data->error; i=j) {
+            for(j=i+1; j<n && bufs[j]->seq == bufs[j-1]->seq + 1; j++);
+            if(writer_write(thread_data->writer, &samples[i], j - i,
+                            queue->samples_per_buffer * 2 * sizeof(int16_t),
+                            (uint64_t)bufs[i]->seq *
+                            queue->samples_per_buffer)) {
+                thread_data->error = errno;
+            } else {
+                thread_data->buffers_written += j - i;
+            }
+        }
+        stats_hist_add(&thread_data->stats->stages[STATS_STAGE_WRITE],
+                       stats_now() - t);
+
+        for(i=0; i<n; i++) {
+            rx_queue_release(queue, bufs[i]);
+        }
+    }
 
-    enable(dev, false);
-    printf("%-50s", "Deinitialising stream... ");
+    return NULL;
+}
+
+
+/*
+ * Device d's copy of a file or shared memory name: the name itself when
+ * there is only one device, else with "-d" before any extension, e.g.
+ * ./bladerf_samples-1.dat.
+ */
+void device_filename(char* out, size_t size, const char* name, int d,
+                     int n_devices)
+{
+    const char* base = strrchr(name, '/');
+    const char* dot;
+
+    base = base ? base + 1 : name;
+    dot = strrchr(base, '.');
+    if(n_devices == 1) {
+        snprintf(out, size, "%s", name);
+    } else if(dot && dot != base) {
+        snprintf(out, size, "%.*s-%d%s", (int)(dot - name), name, d, dot);
+    } else {
+        snprintf(out, size, "%s-%d", name, d);
+    }
+}
+
+
+/*
+ * Name device d's files after the shared ones and give its TX, RX and
+ * frame threads their places: three CPUs to a device, in the order -a
+ * lists them.
+ */
+void init_device(struct device* device, const char* spec, int d,
+                 int n_devices, const char* publish_name, int rt_priority,
+                 const int* cpus)
+{
+    device->spec = spec;
+    if(n_devices > 1) {
+        snprintf(device->label, sizeof(device->label), "Device %d: ", d);
+    }
+    device_filename(device->samples_filename,
+                    sizeof(device->samples_filename),
+                    output_samples_filename, d, n_devices);
+    device_filename(device->profile_filename,
+                    sizeof(device->profile_filename),
+                    output_profile_filename, d, n_devices);
+    device_filename(device->rdmap_filename, sizeof(device->rdmap_filename),
+                    output_rdmap_filename, d, n_devices);
+    device_filename(device->detections_filename,
+                    sizeof(device->detections_filename),
+                    output_detections_filename, d, n_devices);
+    device_filename(device->stats_filename, sizeof(device->stats_filename),
+                    output_stats_filename, d, n_devices);
+    if(publish_name) {
+        device_filename(device->shm_name, sizeof(device->shm_name),
+                        publish_name, d, n_devices);
+    }
+
+    // Stream threads above processing, so a callback is never kept waiting
+    device->tx_sched.priority = rt_priority;
+    device->tx_sched.cpu = cpus[3*d];
+    device->rx_sched.priority = rt_priority;
+    device->rx_sched.cpu = cpus[3*d + 1];
+    device->frame_sched.priority = rt_priority > 1 ? rt_priority - 1 :
+                                                     rt_priority;
+    device->frame_sched.cpu = cpus[3*d + 2];
+
+    stats_init(&device->stats);
+    device->stats.filename = device->stats_filename;
+}
+
+
+struct iq_corrector* create_iq_corrector(const struct bladerf_config* cfg)
+{
+    struct iq_corrector* iq;
+
+    printf("%-50s", "Creating IQ corrector... ");
     fflush(stdout);
-    bladerf_deinit_stream(rx_stream);
+    iq = iq_corrector_create(fmax(1, IQ_TIME_CONSTANT * cfg->rx_sr /
+                                     cfg->rx_samples_per_buffer));
+    if(!iq) {
+        printf(KRED "Failed: %s" KNRM "\n", strerror(ENOMEM));
+        return NULL;
+    }
+    printf(KGRN "%.0f buffers" KNRM "\n", 1 / iq->alpha);
+
+    return iq;
+}
+
+
+/*
+ * The device's own correlator, on the shared pool and code spectra, and
+ * the decimator, map, acquisition engine and detector that go with it as
+ * asked for. Returns 0 on success, or 1 leaving whatever was made for
+ * close_device.
+ */
+int create_processing(struct device* device, struct bladerf_config* cfg,
+                      struct pool* pool, struct goldcode_cache** codes,
+                      int prn, bool map,
+                      const struct acquisition* acquisition,
+                      const struct cfar_config* cfar_config)
+{
+    device->corr = create_correlator(cfg, pool, codes, prn);
+    device->profile = malloc(CODE_LEN_CORR(cfg) * sizeof(float));
+    if(device->corr && cfg->rx_decimation > 1) {
+        device->decimator = create_decimator(cfg, &device->decimated);
+    }
+    if(device->corr && map) {
+        device->rdmap = create_rdmap(cfg, device->corr);
+    }
+    device->acquisition = *acquisition;
+    if(device->corr && acquisition->n_prns) {
+        device->acquisition.acq = create_acquisition(cfg, pool);
+        device->acquisition.codes = *codes;
+    }
+    if(device->corr && cfar_config) {
+        device->cfar = create_detector(cfg, cfar_config, &device->detections,
+                                       device->detections_filename);
+    }
+
+    return !device->corr || !device->profile || (map && !device->rdmap) ||
+           (acquisition->n_prns && !device->acquisition.acq) ||
+           (cfar_config && !device->cfar) ||
+           (cfg->rx_decimation > 1 && !device->decimator);
+}
+
+
+/*
+ * Size and set up the device's TX and RX streams: a frame of RX buffers,
+ * twice that in continuous mode for slack between stream_cb and the frame
+ * thread, or RECORD_N_BUFFERS when recording.
+ */
+int setup_streams(struct device* device, const struct bladerf_config* cfg,
+                  const struct waveform* waveforms, int n_waveforms,
+                  bool continuous, bool record)
+{
+    struct bladerf_stream_data* tx_stream_data = &device->tx_stream_data;
+    struct bladerf_stream_data* rx_stream_data = &device->rx_stream_data;
+
+    atomic_init(&device->done, false);
+    tx_stream_data->num_buffers        = cfg->tx_n_buffers;
+    tx_stream_data->samples_per_buffer = cfg->tx_samples_per_buffer;
+    tx_stream_data->samples_left       = cfg->tx_n_samples;
+    tx_stream_data->samples_lost       = 0;
+    tx_stream_data->num_transfers      = cfg->tx_n_transfers;
+    tx_stream_data->continuous         = continuous;
+    tx_stream_data->done               = &device->done;
+    tx_stream_data->stats              = &device->stats.tx;
+
+    rx_stream_data->num_buffers        = RX_N_BUFFERS(cfg);
+    rx_stream_data->samples_per_buffer = cfg->rx_samples_per_buffer;
+    rx_stream_data->samples_left       = cfg->rx_n_samples;
+    rx_stream_data->samples_lost       = 0;
+    rx_stream_data->num_transfers      = cfg->rx_n_transfers;
+    rx_stream_data->continuous         = continuous;
+    rx_stream_data->done               = &device->done;
+    rx_stream_data->stats              = &device->stats.rx;
+    if(continuous) {
+        rx_stream_data->num_buffers    = 2 * RX_N_BUFFERS(cfg);
+    }
+    if(record) {
+        rx_stream_data->num_buffers    = RECORD_N_BUFFERS;
+    }
+
+    return setup_tx_stream(device->dev, &device->tx_stream, tx_stream_data,
+                           cfg, waveforms, n_waveforms,
+                           &device->tx_sched) ||
+           setup_rx_stream(device->dev, &device->rx_stream, rx_stream_data,
+                           &device->rx_sched);
+}
+
+
+/*
+ * Open the device's recording and start its record thread writing behind
+ * the stream, stopping after record_seconds unless that is 0.
+ */
+int start_recording(struct device* device, const struct bladerf_config* cfg,
+                    double record_seconds, bool direct)
+{
+    struct bladerf_stream_data* rx_stream_data = &device->rx_stream_data;
+    struct record_thread_data* thread_data = &device->record_thread_data;
+    int status;
+
+    printf("%-10s %-39s", "Recording", device->samples_filename);
+    fflush(stdout);
+    if(writer_open(&device->writer, device->samples_filename, direct,
+                   &device->capture)) {
+        status = errno;
+    } else if(rx_queue_init(&device->rx_queue, rx_stream_data->buffers,
+                            rx_stream_data->num_buffers,
+                            rx_stream_data->num_transfers,
+                            rx_stream_data->samples_per_buffer,
+                            (unsigned long)(record_seconds * cfg->rx_sr /
+                                cfg->rx_samples_per_buffer))) {
+        writer_close(&device->writer);
+        status = ENOMEM;
+    } else {
+        device->queued = true;
+        rx_stream_data->queue = &device->rx_queue;
+        thread_data->queue = &device->rx_queue;
+        thread_data->writer = &device->writer;
+        thread_data->stats = &device->stats;
+        device->stats.queue = &device->rx_queue;
+        thread_data->buffers_written = 0;
+        thread_data->gaps = 0;
+        thread_data->error = 0;
+        status = rt_thread_create(&device->frame_thread_pth,
+                                  &device->frame_sched, record_thread,
+                                  thread_data);
+        if(status) {
+            writer_close(&device->writer);
+        }
+    }
+    if(status) {
+        printf(KRED "Failed: %s" KNRM "\n", strerror(status));
+        return 1;
+    }
+    device->frame_running = true;
+    printf(KGRN "OK" KNRM "\n");
+
+    return 0;
+}
+
+
+/* Start the device's frame thread, stopping after max_frames unless 0 */
+int start_frames(struct device* device, const struct bladerf_config* cfg,
+                 unsigned long max_frames, bool save_samples,
+                 struct goldcode_cache* codes)
+{
+    struct bladerf_stream_data* rx_stream_data = &device->rx_stream_data;
+    struct frame_thread_data* thread_data = &device->frame_thread_data;
+    int status;
+
+    printf("%-50s", "Creating frame thread... ");
+    if(rx_queue_init(&device->rx_queue, rx_stream_data->buffers,
+                     rx_stream_data->num_buffers,
+                     rx_stream_data->num_transfers,
+                     rx_stream_data->samples_per_buffer,
+                     max_frames * RX_N_BUFFERS(cfg))) {
+        status = ENOMEM;
+    } else {
+        device->queued = true;
+        // Any of the queue's buffers may be waiting on the correlator
+        thread_data->max_pending = rx_stream_data->num_buffers;
+        thread_data->pending = calloc(rx_stream_data->num_buffers,
+                                      sizeof(struct rx_buffer*));
+        thread_data->pending_jobs = calloc(rx_stream_data->num_buffers,
+                                           sizeof(struct corr_job*));
+        rx_stream_data->queue = &device->rx_queue;
+        thread_data->cfg = cfg;
+        thread_data->label = device->label;
+        thread_data->samples_filename = device->samples_filename;
+        thread_data->profile_filename = device->profile_filename;
+        thread_data->rdmap_filename = device->rdmap_filename;
+        thread_data->capture = device->capture;
+        thread_data->queue = &device->rx_queue;
+        thread_data->buffers_per_frame = RX_N_BUFFERS(cfg);
+        thread_data->frames_saved = 0;
+        thread_data->frames_dropped = 0;
+        thread_data->corr = device->corr;
+        thread_data->profile = device->profile;
+        thread_data->rdmap = device->rdmap;
+        thread_data->acquisition =
+            device->acquisition.acq ? &device->acquisition : NULL;
+        thread_data->cfar = device->cfar;
+        thread_data->detections = device->detections;
+        thread_data->decimator = device->decimator;
+        thread_data->decimated = device->decimated;
+        thread_data->shm = device->shm;
+        thread_data->iq = device->iq;
+        thread_data->waveforms = device->tx_stream_data.waveforms;
+        thread_data->codes = codes;
+        thread_data->save_samples = save_samples;
+        thread_data->stats = &device->stats;
+        device->stats.queue = &device->rx_queue;
+        if(!thread_data->pending || !thread_data->pending_jobs) {
+            status = ENOMEM;
+        } else {
+            status = rt_thread_create(&device->frame_thread_pth,
+                                      &device->frame_sched, frame_thread,
+                                      thread_data);
+        }
+    }
+    if(status) {
+        printf(KRED "Failed: %s" KNRM "\n", strerror(status));
+        return 1;
+    }
+    device->frame_running = true;
+    printf(KGRN "OK" KNRM "\n");
+
+    return 0;
+}
+
+
+/* Start one of the device's streams on its own thread, at start */
+int start_stream(struct device* device, radio_module module, uint64_t start)
+{
+    bool tx = module == RADIO_MODULE_TX;
+    struct bladerf_thread_data* thread_data =
+        tx ? &device->tx_thread_data : &device->rx_thread_data;
+    int status;
+
+    thread_data->dev = device->dev;
+    thread_data->stream = tx ? device->tx_stream : device->rx_stream;
+    thread_data->stream_data =
+        tx ? &device->tx_stream_data : &device->rx_stream_data;
+    thread_data->start = start;
+    thread_data->rv = 1;
+
+    printf("%-50s", tx ? "Creating TX thread... " : "Creating RX thread... ");
+    status = rt_thread_create(tx ? &device->tx_thread_pth :
+                                   &device->rx_thread_pth,
+                              tx ? &device->tx_sched : &device->rx_sched,
+                              txrx_thread, thread_data);
+    if(status) {
+        printf(KRED "Failed: %s" KNRM "\n", strerror(status));
+        return 1;
+    }
+    if(tx) {
+        device->tx_running = true;
+    } else {
+        device->rx_running = true;
+    }
     printf(KGRN "OK" KNRM "\n");
-    printf("%-50s", "Closing device... ");
+
+    return 0;
+}
+
+
+/*
+ * Single-shot mode: save the device's capture, then correlate it and map,
+ * detect in and search it as asked for. Returns 1 if anything could not
+ * be saved.
+ */
+int process_capture(struct device* device, const struct bladerf_config* cfg,
+                    struct pool* pool, bool save_samples)
+{
+    struct bladerf_stream_data* rx_stream_data = &device->rx_stream_data;
+    struct corr_pool* corr = device->corr;
+    int16_t* decimated = device->decimated;
+    size_t corr_samples, i;
+    int status = 0;
+
+    // In capture order, as the stream hands them out
+    for(i=0; device->iq && i<rx_stream_data->num_buffers; i++) {
+        iq_correct(device->iq, rx_stream_data->buffers[i],
+                   rx_stream_data->samples_per_buffer);
+    }
+    if(save_samples) {
+        status = save_rx_data(rx_stream_data, &device->capture,
+                              device->samples_filename);
+    }
+
+    corr_samples = rx_stream_data->samples_per_buffer / cfg->rx_decimation;
+    if(corr) {
+        printf("%-10s %-39s", "Saving", device->profile_filename);
+        fflush(stdout);
+        for(i=0; i<rx_stream_data->num_buffers; i++) {
+            if(device->decimator) {
+                resampler_run(device->decimator, rx_stream_data->buffers[i],
+                              rx_stream_data->samples_per_buffer,
+                              decimated + i * corr_samples * 2);
+                corr_pool_add(corr, decimated + i * corr_samples * 2,
+                              corr_samples);
+            } else {
+                corr_pool_add(corr, rx_stream_data->buffers[i],
+                              corr_samples);
+            }
+        }
+        corr_pool_result(corr, device->profile);
+        if(save_profile(device->profile, corr->n,
+                        device->profile_filename)) {
+            printf(KRED "Failed: %s" KNRM "\n", strerror(errno));
+            status = 1;
+        } else {
+            printf(KGRN "OK" KNRM "\n");
+        }
+    }
+
+    if(device->rdmap && save_samples) {
+        printf("%-10s %-39s", "Saving", device->rdmap_filename);
+        fflush(stdout);
+        if(save_rdmap(cfg, device->rdmap, corr, 0, device->rdmap_filename)) {
+            printf(KRED "Failed: %s" KNRM "\n", strerror(errno));
+            status = 1;
+        } else {
+            printf(KGRN "OK" KNRM "\n");
+        }
+    } else if(device->rdmap) {
+        rdmap_compute(device->rdmap, corr->periods, pool);
+    }
+
+    if(device->cfar) {
+        printf("%-10s %-39s", "Saving", device->detections_filename);
+        fflush(stdout);
+        if(save_detections(device->detections, cfg, device->cfar,
+                           device->profile, device->rdmap, 0)) {
+            printf(KRED "Failed: %s" KNRM "\n", strerror(errno));
+            status = 1;
+        } else {
+            printf(KGRN "%zu detections" KNRM "\n",
+                   device->cfar->n_detections);
+        }
+    }
+
+    if(device->acquisition.acq && device->decimator) {
+        acquire(&device->acquisition,
+                decimated + (rx_stream_data->num_buffers - 1) *
+                            corr_samples * 2, device->label);
+    } else if(device->acquisition.acq) {
+        acquire(&device->acquisition,
+                rx_stream_data->buffers[rx_stream_data->num_buffers - 1],
+                device->label);
+    }
+
+    return status;
+}
+
+
+/*
+ * Stop whatever the device still has running and free everything it has,
+ * however far setting it up got. Streams still running are told to stop.
+ */
+void close_device(struct device* device)
+{
+    if(device->tx_running || device->rx_running) {
+        stop_streaming = 1;
+    }
+    if(device->rx_running) {
+        pthread_join(device->rx_thread_pth, NULL);
+    }
+    if(device->tx_running) {
+        pthread_join(device->tx_thread_pth, NULL);
+    }
+    if(device->frame_running) {
+        rx_queue_finish(&device->rx_queue);
+        pthread_join(device->frame_thread_pth, NULL);
+    }
+    device->tx_running = device->rx_running = device->frame_running = false;
+    stats_stop(&device->stats);
+
+    if(device->queued) {
+        rx_queue_free(&device->rx_queue);
+        device->queued = false;
+    }
+    free(device->frame_thread_data.pending);
+    free(device->frame_thread_data.pending_jobs);
+    device->frame_thread_data.pending = NULL;
+    device->frame_thread_data.pending_jobs = NULL;
+
+    if(device->enabled) {
+        enable(device->dev, false);
+        device->enabled = false;
+    }
+    if(device->rx_stream) radio_deinit_stream(device->rx_stream);
+    if(device->tx_stream) radio_deinit_stream(device->tx_stream);
+    if(device->dev) radio_close(device->dev);
+    device->rx_stream = NULL;
+    device->tx_stream = NULL;
+    device->dev = NULL;
+
+    if(device->detections) fclose(device->detections);
+    shm_ring_destroy(device->shm);
+    iq_corrector_destroy(device->iq);
+    resampler_destroy(device->decimator);
+    cfar_destroy(device->cfar);
+    acq_destroy(device->acquisition.acq);
+    rdmap_destroy(device->rdmap);
+    corr_pool_destroy(device->corr);
+    if(device->decimated) rt_free(device->decimated);
+    if(device->profile) free(device->profile);
+    waveform_lib_destroy(device->tx_stream_data.waveforms);
+    memset(device, 0, sizeof(*device));
+}
+
+
+/* close_device for each device, then the array itself */
+void close_devices(struct device* devices, int n_devices)
+{
+    int d;
+
+    for(d=0; d<MAX_DEVICES; d++) {
+        tx_waveforms[d] = NULL;
+    }
+    for(d=0; devices && d<n_devices; d++) {
+        close_device(&devices[d]);
+    }
+    free(devices);
+}
+
+
+void usage(const char* argv0)
+{
+    printf("Usage: %s [-d device] [-c [-n frames]] [-P prn] [-W list]\n"
+           "       [-p [-m] [-A prns] [-C ca|os] [-N] [-j workers]]\n"
+           "       [-R seconds [-D]] [-k] [-o file] [-s name=value]...\n"
+           "       [-S seconds] [-M name] [-F prio] [-a cpus] [-L] [-I]"
+           " [q]\n",
+           argv0);
+    printf("  -d device  Radio to use, \"bladerf[:identifier]\" or\n"
+           "             \"sim[:replay=FILE,delay=N,atten=DB,noise=RMS,"
+           "fast]\";\n"
+           "             repeat for up to %d, each with its own files\n",
+           MAX_DEVICES);
+    printf("  -c         Continuous: keep streaming, saving each frame of\n"
+           "             samples as it completes and printing \"Frame N\"\n");
+    printf("  -n frames  Stop continuous mode after this many frames of "
+           "stream time,\n"
+           "             saved or dropped\n");
+    printf("  -P prn     Gold code to transmit and correlate, 1 to %d, "
+           "default 1\n", GOLDCODE_N_PRNS);
+    printf("  -W list    Transmit these instead, comma separated: prn:N,\n"
+           "             chirp:BW (Hz) or pulse:WIDTH[:BUFFERS]; with -c,\n"
+           "             SIGUSR1 moves on to the next one\n");
+    printf("  -p         Process: correlate against the transmitted code and\n"
+           "             save the averaged profile to %s\n",
+           output_profile_filename);
+    printf("  -m         Also save a range-Doppler map of each frame to\n"
+           "             %s\n", output_rdmap_filename);
+    printf("  -A prns    Acquire: search each frame for these PRNs, comma\n"
+           "             separated or \"all\", over +-10kHz of Doppler\n");
+    printf("  -C ca|os   Detect: run a cell-averaging or ordered-statistic\n"
+           "             CFAR detector over each map, or else each profile,\n"
+           "             appending detections to %s\n",
+           output_detections_filename);
+    printf("  -N         Don't save samples or maps, only profiles and\n"
+           "             detections\n");
+    printf("  -j workers Worker threads for processing, default one per CPU\n");
+    printf("  -R seconds Record continuously to the samples file, written\n"
+           "             behind the stream; 0 records until interrupted\n");
+    printf("  -D         Write recordings with O_DIRECT\n");
+    printf("  -k         Pack saved samples to 12 bits, 3 bytes per I/Q "
+           "pair\n");
+    printf("  -o file    Samples file, default %s\n",
+           output_samples_filename);
+    printf("  -s setting Override a setting from %s, e.g.\n"
+           "             rx_freq=2400000000; see README.md for the names\n",
+           output_config_filename);
+    printf("  -S seconds Write streaming statistics to %s this often\n",
+           output_stats_filename);
+    printf("  -M name    With -c, publish each frame to shared memory for\n"
+           "             live viewers, e.g. %s\n", SHM_RING_NAME);
+    printf("  -F prio    Run the TX and RX threads under SCHED_FIFO at this\n"
+           "             priority, and the frame thread one below\n");
+    printf("  -a cpus    Pin the TX, RX and frame threads to these CPUs,\n"
+           "             comma separated, three per device in turn; the\n"
+           "             last one given is reused\n");
+    printf("  -L         Lock memory, with stream buffers in a pre-faulted\n"
+           "             huge page arena\n");
+    printf("  -I         Correct DC offset and IQ imbalance as samples "
+           "arrive\n");
+    printf("  q          Quick: skip configuration, reuse device settings\n");
+}
+
+
+void ignore_sigint(int sig)
+{
+    return;
+}
+
+
+void request_stop(int sig)
+{
+    stop_streaming = 1;
+}
+
+
+// Move each TX on to its next waveform at the end of the current period
+void next_waveform(int sig)
+{
+    struct waveform_lib* lib;
+    int d;
+
+    for(d=0; d<MAX_DEVICES; d++) {
+        lib = tx_waveforms[d];
+        if(lib) {
+            waveform_select(lib, (atomic_load(&lib->selected) + 1) %
+                                 lib->n_waveforms);
+        }
+    }
+}
+
+
+int main(int argc, char** argv) {
+    int status, quick, opt, continuous = 0, process = 0;
+    size_t i;
+    int d, record = 0, direct = 0, map = 0, n_workers = -1, prn = 1;
+    int detect = 0, save_samples = 1, packed = 0;
+    struct waveform waveforms[WAVEFORM_MAX];
+    int n_waveforms = 0;
+    int rt_priority = 0, lock_memory = 0, cpus[3 * MAX_DEVICES];
+    int correct_iq = 0;
+    double phase, gain;
+    uint64_t tx_window;
+    struct rt_sched worker_sched;
+    size_t rx_buffers;
+    int config_status, config_errno;
+    const char* config_error;
+    unsigned long max_frames = 0;
+    const char* publish_name = NULL;
+    uint64_t start;
+    double record_seconds = 0, stats_interval = 0;
+    const char* device_specs[MAX_DEVICES];
+    int n_devices = 0;
+    struct device* devices = NULL;
+    struct device* device;
+    struct bladerf_config* cfg;
+    struct pool* pool = NULL;
+    struct goldcode_cache* codes = NULL;
+    struct acquisition acquisition = { .acq = NULL };
+    struct cfar_config cfar_config = {
+        .type = CFAR_CA,
+        .guard = CFAR_GUARD,
+        .train = CFAR_TRAIN,
+        .pfa = CFAR_PFA,
+    };
+
+    cfg = malloc(sizeof(struct bladerf_config));
+    for(d=0; d<3 * MAX_DEVICES; d++) {
+        cpus[d] = -1;
+    }
+
+    config_defaults(cfg);
+
+    // The last run's settings, which -s can then override
+    config_status = config_read(cfg, output_config_filename);
+    config_errno = errno;
+
+    while((opt = getopt(argc, argv,
+                        "d:cn:P:W:pmA:C:Nj:R:Dko:s:S:M:F:a:LI")) != -1) {
+        switch(opt) {
+            case 'd':
+                if(n_devices < MAX_DEVICES) {
+                    device_specs[n_devices++] = optarg;
+                    break;
+                }
+                printf(KRED "At most %d devices" KNRM "\n", MAX_DEVICES);
+                if(cfg) free(cfg);
+                return 1;
+            case 'c':
+                continuous = 1;
+                break;
+            case 'n':
+                max_frames = strtoul(optarg, NULL, 0);
+                break;
+            case 'P':
+                prn = atoi(optarg);
+                break;
+            case 'W':
+                n_waveforms = waveform_parse(optarg, waveforms,
+                                             WAVEFORM_MAX);
+                if(n_waveforms) {
+                    break;
+                }
+                usage(argv[0]);
+                if(cfg) free(cfg);
+                return 1;
+            case 'p':
+                process = 1;
+                break;
+            case 'm':
+                process = 1;
+                map = 1;
+                break;
+            case 'C':
+                process = 1;
+                detect = 1;
+                if(strcmp(optarg, "os") == 0) {
+                    cfar_config.type = CFAR_OS;
+                } else if(strcmp(optarg, "ca") != 0) {
+                    printf(KRED "Not a detector: %s" KNRM "\n", optarg);
+                    if(cfg) free(cfg);
+                    return 1;
+                }
+                break;
+            case 'N':
+                save_samples = 0;
+                break;
+            case 'j':
+                n_workers = atoi(optarg);
+                break;
+            case 'R':
+                record = 1;
+                continuous = 1;
+                record_seconds = atof(optarg);
+                break;
+            case 'D':
+                direct = 1;
+                break;
+            case 'k':
+                packed = 1;
+                break;
+            case 'o':
+                output_samples_filename = optarg;
+                break;
+            case 'S':
+                stats_interval = atof(optarg);
+                break;
+            case 'M':
+                publish_name = optarg;
+                break;
+            case 'F':
+                rt_priority = atoi(optarg);
+                break;
+            case 'L':
+                lock_memory = 1;
+                break;
+            case 'I':
+                correct_iq = 1;
+                break;
+            case 'a':
+                if(parse_cpus(optarg, cpus, 3 * MAX_DEVICES)) {
+                    break;
+                }
+                usage(argv[0]);
+                if(cfg) free(cfg);
+                return 1;
+            case 's':
+                if(config_set(cfg, optarg)) {
+                    printf(KRED "Not a valid setting: %s" KNRM "\n", optarg);
+                    if(cfg) free(cfg);
+                    return 1;
+                }
+                break;
+            case 'A':
+                process = 1;
+                acquisition.n_prns = parse_prns(optarg, acquisition.prns);
+                if(acquisition.n_prns) {
+                    break;
+                }
+                // Not a valid list, so fall through to usage
+            default:
+                usage(argv[0]);
+                if(cfg) free(cfg);
+                return 1;
+        }
+    }
+
+    if(!n_devices) {
+        device_specs[n_devices++] = device_spec;
+    }
+
+    if(prn < 1 || prn > GOLDCODE_N_PRNS) {
+        printf(KRED "PRN must be between 1 and %d" KNRM "\n",
+               GOLDCODE_N_PRNS);
+        if(cfg) free(cfg);
+        return 1;
+    }
+
+    if(rt_priority < 0 || rt_priority > sched_get_priority_max(SCHED_FIFO)) {
+        printf(KRED "Priority must be between 1 and %d" KNRM "\n",
+               sched_get_priority_max(SCHED_FIFO));
+        if(cfg) free(cfg);
+        return 1;
+    }
+    worker_sched.priority = rt_priority > 1 ? rt_priority - 1 : rt_priority;
+    worker_sched.cpu = -1;
+
+    // Send -P's code unless -W lists waveforms, then correlate against the
+    // first of those if it is a code
+    if(!n_waveforms) {
+        waveforms[0].type = WAVEFORM_PRN;
+        waveforms[0].param = prn;
+        waveforms[0].n_blocks = 1;
+        n_waveforms = 1;
+    } else if(waveforms[0].type == WAVEFORM_PRN) {
+        prn = waveforms[0].param;
+    }
+
+    printf("%-50s", "Loading settings... ");
+    if(config_status == 0) {
+        printf(KGRN "OK" KNRM "\n");
+    } else if(config_status == 1 && config_errno == ENOENT) {
+        printf(KGRN "Using defaults" KNRM "\n");
+    } else if(config_status == 1) {
+        printf(KRED "Failed: %s" KNRM "\n", strerror(config_errno));
+    } else {
+        printf(KRED "Failed: malformed %s" KNRM "\n",
+               output_config_filename);
+    }
+
+    config_error = config_check(cfg);
+    if(config_error) {
+        printf(KRED "Invalid settings: %s" KNRM "\n", config_error);
+        if(cfg) free(cfg);
+        return 1;
+    }
+
+    if(optind < argc && argv[optind][0] == 'q') {
+        quick = 1;
+    } else {
+        quick = 0;
+    }
+
+    devices = calloc(n_devices, sizeof(struct device));
+    if(!devices) {
+        printf(KRED "%s" KNRM "\n", strerror(ENOMEM));
+        if(cfg) free(cfg);
+        return 1;
+    }
+    for(d=0; d<n_devices; d++) {
+        init_device(&devices[d], device_specs[d], d, n_devices,
+                    publish_name, rt_priority, cpus);
+    }
+
+    printf("%-50s", "Selecting sample conversion kernels... ");
+    printf(KGRN "%s" KNRM "\n", convert_init());
+
+    if(lock_memory) {
+        if(record) {
+            rx_buffers = RECORD_N_BUFFERS;
+        } else if(continuous) {
+            rx_buffers = 2 * RX_N_BUFFERS(cfg);
+        } else {
+            rx_buffers = RX_N_BUFFERS(cfg);
+        }
+        printf("%-50s", "Locking buffer memory... ");
+        fflush(stdout);
+        // The arena for the buffers, then everything else as it is touched
+        if(rt_arena_create(n_devices *
+                           arena_size(cfg, rx_buffers, n_waveforms,
+                                      process && cfg->rx_decimation > 1)) ||
+           mlockall(MCL_CURRENT | MCL_FUTURE)) {
+            printf(KRED "Failed: %s" KNRM "\n", strerror(errno));
+            close_devices(devices, n_devices);
+            rt_arena_destroy();
+            if(cfg) free(cfg);
+            return 1;
+        }
+        printf(KGRN "%zu MB, %s pages" KNRM "\n",
+               rt_arena()->size >> 20,
+               rt_arena()->huge ? "huge" : "transparent huge");
+    }
+
+    // One pool for every device, so the workers go wherever there is work
+    if(process) {
+        if(n_workers < 0) {
+            n_workers = sysconf(_SC_NPROCESSORS_ONLN);
+        }
+        printf("%-50s", "Starting worker threads... ");
+        fflush(stdout);
+        pool = pool_create(n_workers > 0 ? n_workers : 0);
+        // Workers share the frame thread's priority, but not its CPU
+        for(status=0, i=0; pool && !status && i<(size_t)pool->n_workers; i++) {
+            status = rt_thread_set(pool->workers[i].thread, &worker_sched);
+        }
+        if(pool && status) {
+            printf(KRED "Failed: %s" KNRM "\n", strerror(status));
+        } else if(pool) {
+            printf(KGRN "%d" KNRM "\n", pool->n_workers);
+        } else {
+            printf(KRED "Failed" KNRM "\n");
+        }
+        if(!pool || status) {
+            pool_destroy(pool);
+            close_devices(devices, n_devices);
+            rt_arena_destroy();
+            if(cfg) free(cfg);
+            return 1;
+        }
+    }
+
+    if(continuous) {
+        signal(SIGINT, request_stop);
+        signal(SIGTERM, request_stop);
+        signal(SIGUSR1, next_waveform);
+    } else {
+        signal(SIGINT, ignore_sigint);
+    }
+
+    if(!quick && write_config(cfg)) {
+        pool_destroy(pool);
+        close_devices(devices, n_devices);
+        rt_arena_destroy();
+        if(cfg) free(cfg);
+        return 1;
+    }
+
+    // Each device's processing and radio, one after the other
+    for(status=0, d=0; d<n_devices && !status; d++) {
+        device = &devices[d];
+        if(n_devices > 1) {
+            printf("%s%s\n", device->label, device->spec);
+        }
+
+        if(correct_iq) {
+            device->iq = create_iq_corrector(cfg);
+            status = !device->iq;
+        }
+        if(!status && process) {
+            status = create_processing(device, cfg, pool, &codes, prn, map,
+                                       &acquisition,
+                                       detect ? &cfar_config : NULL);
+        }
+        if(!status && publish_name && continuous && !record) {
+            device->shm = create_publisher(cfg, device->shm_name,
+                                           device->corr, device->rdmap);
+            status = !device->shm;
+        }
+
+        if(!status && !quick) {
+            status = configure_bladerf(&device->dev, cfg, device->spec);
+        } else if(!status) {
+            status = open_device(&device->dev, device->spec);
+        }
+        if(!status) {
+            status = setup_streams(device, cfg, waveforms, n_waveforms,
+                                   continuous, record);
+            tx_waveforms[d] = device->tx_stream_data.waveforms;
+        }
+        if(!status) {
+            device->enabled = true;
+            status = enable(device->dev, true);
+        }
+    }
+    if(status) {
+        close_devices(devices, n_devices);
+        goldcode_cache_destroy(codes);
+        pool_destroy(pool);
+        rt_arena_destroy();
+        if(cfg) free(cfg);
+        return 1;
+    }
+
+    // Then get each one going, consumer first
+    for(status=0, d=0; d<n_devices && !status; d++) {
+        device = &devices[d];
+        if(n_devices > 1) {
+            printf("%s%s\n", device->label, device->spec);
+        }
+
+        status = schedule_start(device->dev, cfg, &start,
+                                &device->start_time);
+        if(status) {
+            break;
+        }
+        capture_header_init(&device->capture, cfg, prn, device->start_time,
+                            cfg->rx_n_samples,
+                            packed ? CAPTURE_FORMAT_SC12 :
+                                     CAPTURE_FORMAT_SC16);
+
+        if(record) {
+            status = start_recording(device, cfg, record_seconds, direct);
+        } else if(continuous) {
+            status = start_frames(device, cfg, max_frames, save_samples,
+                                  codes);
+        }
+        if(status) {
+            break;
+        }
+
+        device->stats.tx_sr = cfg->tx_sr;
+        device->stats.rx_sr = cfg->rx_sr;
+        device->stats.tx_samples_per_buffer = cfg->tx_samples_per_buffer;
+        device->stats.rx_samples_per_buffer = cfg->rx_samples_per_buffer;
+        device->stats.tx_transfers = cfg->tx_n_transfers;
+        device->stats.rx_transfers = cfg->rx_n_transfers;
+        if(stats_interval > 0) {
+            printf("%-10s %-39s", "Stats", device->stats_filename);
+            device->stats.interval = stats_interval;
+            status = stats_start(&device->stats);
+            if(status) {
+                printf(KRED "Failed: %s" KNRM "\n", strerror(status));
+            } else {
+                printf(KGRN "OK" KNRM "\n");
+            }
+        }
+
+        status = start_stream(device, RADIO_MODULE_TX, start) ||
+                 start_stream(device, RADIO_MODULE_RX, start);
+    }
+    if(status) {
+        close_devices(devices, n_devices);
+        goldcode_cache_destroy(codes);
+        pool_destroy(pool);
+        rt_arena_destroy();
+        if(cfg) free(cfg);
+        return 1;
+    }
+
+    printf("%-50s", "Waiting for completion... ");
     fflush(stdout);
-    bladerf_close(dev);
+    for(d=0; d<n_devices; d++) {
+        device = &devices[d];
+        pthread_join(device->rx_thread_pth, NULL);
+        pthread_join(device->tx_thread_pth, NULL);
+        device->rx_running = device->tx_running = false;
+        if(continuous) {
+            rx_queue_finish(&device->rx_queue);
+            pthread_join(device->frame_thread_pth, NULL);
+            device->frame_running = false;
+        }
+        stats_stop(&device->stats);
+    }
     printf(KGRN "OK" KNRM "\n");
 
+    for(status=0, d=0; d<n_devices; d++) {
+        device = &devices[d];
+        if(n_devices > 1) {
+            printf("%s%s\n", device->label, device->spec);
+        }
+
+        if(record) {
+            if(writer_close(&device->writer) ||
+               device->record_thread_data.error) {
+                printf(KRED "Failed to write recording: %s" KNRM "\n",
+                       strerror(device->record_thread_data.error ?
+                                device->record_thread_data.error : errno));
+            }
+            printf("%-30s %'15lu\n", "Samples recorded:",
+                   device->record_thread_data.buffers_written *
+                   cfg->rx_samples_per_buffer);
+            printf("%-30s %15lu\n", "Gaps in recording:",
+                   device->record_thread_data.gaps);
+            printf("%-30s %15lu\n", "Buffers dropped:",
+                   device->rx_queue.buffers_dropped);
+        } else if(continuous) {
+            printf("%-30s %15lu\n", "Frames saved:",
+                   device->frame_thread_data.frames_saved);
+            printf("%-30s %15lu\n", "Frames dropped:",
+                   device->frame_thread_data.frames_dropped);
+            printf("%-30s %15lu\n", "Buffers dropped:",
+                   device->rx_queue.buffers_dropped);
+        }
+
+        printf("%-50s", "All done, checking TX results... ");
+        fflush(stdout);
+        if(device->tx_thread_data.rv < 0) {
+            printf(KRED "Failed: %s" KNRM "\n",
+                   radio_strerror(device->dev->backend,
+                                  device->tx_thread_data.rv));
+            status = 1;
+        } else {
+            printf(KGRN "OK" KNRM "\n");
+        }
+        // How closely the TX start was tied to RX time, where it had to be
+        if(!radio_get_tx_window(device->dev, &tx_window) && tx_window) {
+            printf("%-30s %15" PRIu64 "\n", "TX start window (samples):",
+                   tx_window);
+        }
+
+        printf("%-50s", "          checking RX results... ");
+        fflush(stdout);
+        if(device->rx_thread_data.rv < 0) {
+            printf(KRED "Failed: %s" KNRM "\n",
+                   radio_strerror(device->dev->backend,
+                                  device->rx_thread_data.rv));
+            status = 1;
+        } else if(device->rx_stream_data.samples_lost) {
+            // A single-shot capture with a hole in it is no use
+            printf(KRED "Failed: %lu samples lost" KNRM "\n",
+                   device->rx_stream_data.samples_lost);
+            status = 1;
+        } else {
+            printf(KGRN "OK" KNRM "\n");
+        }
+    }
+    if(status) {
+        close_devices(devices, n_devices);
+        goldcode_cache_destroy(codes);
+        pool_destroy(pool);
+        rt_arena_destroy();
+        if(cfg) free(cfg);
+        return 1;
+    }
+
+    printf(KGRN "Success!" KNRM "\n");
+
+    for(d=0; d<n_devices; d++) {
+        device = &devices[d];
+        if(n_devices > 1) {
+            printf("%s%s\n", device->label, device->spec);
+        }
+
+        if(!continuous) {
+            status |= process_capture(device, cfg, pool, save_samples);
+        }
+
+        if(device->iq) {
+            iq_corrector_imbalance(device->iq, &phase, &gain);
+            printf("%-30s %7.1f %7.1f\n", "DC offset (I, Q):",
+                   device->iq->dc_i, device->iq->dc_q);
+            printf("%-30s %15.2f\n", "IQ phase correction (deg):", phase);
+            printf("%-30s %15.2f\n", "IQ gain correction (dB):", gain);
+            printf("%-30s %15lu\n", "Buffers not circular:",
+                   device->iq->buffers - device->iq->circular);
+        }
+
+        enable(device->dev, false);
+        device->enabled = false;
+        printf("%-50s", "Deinitialising stream... ");
+        fflush(stdout);
+        radio_deinit_stream(device->rx_stream);
+        radio_deinit_stream(device->tx_stream);
+        device->rx_stream = NULL;
+        device->tx_stream = NULL;
+        printf(KGRN "OK" KNRM "\n");
+        printf("%-50s", "Closing device... ");
+        fflush(stdout);
+        radio_close(device->dev);
+        device->dev = NULL;
+        printf(KGRN "OK" KNRM "\n");
+    }
+
     printf("%-50s", "Freeing memory... ");
     fflush(stdout);
+    close_devices(devices, n_devices);
+    goldcode_cache_destroy(codes);
+    pool_destroy(pool);
+    rt_arena_destroy();
     if(cfg) free(cfg);
-    if(tx_stream_data) free(tx_stream_data);
-    if(rx_stream_data) free(rx_stream_data);
-    if(tx_thread_data) free(tx_thread_data);
-    if(rx_thread_data) free(rx_thread_data);
     printf(KGRN "OK" KNRM "\n");
-    return 0;
+    return status;
 }
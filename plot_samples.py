@@ -1,24 +1,19 @@
-import json
 import numpy as np
 import matplotlib
 matplotlib.use('QT4Agg')
 import matplotlib.pyplot as plt
 from matplotlib.ticker import EngFormatter
+from capture import Capture
 
-with open("bladerf_config.json") as f:
-    cfg = json.loads(f.read())
-
-centre_freq = float(cfg['rx_freq'])
-sample_rate = float(cfg['rx_sr'])
+capture = Capture("bladerf_samples.dat")
+centre_freq = float(capture.header['rx_freq'])
+sample_rate = float(capture.header['rx_sr'])
 
 
 def db(pwr):
     return 10*np.log10(pwr)
 
-with open("bladerf_samples.dat", "rb") as f:
-    data = np.fromfile(f, np.int16, -1).reshape((-1, 2)).astype(np.float)
-
-samples = (data[:, 0] + 1j * data[:, 1]) / 2048.0
+samples = capture.samples()
 
 samples -= np.mean(samples)
 
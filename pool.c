@@ -0,0 +1,242 @@
+#include <stdlib.h>
+#include "pool.h"
+
+
+static bool deque_push(struct pool_deque* deque, const struct pool_task* task)
+{
+    bool pushed = false;
+
+    pthread_mutex_lock(&deque->lock);
+    if(deque->tail - deque->head < POOL_QUEUE_LEN) {
+        deque->tasks[deque->tail % POOL_QUEUE_LEN] = *task;
+        deque->tail++;
+        pushed = true;
+    }
+    pthread_mutex_unlock(&deque->lock);
+
+    return pushed;
+}
+
+
+/* The owner takes the oldest task, thieves the newest */
+static bool deque_take(struct pool_deque* deque, struct pool_task* task,
+                       bool steal)
+{
+    bool taken = false;
+
+    pthread_mutex_lock(&deque->lock);
+    if(deque->tail != deque->head) {
+        if(steal) {
+            deque->tail--;
+            *task = deque->tasks[deque->tail % POOL_QUEUE_LEN];
+        } else {
+            *task = deque->tasks[deque->head % POOL_QUEUE_LEN];
+            deque->head++;
+        }
+        taken = true;
+    }
+    pthread_mutex_unlock(&deque->lock);
+
+    return taken;
+}
+
+
+static bool pool_find_task(struct pool* pool, int slot, struct pool_task* task)
+{
+    int i, victim;
+
+    if(deque_take(&pool->deques[slot], task, false))
+        return true;
+
+    for(i=1; i<pool->n_workers; i++) {
+        victim = (slot + i) % pool->n_workers;
+        if(deque_take(&pool->deques[victim], task, true))
+            return true;
+    }
+
+    return false;
+}
+
+
+static void pool_task_done(struct pool* pool, struct pool_group* group)
+{
+    bool idle = false;
+
+    if(group && atomic_fetch_sub(&group->outstanding, 1) == 1)
+        idle = true;
+    if(atomic_fetch_sub(&pool->outstanding, 1) == 1)
+        idle = true;
+
+    if(idle) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->idle);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+
+static void* pool_worker_thread(void* arg)
+{
+    struct pool_worker* worker = arg;
+    struct pool* pool = worker->pool;
+    struct pool_task task;
+
+    for(;;) {
+        if(pool_find_task(pool, worker->slot, &task)) {
+            atomic_fetch_sub(&pool->queued, 1);
+            task.fn(task.arg, worker->slot);
+            pool_task_done(pool, task.group);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        while(!atomic_load(&pool->queued) && !pool->shutdown)
+            pthread_cond_wait(&pool->work, &pool->lock);
+        if(pool->shutdown && !atomic_load(&pool->queued)) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return NULL;
+}
+
+
+struct pool* pool_create(int n_workers)
+{
+    struct pool* pool;
+    int i;
+
+    pool = calloc(1, sizeof(struct pool));
+    if(!pool)
+        return NULL;
+
+    pool->deques = aligned_alloc(POOL_CACHE_LINE,
+                                 (n_workers + 1) * sizeof(struct pool_deque));
+    pool->workers = calloc(n_workers + 1, sizeof(struct pool_worker));
+    if(!pool->deques || !pool->workers) {
+        free(pool->deques);
+        free(pool->workers);
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->outstanding, 0);
+    atomic_init(&pool->next, 0);
+
+    for(i=0; i<n_workers; i++) {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+        pool->deques[i].head = 0;
+        pool->deques[i].tail = 0;
+    }
+
+    for(i=0; i<n_workers; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].slot = i;
+        if(pthread_create(&pool->workers[i].thread, NULL,
+                          pool_worker_thread, &pool->workers[i]))
+            break;
+        pool->n_workers = i + 1;
+    }
+
+    if(pool->n_workers != n_workers) {
+        pool_destroy(pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+
+void pool_destroy(struct pool* pool)
+{
+    int i;
+
+    if(!pool)
+        return;
+
+    pool_wait(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for(i=0; i<pool->n_workers; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+        pthread_mutex_destroy(&pool->deques[i].lock);
+    }
+
+    pthread_cond_destroy(&pool->idle);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool->deques);
+    free(pool);
+}
+
+
+void pool_submit(struct pool* pool, pool_fn fn, void* arg)
+{
+    pool_submit_group(pool, NULL, fn, arg);
+}
+
+
+void pool_submit_group(struct pool* pool, struct pool_group* group,
+                       pool_fn fn, void* arg)
+{
+    struct pool_task task = { fn, arg, group };
+    unsigned int next = atomic_load(&pool->next);
+    int i, target;
+
+    for(i=0; i<pool->n_workers; i++) {
+        target = (next + i) % pool->n_workers;
+        if(group)
+            atomic_fetch_add(&group->outstanding, 1);
+        atomic_fetch_add(&pool->outstanding, 1);
+        atomic_fetch_add(&pool->queued, 1);
+        if(deque_push(&pool->deques[target], &task)) {
+            // Only a hint, so other submitters may overwrite it
+            atomic_store(&pool->next, target + 1);
+            pthread_mutex_lock(&pool->lock);
+            pthread_cond_signal(&pool->work);
+            pthread_mutex_unlock(&pool->lock);
+            return;
+        }
+        atomic_fetch_sub(&pool->queued, 1);
+        atomic_fetch_sub(&pool->outstanding, 1);
+        if(group)
+            atomic_fetch_sub(&group->outstanding, 1);
+    }
+
+    fn(arg, pool->n_workers);
+}
+
+
+void pool_wait(struct pool* pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    while(atomic_load(&pool->outstanding))
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+
+void pool_group_init(struct pool_group* group)
+{
+    atomic_init(&group->outstanding, 0);
+}
+
+
+void pool_wait_group(struct pool* pool, struct pool_group* group)
+{
+    pthread_mutex_lock(&pool->lock);
+    while(atomic_load(&group->outstanding))
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,94 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+/*
+ * Work-stealing thread pool.
+ *
+ * Each worker has its own deque of tasks. Submitted tasks are spread over
+ * the deques round robin; a worker runs its own tasks oldest first and,
+ * once its deque is empty, steals the newest task from another worker's
+ * deque, so a worker held up by one slow task does not hold up the rest.
+ *
+ * Tasks are given a slot number below pool_slots() for indexing per-worker
+ * state. Slot n_workers is the submitting thread's: it runs tasks itself
+ * when every deque is full or the pool has no workers.
+ *
+ * Several threads may submit to one pool, each waiting on a pool_group of
+ * its own tasks rather than on the whole pool. They share slot n_workers,
+ * so state indexed by slot must belong to one submitting thread; a
+ * correlator, map or acquisition engine each do.
+ */
+
+#define POOL_QUEUE_LEN   256            // Per worker, a power of two
+#define POOL_CACHE_LINE  64
+
+typedef void (*pool_fn)(void* arg, int slot);
+
+struct pool_group {
+    atomic_size_t outstanding;          // Submitted and not yet finished
+};
+
+struct pool_task {
+    pool_fn            fn;
+    void*              arg;
+    struct pool_group* group;           // Or NULL
+};
+
+struct pool_deque {
+    alignas(POOL_CACHE_LINE) pthread_mutex_t lock;
+    size_t head;                        // Owner takes from here
+    size_t tail;                        // New tasks go here, thieves take
+    struct pool_task tasks[POOL_QUEUE_LEN];
+};
+
+struct pool_worker {
+    struct pool* pool;
+    int          slot;
+    pthread_t    thread;
+};
+
+struct pool {
+    int                 n_workers;
+    struct pool_deque*  deques;
+    struct pool_worker* workers;
+    atomic_uint         next;           // Round robin submit position
+
+    atomic_size_t       queued;         // Tasks sitting in deques
+    atomic_size_t       outstanding;    // Submitted and not yet finished
+
+    pthread_mutex_t     lock;
+    pthread_cond_t      work;           // Signalled when tasks are queued
+    pthread_cond_t      idle;           // Signalled when a count reaches 0
+    bool                shutdown;
+};
+
+/* n_workers may be 0, in which case every task runs on submit */
+struct pool* pool_create(int n_workers);
+void pool_destroy(struct pool* pool);
+
+static inline int pool_slots(const struct pool* pool)
+{
+    return pool->n_workers + 1;
+}
+
+void pool_submit(struct pool* pool, pool_fn fn, void* arg);
+
+/* Wait until every submitted task has finished */
+void pool_wait(struct pool* pool);
+
+void pool_group_init(struct pool_group* group);
+
+/* Submit a task counted in group, which must outlive it */
+void pool_submit_group(struct pool* pool, struct pool_group* group,
+                       pool_fn fn, void* arg);
+
+/* Wait until every task submitted in group has finished */
+void pool_wait_group(struct pool* pool, struct pool_group* group);
+
+#endif
@@ -1,55 +1,53 @@
 import json
 import numpy as np
 import matplotlib.pyplot as plt
-import goldcode
 import subprocess
+from shmring import ShmRing
 
 
-origcode = goldcode.generateCACode(1)
-code = np.zeros(2048, np.int16)
-for idx, bit in enumerate(origcode):
-    code[1 + idx*2] = bit
-    code[1 + idx*2+1] = bit
-code_conj_spec = np.conjugate(np.fft.fft(code))
+# Keep one radar process streaming; with -p it correlates each frame and
+# publishes the averaged profile to shared memory, printing "Frame N" as it
+# does. -N saves no samples, so the disk stays out of the loop.
+radar = subprocess.Popen(["./radar", "-c", "-p", "-N", "-M", "/radar"],
+                         stdout=subprocess.PIPE)
 
 
+def frames():
+    for line in iter(radar.stdout.readline, ''):
+        if line.startswith("Frame "):
+            yield
+
+frame_iter = frames()
+next(frame_iter)
+ring = ShmRing("radar")
+
 with open("bladerf_config.json") as f:
     cfg = json.loads(f.read())
 
 centre_freq = float(cfg['rx_freq'])
 sample_rate = float(cfg['rx_sr'])
+samples_per_chip = (cfg['rx_sr'] // cfg['tx_sr'] *
+                    (cfg['tx_samples_per_buffer'] // 1023) //
+                    cfg.get('rx_decimation', 1))
 
+# TX and RX start on the same hardware timestamp, so the direct path stays
+# put from frame to frame. How well the TX start is tied to RX time on a
+# bladeRF varies from run to run, so the first frame's strongest bin, the
+# direct path, is moved to bin LEAD and every frame shifted the same way.
+RANGE_BINS = 200
+LEAD = 20
 
-def get_corrs():
-    with open("bladerf_samples.dat", "rb") as f:
-        data = np.fromfile(f, np.int16, -1).reshape((-1, 2)).astype(np.float)
-
-    samples = (data[:, 0] + 1j * data[:, 1]) / 2048.0
-    samples -= np.mean(samples)
-
-    chunks = samples.size // 2048
-    corrs = np.zeros((chunks, 2048))
-    for idx in range(chunks):
-        subsamps = samples[idx*2048:(idx+1)*2048]
-        samp_spec = np.fft.fft(subsamps)
-        corr_spec = samp_spec * code_conj_spec
-        corrs[idx] = np.abs(np.fft.ifft(corr_spec)) ** 2
 
-    avgcorr = np.zeros(2048)
-
-    for corr in corrs:
-        #plt.plot(corr, '.-')
-        avgcorr += corr
-
-    avgcorr /= chunks
-
-    peakidx = np.argmax(avgcorr)
-    avgcorr = np.roll(avgcorr, -(peakidx - 20))
-    avgcorr = avgcorr[:50]
-    return avgcorr
+def get_corrs():
+    while True:
+        frame = ring.latest()
+        corrs = frame.profile.copy()
+        if frame.valid():
+            return corrs
 
-subprocess.check_call(["./radar"])
 corrs = get_corrs()
+shift = int(np.argmax(corrs)) - LEAD
+corrs = np.roll(corrs, -shift)[:RANGE_BINS]
 chart, = plt.plot(corrs, '.-')
 plt.xlabel("Code Shift (PRN bits)")
 plt.ylabel("Correlation Score")
@@ -58,12 +56,11 @@ plt.grid()
 plt.ylim((0, 150000))
 plt.yticks([])
 locs, labels = plt.xticks()
-plt.xticks(locs, [(float(x)-20.0)/2.0 for x in locs])
+plt.xticks(locs, [(float(x) - LEAD) / samples_per_chip for x in locs])
 plt.show(block=False)
 plt.savefig("radar.png", dpi=300)
 
-while True:
-    subprocess.check_call(["./radar", "q"])
-    corrs = get_corrs()
+for _ in frame_iter:
+    corrs = np.roll(get_corrs(), -shift)[:RANGE_BINS]
     chart.set_ydata(corrs)
     plt.draw()
@@ -1,21 +1,42 @@
-import json
 import numpy as np
 import subprocess
 import matplotlib.pyplot as plt
 from matplotlib.ticker import EngFormatter
+from shmring import ShmRing
 
-subprocess.check_call(["./radar"])
+# Keep one radar process streaming; it prints "Frame N" whenever a new frame
+# has been published to shared memory, and saves nothing with -N. TX and RX
+# start on the same hardware timestamp, so echoes stay at the same offset in
+# every frame, though not necessarily the same one every run.
+radar = subprocess.Popen(["./radar", "-c", "-N", "-M", "/radar"],
+                         stdout=subprocess.PIPE)
 
-with open("bladerf_config.json") as f:
-    cfg = json.loads(f.read())
 
-centre_freq = float(cfg['rx_freq'])
-sample_rate = float(cfg['rx_sr'])
+def frames():
+    for line in iter(radar.stdout.readline, ''):
+        if line.startswith("Frame "):
+            yield
 
-with open("bladerf_samples.dat", "rb") as f:
-    data = np.fromfile(f, np.int16, -1).reshape((-1, 2)).astype(np.float)
 
-samples = (data[:, 0] + 1j * data[:, 1]) / 2048.0
+def latest_samples():
+    """Complex samples of the newest frame, scaled to +-1"""
+    while True:
+        frame = ring.latest()
+        iq = frame.samples.astype(np.float64)
+        if frame.valid():
+            return (iq[:, 0] + 1j * iq[:, 1]) / 2048.0
+
+frame_iter = frames()
+next(frame_iter)
+
+# The first frame's peak, the direct path, is put LEAD samples into the trace
+# and every frame after it shifted the same way
+LEAD = 20
+
+ring = ShmRing("radar")
+sample_rate = float(ring.rx_sr)
+
+samples = latest_samples()
 
 samples -= np.mean(samples)
 
@@ -25,9 +46,8 @@ for i in range(chunks):
     avgd += samples[i*256:(i+1)*256]
 avgd /= float(chunks)
 avgd = np.abs(avgd) / np.sqrt(2)
-first_peak = np.argmax(avgd)
-avgd = np.roll(avgd, -(first_peak - 20))
-avgd = avgd[:100]
+shift = int(np.argmax(avgd)) - LEAD
+avgd = np.roll(avgd, -shift)[:100]
 
 times = np.linspace(0, avgd.size / sample_rate, avgd.size)
 
@@ -42,12 +62,8 @@ plt.grid()
 
 plt.show(block=False)
 
-while True:
-    subprocess.check_call(["./radar", "q"])
-    with open("bladerf_samples.dat", "rb") as f:
-        data = np.fromfile(f, np.int16, -1).reshape((-1, 2)).astype(np.float)
-
-    samples = (data[:, 0] + 1j * data[:, 1]) / 2048.0
+for _ in frame_iter:
+    samples = latest_samples()
     samples -= np.mean(samples)
     avgd = np.zeros(256, np.complex128)
     chunks = samples.size // 256
@@ -55,8 +71,6 @@ while True:
         avgd += samples[i*256:(i+1)*256]
     avgd /= float(chunks)
     avgd = np.abs(avgd) / np.sqrt(2)
-    first_peak = np.argmax(avgd)
-    avgd = np.roll(avgd, -(first_peak - 20))
-    avgd = avgd[:100]
+    avgd = np.roll(avgd, -shift)[:100]
     chart.set_ydata(avgd)
     plt.draw()
@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "rdmap.h"
+
+
+struct rdmap* rdmap_create(size_t n_range, size_t n_doppler,
+                           const struct pool* pool)
+{
+    struct rdmap* rd;
+    size_t i;
+    int slot;
+
+    rd = calloc(1, sizeof(struct rdmap));
+    if(!rd)
+        return NULL;
+
+    rd->n_range = n_range;
+    rd->n_doppler = n_doppler;
+    rd->plan = fft_plan_create(n_doppler);
+    rd->slow = fft_alloc(n_range * n_doppler * sizeof(cf32));
+    rd->map = fft_alloc(n_range * n_doppler * sizeof(float));
+    rd->window = fft_alloc(n_doppler * sizeof(float));
+    rd->n_work = pool_slots(pool);
+    pool_group_init(&rd->tasks);
+    rd->work = calloc(rd->n_work, sizeof(cf32*));
+    rd->n_jobs = (n_range + RDMAP_BLOCK - 1) / RDMAP_BLOCK;
+    rd->jobs = calloc(rd->n_jobs, sizeof(struct rdmap_job));
+    if(!rd->plan || !rd->slow || !rd->map || !rd->window || !rd->work ||
+       !rd->jobs) {
+        rdmap_destroy(rd);
+        return NULL;
+    }
+
+    for(slot=0; slot<rd->n_work; slot++) {
+        rd->work[slot] = fft_alloc(n_doppler * sizeof(cf32));
+        if(!rd->work[slot]) {
+            rdmap_destroy(rd);
+            return NULL;
+        }
+    }
+
+    for(i=0; i<rd->n_jobs; i++) {
+        rd->jobs[i].rd = rd;
+        rd->jobs[i].first = i * RDMAP_BLOCK;
+        rd->jobs[i].last = (i + 1) * RDMAP_BLOCK < n_range ?
+                           (i + 1) * RDMAP_BLOCK : n_range;
+    }
+
+    return rd;
+}
+
+
+void rdmap_destroy(struct rdmap* rd)
+{
+    int slot;
+
+    if(!rd)
+        return;
+    if(rd->work) {
+        for(slot=0; slot<rd->n_work; slot++)
+            free(rd->work[slot]);
+    }
+    fft_plan_destroy(rd->plan);
+    free(rd->slow);
+    free(rd->map);
+    free(rd->window);
+    free(rd->work);
+    free(rd->jobs);
+    free(rd);
+}
+
+
+void rdmap_add_profile(struct rdmap* rd, unsigned long period,
+                       const cf32* profile)
+{
+    if(period >= rd->n_doppler)
+        return;
+
+    memcpy(rd->slow + period * rd->n_range, profile,
+           rd->n_range * sizeof(cf32));
+}
+
+
+static void rdmap_columns(void* arg, int slot)
+{
+    struct rdmap_job* job = arg;
+    struct rdmap* rd = job->rd;
+    size_t r, k, n = rd->n_doppler, half = n / 2, periods = rd->periods;
+    cf32* x = rd->work[slot];
+    const cf32* in;
+    float* out;
+
+    for(r=job->first; r<job->last; r++) {
+        in = rd->slow + r;
+        for(k=0; k<periods; k++) {
+            x[k].re = in[k * rd->n_range].re * rd->window[k];
+            x[k].im = in[k * rd->n_range].im * rd->window[k];
+        }
+        memset(x + periods, 0, (n - periods) * sizeof(cf32));
+
+        fft_forward(rd->plan, x);
+
+        // fftshift so zero Doppler sits in the middle of the row
+        out = rd->map + r*n;
+        for(k=0; k<n; k++)
+            out[(k + half) % n] = x[k].re * x[k].re + x[k].im * x[k].im;
+    }
+}
+
+
+void rdmap_compute(struct rdmap* rd, size_t n_periods, struct pool* pool)
+{
+    size_t i;
+
+    if(n_periods > rd->n_doppler)
+        n_periods = rd->n_doppler;
+
+    if(rd->periods != n_periods) {
+        for(i=0; i<n_periods; i++) {
+            rd->window[i] = n_periods > 1 ?
+                0.5f - 0.5f * cosf(2*M_PI*i/(n_periods - 1)) : 1.0f;
+        }
+        rd->periods = n_periods;
+    }
+
+    for(i=0; i<rd->n_jobs; i++)
+        pool_submit_group(pool, &rd->tasks, rdmap_columns, &rd->jobs[i]);
+    pool_wait_group(pool, &rd->tasks);
+}
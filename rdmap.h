@@ -0,0 +1,74 @@
+#ifndef RDMAP_H
+#define RDMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "fft.h"
+#include "pool.h"
+
+/*
+ * Range-Doppler map.
+ *
+ * Complex correlation profiles from consecutive code periods are stacked
+ * into a slow-time matrix, one row per period so that profiles arriving
+ * from different workers never share a cache line. A Hann-windowed FFT down
+ * each range bin's column then gives its Doppler spectrum. Columns are
+ * independent, so rdmap_compute hands blocks of RDMAP_BLOCK of them to a
+ * worker pool.
+ */
+
+#define RDMAP_BLOCK 64
+
+#define RDMAP_MAGIC "RDM1"
+
+struct rdmap_job {
+    struct rdmap* rd;
+    size_t        first;
+    size_t        last;
+};
+
+struct rdmap {
+    size_t            n_range;    // Range bins kept from each profile
+    size_t            n_doppler;  // Slow-time FFT length, a power of two
+    struct fft_plan*  plan;
+    cf32*             slow;       // n_doppler rows of n_range bins
+    float*            map;        // n_range rows of n_doppler power bins
+    float*            window;
+    size_t            periods;    // Periods in the last map computed
+    cf32**            work;       // One FFT buffer per pool slot
+    int               n_work;
+    struct rdmap_job* jobs;
+    size_t            n_jobs;
+    struct pool_group tasks;      // Its jobs, waited for apart from others'
+};
+
+/*
+ * Header of a saved map, followed by n_range rows of n_doppler float32
+ * power values with zero Doppler at index n_doppler/2.
+ */
+struct rdmap_header {
+    char     magic[4];
+    uint32_t n_range;
+    uint32_t n_doppler;
+    uint32_t n_periods;          // Periods integrated, the rest zero-padded
+    uint64_t frame;
+    float    prf;                // Code periods per second
+    float    range_bin;          // Seconds of delay per range bin
+};
+
+struct rdmap* rdmap_create(size_t n_range, size_t n_doppler,
+                           const struct pool* pool);
+void rdmap_destroy(struct rdmap* rd);
+
+/*
+ * Store one period's complex profile; only the first n_range bins are kept
+ * and periods from n_doppler on are ignored. Different periods may be
+ * added concurrently.
+ */
+void rdmap_add_profile(struct rdmap* rd, unsigned long period,
+                       const cf32* profile);
+
+/* Window and transform periods 0 to n_periods-1, zero-padding the rest */
+void rdmap_compute(struct rdmap* rd, size_t n_periods, struct pool* pool);
+
+#endif
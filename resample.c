@@ -0,0 +1,241 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "resample.h"
+#include "convert.h"
+#include "fft.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RESAMPLE_X86
+#endif
+
+#define KAISER_BETA 7.0
+
+typedef void (*dot2_fn)(const float* c, const float* x_i, const float* x_q,
+                        size_t n, float* y_i, float* y_q);
+
+
+static void dot2_scalar(const float* c, const float* x_i, const float* x_q,
+                        size_t n, float* y_i, float* y_q)
+{
+    float si = 0, sq = 0;
+    size_t k;
+
+    for(k=0; k<n; k++) {
+        si += c[k] * x_i[k];
+        sq += c[k] * x_q[k];
+    }
+    *y_i = si;
+    *y_q = sq;
+}
+
+
+#ifdef RESAMPLE_X86
+
+__attribute__((target("avx2,fma")))
+static float hsum_avx2(__m256 v)
+{
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v),
+                          _mm256_extractf128_ps(v, 1));
+
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+
+// n is a multiple of RESAMPLE_ALIGN
+__attribute__((target("avx2,fma")))
+static void dot2_avx2(const float* c, const float* x_i, const float* x_q,
+                      size_t n, float* y_i, float* y_q)
+{
+    __m256 si = _mm256_setzero_ps(), sq = _mm256_setzero_ps(), ck;
+    size_t k;
+
+    for(k=0; k<n; k+=8) {
+        ck = _mm256_loadu_ps(c + k);
+        si = _mm256_fmadd_ps(ck, _mm256_loadu_ps(x_i + k), si);
+        sq = _mm256_fmadd_ps(ck, _mm256_loadu_ps(x_q + k), sq);
+    }
+    *y_i = hsum_avx2(si);
+    *y_q = hsum_avx2(sq);
+}
+
+#endif
+
+
+static dot2_fn dot2 = dot2_scalar;
+
+
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+    unsigned int t;
+
+    while(b) {
+        t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+
+// Zeroth order modified Bessel function of the first kind
+static double bessel_i0(double x)
+{
+    double sum = 1, term = 1;
+    int k;
+
+    for(k=1; k<50; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+        if(term < 1e-12 * sum)
+            break;
+    }
+    return sum;
+}
+
+
+// Prototype lowpass of n taps at the upsampled rate, with a DC gain of up
+static void design_prototype(float* h, size_t n, unsigned int up,
+                             unsigned int down)
+{
+    double fc = 0.5 / (up > down ? up : down);   // Cycles per sample
+    double centre = (n - 1) / 2.0, x, r, sum = 0;
+    size_t k;
+
+    for(k=0; k<n; k++) {
+        x = k - centre;
+        r = x / centre;
+        h[k] = 2 * fc * (x == 0 ? 1.0 : sin(2 * M_PI * fc * x) /
+                                         (2 * M_PI * fc * x)) *
+               bessel_i0(KAISER_BETA * sqrt(1 - r * r)) /
+               bessel_i0(KAISER_BETA);
+        sum += h[k];
+    }
+    for(k=0; k<n; k++)
+        h[k] *= up / sum;
+}
+
+
+struct resampler* resampler_create(unsigned int up, unsigned int down,
+                                   size_t half_len, size_t max_in)
+{
+    struct resampler* rs;
+    unsigned int g;
+    size_t n, p, i, k;
+    float* h;
+
+    if(!up || !down)
+        return NULL;
+
+    rs = calloc(1, sizeof(struct resampler));
+    if(!rs)
+        return NULL;
+
+    g = gcd(up, down);
+    rs->up = up / g;
+    rs->down = down / g;
+    // A whole number of output samples of delay, at least one tap each side
+    if(!half_len)
+        half_len = 1;
+    rs->half_len = (half_len + rs->down - 1) / rs->down * rs->down;
+    rs->taps = (2 * rs->half_len + 1 + RESAMPLE_ALIGN - 1) /
+               RESAMPLE_ALIGN * RESAMPLE_ALIGN;
+    rs->max_in = max_in;
+
+    n = 2 * rs->half_len * rs->up + 1;
+    h = malloc(n * sizeof(float));
+    rs->bank = fft_alloc(rs->up * rs->taps * sizeof(float));
+    rs->in_i = fft_alloc((rs->taps - 1 + max_in) * sizeof(float));
+    rs->in_q = fft_alloc((rs->taps - 1 + max_in) * sizeof(float));
+    if(!h || !rs->bank || !rs->in_i || !rs->in_q) {
+        free(h);
+        resampler_destroy(rs);
+        return NULL;
+    }
+
+    // Phase p's tap j, reversed so a dot product runs oldest sample first
+    design_prototype(h, n, rs->up, rs->down);
+    for(p=0; p<rs->up; p++) {
+        for(i=0; i<rs->taps; i++) {
+            k = p + (rs->taps - 1 - i) * rs->up;
+            rs->bank[p * rs->taps + i] = k < n ? h[k] : 0.0f;
+        }
+    }
+    free(h);
+
+#ifdef RESAMPLE_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        dot2 = dot2_avx2;
+#endif
+
+    resampler_reset(rs);
+    return rs;
+}
+
+
+void resampler_destroy(struct resampler* rs)
+{
+    if(!rs)
+        return;
+
+    free(rs->bank);
+    free(rs->in_i);
+    free(rs->in_q);
+    free(rs);
+}
+
+
+void resampler_reset(struct resampler* rs)
+{
+    memset(rs->in_i, 0, (rs->taps - 1) * sizeof(float));
+    memset(rs->in_q, 0, (rs->taps - 1) * sizeof(float));
+    rs->pos = 0;
+    rs->phase = 0;
+}
+
+
+static inline int16_t to_sc16(float v)
+{
+    long q = lrintf(v);
+
+    if(q > 2047)
+        q = 2047;
+    if(q < -2048)
+        q = -2048;
+    return (int16_t)q;
+}
+
+
+size_t resampler_run(struct resampler* rs, const int16_t* in, size_t n,
+                     int16_t* out)
+{
+    size_t history = rs->taps - 1, n_out = 0;
+    float y_i, y_q;
+
+    if(n > rs->max_in)
+        n = rs->max_in;
+    sc16_to_split(in, rs->in_i + history, rs->in_q + history, n, 1.0f);
+
+    // Output m needs every input up to pos + taps - 1
+    while(rs->pos < n) {
+        dot2(rs->bank + rs->phase * rs->taps, rs->in_i + rs->pos,
+             rs->in_q + rs->pos, rs->taps, &y_i, &y_q);
+        out[2*n_out] = to_sc16(y_i);
+        out[2*n_out + 1] = to_sc16(y_q);
+        n_out++;
+
+        rs->phase += rs->down;
+        rs->pos += rs->phase / rs->up;
+        rs->phase %= rs->up;
+    }
+    rs->pos -= n;
+
+    memmove(rs->in_i, rs->in_i + n, history * sizeof(float));
+    memmove(rs->in_q, rs->in_q + n, history * sizeof(float));
+
+    return n_out;
+}
@@ -0,0 +1,68 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Streaming polyphase FIR resampler for SC16_Q12 I/Q, by up/down.
+ *
+ * The prototype is a Kaiser-windowed sinc lowpass at the narrower of the
+ * two Nyquist rates, 2 * half_len * up + 1 taps long at the upsampled
+ * rate, split into up phases so that only the taps that meet an input
+ * sample are ever computed. Input is converted to separate I and Q float
+ * planes after the last taps - 1 samples of the previous call, so the
+ * filter runs straight across buffer boundaries; each output is a pair of
+ * dot products, done eight taps at a time with AVX2 where the CPU has it.
+ *
+ * The filter delays the signal by exactly half_len input samples, which
+ * half_len is rounded up to make a whole number of output samples; see
+ * resampler_delay. Outputs are rounded and clipped back to 12 bits.
+ */
+
+#define RESAMPLE_ALIGN 8        // Taps per phase are padded to a multiple
+
+struct resampler {
+    unsigned int up;
+    unsigned int down;
+    size_t       half_len;      // In input samples
+    size_t       taps;          // Per phase, a multiple of RESAMPLE_ALIGN
+    float*       bank;          // up phases of taps, each time-reversed
+    size_t       max_in;        // Most input samples in one call
+    float*       in_i;          // taps - 1 samples of history, then input
+    float*       in_q;
+    size_t       pos;           // Input index of the next output's oldest tap
+    unsigned int phase;         // Its phase, 0 to up - 1
+};
+
+/*
+ * Returns NULL if out of memory or up or down is 0. The ratio is reduced
+ * to lowest terms first.
+ */
+struct resampler* resampler_create(unsigned int up, unsigned int down,
+                                   size_t half_len, size_t max_in);
+void resampler_destroy(struct resampler* rs);
+
+/* Forget the history, as if the stream started again */
+void resampler_reset(struct resampler* rs);
+
+/* Most outputs one call with n inputs can give */
+static inline size_t resampler_max_out(const struct resampler* rs, size_t n)
+{
+    return (n * rs->up + rs->down - 1) / rs->down + 1;
+}
+
+/* Group delay in output samples */
+static inline size_t resampler_delay(const struct resampler* rs)
+{
+    return rs->half_len * rs->up / rs->down;
+}
+
+/*
+ * Resample n SC16 I/Q samples, at most max_in, into out. Returns the
+ * number of samples written.
+ */
+size_t resampler_run(struct resampler* rs, const int16_t* in, size_t n,
+                     int16_t* out);
+
+#endif
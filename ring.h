@@ -0,0 +1,95 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+
+/*
+ * Single-producer/single-consumer lock-free ring of pointers.
+ *
+ * The producer only writes head and the consumer only writes tail; each sits
+ * on its own cache line together with that side's cached copy of the other
+ * index, so the two threads only share a line when the ring looks full or
+ * empty.
+ */
+
+#define RING_CACHE_LINE 64
+
+struct spsc_ring {
+    alignas(RING_CACHE_LINE) atomic_size_t head;
+    size_t tail_cache;                  // Producer's copy of tail
+
+    alignas(RING_CACHE_LINE) atomic_size_t tail;
+    size_t head_cache;                  // Consumer's copy of head
+
+    alignas(RING_CACHE_LINE) size_t mask;
+    void** slots;
+};
+
+
+/* Capacity is rounded up to a power of two. Returns 0 on success. */
+static inline int spsc_ring_init(struct spsc_ring* ring, size_t capacity)
+{
+    size_t size = 1;
+
+    while(size < capacity)
+        size <<= 1;
+
+    ring->slots = calloc(size, sizeof(void*));
+    if(!ring->slots)
+        return 1;
+
+    ring->mask = size - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    ring->tail_cache = 0;
+    ring->head_cache = 0;
+    return 0;
+}
+
+
+static inline void spsc_ring_free(struct spsc_ring* ring)
+{
+    free(ring->slots);
+    ring->slots = NULL;
+}
+
+
+/* Producer side. Returns false if the ring is full. */
+static inline bool spsc_ring_push(struct spsc_ring* ring, void* item)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    if(head - ring->tail_cache > ring->mask) {
+        ring->tail_cache = atomic_load_explicit(&ring->tail,
+                                                memory_order_acquire);
+        if(head - ring->tail_cache > ring->mask)
+            return false;
+    }
+
+    ring->slots[head & ring->mask] = item;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+
+/* Consumer side. Returns false if the ring is empty. */
+static inline bool spsc_ring_pop(struct spsc_ring* ring, void** item)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    if(tail == ring->head_cache) {
+        ring->head_cache = atomic_load_explicit(&ring->head,
+                                                memory_order_acquire);
+        if(tail == ring->head_cache)
+            return false;
+    }
+
+    *item = ring->slots[tail & ring->mask];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+#endif
@@ -0,0 +1,174 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include "rt.h"
+
+static struct rt_arena arena;
+
+
+static size_t round_up(size_t n, size_t align)
+{
+    return (n + align - 1) / align * align;
+}
+
+
+int rt_arena_create(size_t size)
+{
+    int err;
+
+    if(arena.base) {
+        errno = EBUSY;
+        return 1;
+    }
+
+    size = round_up(size ? size : 1, RT_HUGE_SIZE);
+    arena.huge = true;
+    arena.base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(arena.base == MAP_FAILED) {
+        // No huge pages reserved; ask for transparent ones before faulting
+        arena.huge = false;
+        arena.base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(arena.base == MAP_FAILED) {
+            arena.base = NULL;
+            return 1;
+        }
+        madvise(arena.base, size, MADV_HUGEPAGE);
+    }
+
+    // mlock faults every page in as well as keeping it there
+    if(mlock(arena.base, size)) {
+        err = errno;
+        munmap(arena.base, size);
+        arena.base = NULL;
+        errno = err;
+        return 1;
+    }
+    arena.size = size;
+    arena.used = 0;
+
+    return 0;
+}
+
+
+void rt_arena_destroy(void)
+{
+    if(!arena.base)
+        return;
+
+    munlock(arena.base, arena.size);
+    munmap(arena.base, arena.size);
+    memset(&arena, 0, sizeof(arena));
+}
+
+
+const struct rt_arena* rt_arena(void)
+{
+    return arena.base ? &arena : NULL;
+}
+
+
+void* rt_alloc(size_t size)
+{
+    void* buf;
+
+    size = round_up(size ? size : 1, RT_PAGE_SIZE);
+    if(arena.base && arena.size - arena.used >= size) {
+        buf = arena.base + arena.used;
+        arena.used += size;
+        memset(buf, 0, size);
+        return buf;
+    }
+
+    if(posix_memalign(&buf, RT_PAGE_SIZE, size))
+        return NULL;
+    memset(buf, 0, size);
+    return buf;
+}
+
+
+void rt_free(void* buf)
+{
+    if(arena.base && (char*)buf >= arena.base &&
+       (char*)buf < arena.base + arena.size)
+        return;
+
+    free(buf);
+}
+
+
+int rt_thread_create(pthread_t* thread, const struct rt_sched* sched,
+                     void* (*fn)(void*), void* arg)
+{
+    pthread_attr_t attr;
+    struct sched_param param;
+    cpu_set_t cpus;
+    int status;
+
+    status = pthread_attr_init(&attr);
+    if(status)
+        return status;
+
+    if(sched && sched->priority > 0) {
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = sched->priority;
+        status = pthread_attr_setinheritsched(&attr,
+                                              PTHREAD_EXPLICIT_SCHED);
+        if(!status)
+            status = pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        if(!status)
+            status = pthread_attr_setschedparam(&attr, &param);
+    }
+    if(!status && sched && sched->cpu >= 0) {
+        CPU_ZERO(&cpus);
+        CPU_SET(sched->cpu, &cpus);
+        status = pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+    }
+    if(!status)
+        status = pthread_create(thread, &attr, fn, arg);
+
+    pthread_attr_destroy(&attr);
+    return status;
+}
+
+
+int rt_thread_set(pthread_t thread, const struct rt_sched* sched)
+{
+    struct sched_param param;
+    cpu_set_t cpus;
+    int status = 0;
+
+    if(sched->priority > 0) {
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = sched->priority;
+        status = pthread_setschedparam(thread, SCHED_FIFO, &param);
+    }
+    if(!status && sched->cpu >= 0) {
+        CPU_ZERO(&cpus);
+        CPU_SET(sched->cpu, &cpus);
+        status = pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+    }
+
+    return status;
+}
+
+
+int rt_call(const struct rt_sched* sched, void* (*fn)(void*), void* arg)
+{
+    pthread_t thread;
+    int status;
+
+    if(!sched || (sched->priority <= 0 && sched->cpu < 0)) {
+        fn(arg);
+        return 0;
+    }
+
+    status = rt_thread_create(&thread, sched, fn, arg);
+    if(!status)
+        status = pthread_join(thread, NULL);
+    return status;
+}
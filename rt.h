@@ -0,0 +1,69 @@
+#ifndef RT_H
+#define RT_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/*
+ * Real-time support: streaming and processing threads under SCHED_FIFO,
+ * pinned to CPUs, and an arena for the buffers they touch.
+ *
+ * The arena is mapped once, up front, from huge pages if the system has
+ * any reserved and otherwise from ordinary pages marked for transparent
+ * huge pages, then faulted in and locked, so the stream callbacks never
+ * take a page fault on a buffer. Buffers are handed out page-aligned from
+ * it in order and never given back to it; once it is full, or if there is
+ * no arena, rt_alloc falls back to the heap. Only the main thread may
+ * create the arena or allocate; the buffers may be used anywhere.
+ */
+
+#define RT_PAGE_SIZE  4096
+#define RT_HUGE_SIZE  (2 * 1024 * 1024)
+
+struct rt_arena {
+    char*  base;
+    size_t size;
+    size_t used;
+    bool   huge;            // Backed by reserved huge pages
+};
+
+struct rt_sched {
+    int priority;           // SCHED_FIFO priority, or 0 for the default
+    int cpu;                // CPU to run on, or -1 for any
+};
+
+/*
+ * Map, fault in and lock an arena of at least size bytes, for rt_alloc to
+ * use. Returns 0 on success or 1 with errno set.
+ */
+int rt_arena_create(size_t size);
+void rt_arena_destroy(void);
+
+/* The arena, or NULL if there is none */
+const struct rt_arena* rt_arena(void);
+
+/* size bytes, page-aligned and zeroed, or NULL if out of memory */
+void* rt_alloc(size_t size);
+
+/* Release a buffer from rt_alloc; arena buffers stay until it is destroyed */
+void rt_free(void* buf);
+
+/*
+ * pthread_create with sched applied, returning its error code. Needs
+ * CAP_SYS_NICE (or an RLIMIT_RTPRIO) for a priority.
+ */
+int rt_thread_create(pthread_t* thread, const struct rt_sched* sched,
+                     void* (*fn)(void*), void* arg);
+
+/* Apply sched to a running thread, returning 0 or an error code */
+int rt_thread_set(pthread_t thread, const struct rt_sched* sched);
+
+/*
+ * Run fn(arg) to completion on a thread with sched applied, so that any
+ * threads it starts, such as libbladeRF's sync worker, inherit sched too.
+ * Returns 0 or rt_thread_create's error code.
+ */
+int rt_call(const struct rt_sched* sched, void* (*fn)(void*), void* arg);
+
+#endif
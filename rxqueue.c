@@ -0,0 +1,122 @@
+#include <stdlib.h>
+#include "rxqueue.h"
+
+
+int rx_queue_init(struct rx_queue* queue, void** buffers, size_t num_buffers,
+                  size_t num_transfers, size_t samples_per_buffer,
+                  unsigned long max_buffers)
+{
+    size_t i;
+
+    queue->descs = calloc(num_buffers, sizeof(struct rx_buffer));
+    queue->inflight = calloc(num_transfers, sizeof(struct rx_buffer*));
+    if(!queue->descs || !queue->inflight ||
+       spsc_ring_init(&queue->filled, num_buffers)) {
+        free(queue->descs);
+        free(queue->inflight);
+        return 1;
+    }
+    if(spsc_ring_init(&queue->free, num_buffers)) {
+        spsc_ring_free(&queue->filled);
+        free(queue->descs);
+        free(queue->inflight);
+        return 1;
+    }
+    sem_init(&queue->ready, 0, 0);
+
+    for(i=0; i<num_buffers; i++) {
+        queue->descs[i].samples = buffers[i];
+        if(i < num_transfers)
+            queue->inflight[i] = &queue->descs[i];
+        else
+            spsc_ring_push(&queue->free, &queue->descs[i]);
+    }
+
+    queue->inflight_head = 0;
+    queue->num_transfers = num_transfers;
+    queue->samples_per_buffer = samples_per_buffer;
+    queue->seq = 0;
+    queue->max_buffers = max_buffers;
+    queue->buffers_dropped = 0;
+    atomic_init(&queue->done, false);
+
+    return 0;
+}
+
+
+void rx_queue_free(struct rx_queue* queue)
+{
+    sem_destroy(&queue->ready);
+    spsc_ring_free(&queue->free);
+    spsc_ring_free(&queue->filled);
+    free(queue->inflight);
+    free(queue->descs);
+}
+
+
+void* rx_queue_cb(struct rx_queue* queue, unsigned long n_lost)
+{
+    struct rx_buffer* done = queue->inflight[queue->inflight_head];
+    struct rx_buffer* next;
+    void* popped;
+
+    // Keep seq in device time, so consumers see the gap
+    queue->seq += n_lost;
+    queue->buffers_dropped += n_lost;
+    done->seq = queue->seq++;
+
+    if(spsc_ring_pop(&queue->free, &popped)) {
+        next = popped;
+        spsc_ring_push(&queue->filled, done);
+        sem_post(&queue->ready);
+    } else {
+        next = done;
+        queue->buffers_dropped++;
+    }
+
+    queue->inflight[queue->inflight_head] = next;
+    queue->inflight_head = (queue->inflight_head + 1) % queue->num_transfers;
+
+    if(queue->max_buffers && queue->seq >= queue->max_buffers) {
+        return NULL;
+    }
+
+    return next->samples;
+}
+
+
+bool rx_queue_try_pop(struct rx_queue* queue, struct rx_buffer** buf)
+{
+    void* popped;
+
+    if(!spsc_ring_pop(&queue->filled, &popped))
+        return false;
+
+    *buf = popped;
+    return true;
+}
+
+
+bool rx_queue_pop(struct rx_queue* queue, struct rx_buffer** buf)
+{
+    for(;;) {
+        if(rx_queue_try_pop(queue, buf))
+            return true;
+        if(atomic_load(&queue->done))
+            return rx_queue_try_pop(queue, buf);
+        sem_wait(&queue->ready);
+    }
+}
+
+
+void rx_queue_release(struct rx_queue* queue, struct rx_buffer* buf)
+{
+    spsc_ring_push(&queue->free, buf);
+}
+
+
+void rx_queue_finish(struct rx_queue* queue)
+{
+    atomic_store(&queue->done, true);
+    sem_post(&queue->ready);
+}
@@ -0,0 +1,74 @@
+#ifndef RXQUEUE_H
+#define RXQUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+#include "ring.h"
+
+/*
+ * Hands filled RX buffers from the stream callback to a consumer thread and
+ * back again without locks or copies.
+ *
+ * The stream submits the first num_transfers buffers itself; after that,
+ * each completed transfer goes to the consumer through the filled ring and
+ * the callback resubmits a buffer the consumer has returned through the
+ * free ring. If none has been returned, the callback resubmits the buffer
+ * it was just given, dropping its contents, and counts the drop. Buffers
+ * the device lost before they reached the callback are counted as dropped
+ * too, and skipped in the sequence.
+ */
+
+struct rx_buffer
+{
+    int16_t*       samples;
+    unsigned long  seq;             // Position in the stream, in buffers
+};
+
+struct rx_queue
+{
+    struct spsc_ring    filled;     // Callback -> consumer
+    struct spsc_ring    free;       // Consumer -> callback
+    sem_t               ready;      // Posted for each push to filled
+    struct rx_buffer*   descs;      // One per stream buffer
+    struct rx_buffer**  inflight;   // Submitted buffers, oldest at head
+    size_t              inflight_head;
+    size_t              num_transfers;
+    size_t              samples_per_buffer;
+
+    // Written by the callback only
+    unsigned long       seq;
+    unsigned long       max_buffers;
+    unsigned long       buffers_dropped;
+
+    atomic_bool         done;
+};
+
+/* max_buffers stops the stream after that many buffers, 0 for never */
+int  rx_queue_init(struct rx_queue* queue, void** buffers, size_t num_buffers,
+                   size_t num_transfers, size_t samples_per_buffer,
+                   unsigned long max_buffers);
+void rx_queue_free(struct rx_queue* queue);
+
+/*
+ * Stream callback side: takes the buffer just filled, which came n_lost
+ * buffers after the one before it, and returns the next to submit, or NULL
+ * once max_buffers have been captured.
+ */
+void* rx_queue_cb(struct rx_queue* queue, unsigned long n_lost);
+
+/*
+ * Consumer side. rx_queue_pop blocks until a filled buffer is available and
+ * returns false once the queue is finished and empty; rx_queue_try_pop
+ * never blocks. Buffers go back with rx_queue_release when done with.
+ */
+bool rx_queue_pop(struct rx_queue* queue, struct rx_buffer** buf);
+bool rx_queue_try_pop(struct rx_queue* queue, struct rx_buffer** buf);
+void rx_queue_release(struct rx_queue* queue, struct rx_buffer* buf);
+
+/* Wake the consumer after the stream has stopped, so it can drain and exit */
+void rx_queue_finish(struct rx_queue* queue);
+
+#endif
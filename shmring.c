@@ -0,0 +1,155 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "shmring.h"
+
+
+static uint64_t align_up(uint64_t n, uint64_t align)
+{
+    return (n + align - 1) & ~(align - 1);
+}
+
+
+/*
+ * Place the sections after the slot header, each on a cache line, and
+ * return the slot size, a whole number of pages.
+ */
+static uint64_t slot_layout(struct shm_section* sections)
+{
+    uint64_t offset = sizeof(struct shm_slot_header);
+    int s;
+
+    for(s=0; s<SHM_N_SECTIONS; s++) {
+        offset = align_up(offset, 64);
+        sections[s].offset = sections[s].size ? offset : 0;
+        offset += sections[s].size;
+    }
+
+    return align_up(offset, SHM_RING_ALIGN);
+}
+
+
+struct shm_ring* shm_ring_create(const char* name,
+                                 const struct shm_ring_header* header,
+                                 uint32_t n_slots)
+{
+    struct shm_ring* ring;
+    struct shm_ring_header* h;
+    struct shm_section sections[SHM_N_SECTIONS];
+    uint64_t slot_size;
+    int err;
+
+    if(!n_slots || strlen(name) >= sizeof(ring->name)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    ring = calloc(1, sizeof(struct shm_ring));
+    if(!ring) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    strcpy(ring->name, name);
+
+    memcpy(sections, header->sections, sizeof(sections));
+    slot_size = slot_layout(sections);
+    ring->size = SHM_RING_ALIGN + n_slots * slot_size;
+
+    // A fresh object, so viewers still mapping an old one are not cut short
+    shm_unlink(name);
+    ring->fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if(ring->fd < 0) {
+        free(ring);
+        return NULL;
+    }
+    if(ftruncate(ring->fd, ring->size)) {
+        err = errno;
+        close(ring->fd);
+        shm_unlink(name);
+        free(ring);
+        errno = err;
+        return NULL;
+    }
+    h = mmap(NULL, ring->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+             ring->fd, 0);
+    if(h == MAP_FAILED) {
+        err = errno;
+        close(ring->fd);
+        shm_unlink(name);
+        free(ring);
+        errno = err;
+        return NULL;
+    }
+    ring->header = h;
+
+    // A new object is all zeros: every seq even and nothing published
+    memcpy(h->magic, SHM_RING_MAGIC, sizeof(h->magic));
+    h->version = SHM_RING_VERSION;
+    h->header_size = SHM_RING_ALIGN;
+    h->n_slots = n_slots;
+    h->slot_size = slot_size;
+    memcpy(h->sections, sections, sizeof(sections));
+    h->frame_samples = header->frame_samples;
+    h->rx_sr = header->rx_sr;
+    h->n_range = header->n_range;
+    h->n_doppler = header->n_doppler;
+    h->prf = header->prf;
+    h->range_bin = header->range_bin;
+
+    return ring;
+}
+
+
+void shm_ring_destroy(struct shm_ring* ring)
+{
+    if(!ring)
+        return;
+
+    munmap(ring->header, ring->size);
+    close(ring->fd);
+    shm_unlink(ring->name);
+    free(ring);
+}
+
+
+struct shm_slot_header* shm_ring_begin(struct shm_ring* ring,
+                                       uint64_t frame)
+{
+    struct shm_ring_header* h = ring->header;
+    uint64_t published = atomic_load_explicit(&h->published,
+                                              memory_order_relaxed);
+    struct shm_slot_header* slot;
+    uint64_t seq;
+
+    slot = (struct shm_slot_header*)((char*)h + h->header_size +
+                                     published % h->n_slots * h->slot_size);
+    seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    if(!(seq & 1)) {
+        // Readers must see the odd seq before any of the new data
+        atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+    }
+    slot->frame = frame;
+    slot->n_samples = 0;
+    ring->slot = slot;
+
+    return slot;
+}
+
+
+void shm_ring_commit(struct shm_ring* ring)
+{
+    struct shm_ring_header* h = ring->header;
+    uint64_t seq = atomic_load_explicit(&ring->slot->seq,
+                                        memory_order_relaxed);
+
+    atomic_store_explicit(&ring->slot->seq, seq + 1, memory_order_release);
+    atomic_store_explicit(&h->published,
+                          atomic_load_explicit(&h->published,
+                                               memory_order_relaxed) + 1,
+                          memory_order_release);
+    ring->slot = NULL;
+}
@@ -0,0 +1,109 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+/*
+ * Live frames published to POSIX shared memory for viewers.
+ *
+ * The segment starts with a SHM_RING_ALIGN byte page holding a struct
+ * shm_ring_header, followed by n_slots slots of slot_size bytes. Each slot
+ * starts with a struct shm_slot_header and holds up to three sections at
+ * fixed offsets from its start: the frame's SC16 I/Q samples, sign
+ * extended, its averaged correlation profile and its range-Doppler map, as
+ * in the files radar saves. A section of size 0 is not published.
+ *
+ * There is one writer and any number of readers, which never write, so
+ * they can map the segment read-only. Each slot is a seqlock: seq is odd
+ * while the slot is being written and goes up by two each time it is
+ * rewritten. published counts complete frames, so the newest one is in
+ * slot (published - 1) % n_slots. A reader loads seq (acquire), reads the
+ * data in place, then loads seq again after an acquire fence; the data is
+ * good only if seq was even and has not changed. With the writer filling
+ * one slot while the rest stand still, a reader has n_slots - 1 frame
+ * periods to use a frame before it can be overwritten.
+ *
+ * Everything is little-endian.
+ */
+
+#define SHM_RING_MAGIC   "RSHM"
+#define SHM_RING_VERSION 1
+#define SHM_RING_ALIGN   4096
+#define SHM_RING_NAME    "/radar"       // Appears as /dev/shm/radar
+#define SHM_RING_SLOTS   4
+
+enum {
+    SHM_SECTION_SAMPLES,
+    SHM_SECTION_PROFILE,
+    SHM_SECTION_MAP,
+    SHM_N_SECTIONS
+};
+
+struct shm_section {
+    uint64_t offset;        // From the start of the slot
+    uint64_t size;          // In bytes, 0 if not published
+};
+
+struct shm_ring_header {
+    char     magic[4];
+    uint32_t version;
+    uint32_t header_size;   // Offset of the first slot
+    uint32_t n_slots;
+    uint64_t slot_size;
+    struct shm_section sections[SHM_N_SECTIONS];
+    uint32_t frame_samples; // Samples section: I/Q pairs
+    uint32_t rx_sr;
+    uint32_t n_range;       // Profile and map: range bins
+    uint32_t n_doppler;     // Map: Doppler bins, zero Doppler in the middle
+    float    prf;           // Code periods per second
+    float    range_bin;     // Seconds of delay per range bin
+    atomic_uint_least64_t published;
+};
+
+struct shm_slot_header {
+    atomic_uint_least64_t seq;
+    uint64_t frame;         // Frame number, as printed by radar
+    uint64_t n_samples;     // Samples in the samples section
+};
+
+struct shm_ring {
+    int                     fd;
+    char                    name[256];
+    size_t                  size;
+    struct shm_ring_header* header;
+    struct shm_slot_header* slot;       // Being written, or NULL
+};
+
+/*
+ * Create the shared memory object name (a POSIX name such as
+ * SHM_RING_NAME), replacing any left from an earlier run, and lay out
+ * n_slots slots as header describes; only its geometry and section sizes
+ * are taken. Returns NULL with errno set on failure.
+ */
+struct shm_ring* shm_ring_create(const char* name,
+                                 const struct shm_ring_header* header,
+                                 uint32_t n_slots);
+
+/* Unmap and remove the object; readers that have it mapped keep it */
+void shm_ring_destroy(struct shm_ring* ring);
+
+/*
+ * Start writing frame into the next slot, returning the slot. A frame
+ * begun but never committed leaves its slot invalid, and the next
+ * shm_ring_begin reuses it.
+ */
+struct shm_slot_header* shm_ring_begin(struct shm_ring* ring,
+                                       uint64_t frame);
+
+/* Where a section of the slot being written starts */
+static inline void* shm_ring_section(const struct shm_ring* ring, int section)
+{
+    return (char*)ring->slot + ring->header->sections[section].offset;
+}
+
+/* Mark the slot being written complete and make it the newest frame */
+void shm_ring_commit(struct shm_ring* ring);
+
+#endif
@@ -0,0 +1,102 @@
+import time
+import numpy as np
+
+# Reader for the frames radar -M publishes to shared memory; the layout and
+# the seqlock protocol are described in shmring.h. The segment is mapped
+# read-only and frames are numpy views straight into it, so nothing is
+# copied until the caller does.
+
+SHM_RING_MAGIC = "RSHM"
+SECTIONS = ('samples', 'profile', 'map')
+
+header_dtype = np.dtype([
+    ('magic', 'S4'), ('version', '<u4'), ('header_size', '<u4'),
+    ('n_slots', '<u4'), ('slot_size', '<u8'),
+    ('sections', [('offset', '<u8'), ('size', '<u8')], (len(SECTIONS),)),
+    ('frame_samples', '<u4'), ('rx_sr', '<u4'), ('n_range', '<u4'),
+    ('n_doppler', '<u4'), ('prf', '<f4'), ('range_bin', '<f4'),
+    ('published', '<u8'),
+])
+
+slot_dtype = np.dtype([
+    ('seq', '<u8'), ('frame', '<u8'), ('n_samples', '<u8'),
+])
+
+
+class Frame(object):
+    """One published frame, valid only while valid() says so"""
+
+    def __init__(self, ring, slot, seq):
+        self.ring = ring
+        self.slot = slot
+        self.seq = seq
+        self.number = int(ring.slot_header(slot)['frame'])
+        self.samples = None
+        self.profile = None
+        self.map = None
+
+        base = ring.header_size + slot * ring.slot_size
+        for i, name in enumerate(SECTIONS):
+            section = ring.sections[i]
+            if section['size'] == 0:
+                continue
+            start = base + int(section['offset'])
+            data = ring.data[start:start + int(section['size'])]
+            if name == 'samples':
+                n = int(ring.slot_header(slot)['n_samples'])
+                self.samples = data.view('<i2').reshape((-1, 2))[:n]
+            elif name == 'profile':
+                self.profile = data.view('<f4')
+            else:
+                self.map = data.view('<f4').reshape((ring.n_range,
+                                                     ring.n_doppler))
+
+    def valid(self):
+        """True if the slot has not been rewritten since this frame was read"""
+        return self.ring.slot_header(self.slot)['seq'] == self.seq
+
+
+class ShmRing(object):
+    def __init__(self, name="radar"):
+        self.data = np.memmap("/dev/shm/" + name.lstrip("/"), np.uint8, 'r')
+        header = self.header()
+        if header['magic'] != SHM_RING_MAGIC:
+            raise ValueError("%s is not a radar frame ring" % name)
+        self.header_size = int(header['header_size'])
+        self.n_slots = int(header['n_slots'])
+        self.slot_size = int(header['slot_size'])
+        self.sections = header['sections'].copy()
+        self.frame_samples = int(header['frame_samples'])
+        self.rx_sr = int(header['rx_sr'])
+        self.n_range = int(header['n_range'])
+        self.n_doppler = int(header['n_doppler'])
+        self.prf = float(header['prf'])
+        self.range_bin = float(header['range_bin'])
+
+    def header(self):
+        return self.data[:header_dtype.itemsize].view(header_dtype)[0]
+
+    def slot_header(self, slot):
+        start = self.header_size + slot * self.slot_size
+        return self.data[start:start + slot_dtype.itemsize].view(slot_dtype)[0]
+
+    def published(self):
+        return int(self.header()['published'])
+
+    def latest(self):
+        """The newest complete frame, or None if there is none yet"""
+        while True:
+            published = self.published()
+            if published == 0:
+                return None
+            slot = (published - 1) % self.n_slots
+            seq = int(self.slot_header(slot)['seq'])
+            # Odd while being written; then the writer has lapped us
+            if seq % 2 == 0:
+                return Frame(self, slot, seq)
+
+    def wait(self, after=0, interval=0.01):
+        """Wait until more than after frames have been published"""
+        while self.published() <= after:
+            time.sleep(interval)
+        return self.published()
@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include "stats.h"
+
+static const char* stage_names[STATS_N_STAGES] = {
+    "write", "iq", "resample", "correlate", "rdmap", "acquire", "detect",
+    "publish"
+};
+
+// A consistent enough copy of a histogram, taken while it is being written
+struct hist_snapshot {
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+    uint64_t buckets[STATS_BUCKETS];
+    int      n_buckets;     // Up to the last one in use
+};
+
+
+static uint64_t load(const atomic_uint_least64_t* counter)
+{
+    return atomic_load_explicit((atomic_uint_least64_t*)counter,
+                                memory_order_relaxed);
+}
+
+
+static void hist_snapshot(const struct stats_hist* hist,
+                          struct hist_snapshot* s)
+{
+    int b;
+
+    s->count = 0;
+    s->n_buckets = 0;
+    for(b=0; b<STATS_BUCKETS; b++) {
+        s->buckets[b] = load(&hist->buckets[b]);
+        s->count += s->buckets[b];
+        if(s->buckets[b])
+            s->n_buckets = b + 1;
+    }
+    s->total = load(&hist->total);
+    s->max = load(&hist->max);
+}
+
+
+// Upper bound of the bucket holding quantile q, but no more than the max
+static uint64_t hist_quantile(const struct hist_snapshot* s, double q)
+{
+    uint64_t seen = 0, rank = (uint64_t)ceil(q * s->count);
+    uint64_t bound;
+    int b;
+
+    if(!s->count)
+        return 0;
+    if(!rank)
+        rank = 1;
+    for(b=0; b<s->n_buckets; b++) {
+        seen += s->buckets[b];
+        if(seen >= rank)
+            break;
+    }
+    bound = 2ULL << b;
+    return bound < s->max ? bound : s->max;
+}
+
+
+static void write_hist(FILE* f, const char* name,
+                       const struct stats_hist* hist, const char* indent)
+{
+    struct hist_snapshot s;
+    int b;
+
+    hist_snapshot(hist, &s);
+    fprintf(f, "%s\"%s\": {\"count\": %llu, \"mean_ns\": %llu, "
+               "\"max_ns\": %llu,\n", indent, name,
+            (unsigned long long)s.count,
+            (unsigned long long)(s.count ? s.total / s.count : 0),
+            (unsigned long long)s.max);
+    fprintf(f, "%s    \"p50_ns\": %llu, \"p99_ns\": %llu, "
+               "\"p999_ns\": %llu,\n", indent,
+            (unsigned long long)hist_quantile(&s, 0.5),
+            (unsigned long long)hist_quantile(&s, 0.99),
+            (unsigned long long)hist_quantile(&s, 0.999));
+    fprintf(f, "%s    \"log2_buckets\": [", indent);
+    for(b=0; b<s.n_buckets; b++)
+        fprintf(f, "%s%llu", b ? ", " : "", (unsigned long long)s.buckets[b]);
+    fprintf(f, "]}");
+}
+
+
+static void write_stream(FILE* f, const char* name,
+                         struct stats_stream* stream, unsigned int sr,
+                         size_t samples_per_buffer, size_t transfers,
+                         double elapsed)
+{
+    uint64_t samples = load(&stream->samples);
+    double rate = elapsed > 0 ? (samples - stream->reported) / elapsed : 0;
+
+    stream->reported = samples;
+    fprintf(f, "  \"%s\": {\n", name);
+    fprintf(f, "    \"callbacks\": %llu, \"samples\": %llu, "
+               "\"dropped_buffers\": %llu,\n",
+            (unsigned long long)load(&stream->callbacks),
+            (unsigned long long)samples,
+            (unsigned long long)load(&stream->dropped));
+    fprintf(f, "    \"sample_rate\": %.0f, \"nominal_rate\": %u,\n",
+            rate, sr);
+    fprintf(f, "    \"buffer_period_ns\": %llu, \"transfers\": %zu,\n",
+            (unsigned long long)(sr ? samples_per_buffer * 1000000000ULL / sr
+                                    : 0),
+            transfers);
+    write_hist(f, "callback", &stream->callback, "    ");
+    fprintf(f, ",\n");
+    write_hist(f, "interval", &stream->interval, "    ");
+    fprintf(f, "\n  }");
+}
+
+
+static size_t ring_depth(const struct spsc_ring* ring)
+{
+    return atomic_load_explicit((atomic_size_t*)&ring->head,
+                                memory_order_relaxed) -
+           atomic_load_explicit((atomic_size_t*)&ring->tail,
+                                memory_order_relaxed);
+}
+
+
+void stats_init(struct stats* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->start = stats_now();
+    stats->last_write = stats->start;
+}
+
+
+int stats_write(struct stats* stats)
+{
+    char tmp_filename[1024];
+    uint64_t now = stats_now();
+    double elapsed = (now - stats->last_write) / 1e9;
+    FILE* f;
+    int i, status;
+
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", stats->filename);
+    f = fopen(tmp_filename, "w");
+    if(!f)
+        return errno;
+
+    fprintf(f, "{\n  \"uptime\": %.3f,\n", (now - stats->start) / 1e9);
+    write_stream(f, "tx", &stats->tx, stats->tx_sr,
+                 stats->tx_samples_per_buffer, stats->tx_transfers, elapsed);
+    fprintf(f, ",\n");
+    write_stream(f, "rx", &stats->rx, stats->rx_sr,
+                 stats->rx_samples_per_buffer, stats->rx_transfers, elapsed);
+    fprintf(f, ",\n");
+    if(stats->queue) {
+        // Buffers waiting for the consumer, and ready for the callback
+        fprintf(f, "  \"queue\": {\"filled\": %zu, \"free\": %zu},\n",
+                ring_depth(&stats->queue->filled),
+                ring_depth(&stats->queue->free));
+    }
+    fprintf(f, "  \"stages\": {\n");
+    for(i=0; i<STATS_N_STAGES; i++) {
+        write_hist(f, stage_names[i], &stats->stages[i], "    ");
+        fprintf(f, i < STATS_N_STAGES - 1 ? ",\n" : "\n");
+    }
+    fprintf(f, "  }\n}\n");
+    stats->last_write = now;
+
+    status = ferror(f) ? EIO : 0;
+    if(fclose(f) && !status)
+        status = errno;
+    if(!status && rename(tmp_filename, stats->filename))
+        status = errno;
+    if(status)
+        remove(tmp_filename);
+
+    return status;
+}
+
+
+static void* stats_thread(void* arg)
+{
+    struct stats* stats = arg;
+    struct timespec deadline;
+    double whole;
+
+    pthread_mutex_lock(&stats->lock);
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    while(!stats->stop) {
+        deadline.tv_nsec += (long)(modf(stats->interval, &whole) * 1e9);
+        deadline.tv_sec += (time_t)whole + deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+        while(!stats->stop &&
+              pthread_cond_timedwait(&stats->cond, &stats->lock,
+                                     &deadline) != ETIMEDOUT);
+        if(!stats->stop)
+            stats_write(stats);
+    }
+    pthread_mutex_unlock(&stats->lock);
+
+    return NULL;
+}
+
+
+int stats_start(struct stats* stats)
+{
+    int status;
+
+    stats->stop = false;
+    pthread_mutex_init(&stats->lock, NULL);
+    pthread_cond_init(&stats->cond, NULL);
+    status = pthread_create(&stats->thread, NULL, stats_thread, stats);
+    if(status) {
+        pthread_cond_destroy(&stats->cond);
+        pthread_mutex_destroy(&stats->lock);
+        return status;
+    }
+    stats->running = true;
+
+    return 0;
+}
+
+
+void stats_stop(struct stats* stats)
+{
+    if(!stats->running)
+        return;
+
+    pthread_mutex_lock(&stats->lock);
+    stats->stop = true;
+    pthread_cond_signal(&stats->cond);
+    pthread_mutex_unlock(&stats->lock);
+    pthread_join(stats->thread, NULL);
+    pthread_cond_destroy(&stats->cond);
+    pthread_mutex_destroy(&stats->lock);
+    stats->running = false;
+
+    stats_write(stats);
+}
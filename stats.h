@@ -0,0 +1,144 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include "rxqueue.h"
+
+/*
+ * Streaming telemetry.
+ *
+ * Every counter and histogram has exactly one writing thread, which updates
+ * it with relaxed atomic loads and stores: no locks, no read-modify-write
+ * instructions and no allocation on the hot path. A stats thread reads them
+ * whenever it likes and rewrites a JSON file every interval, giving per
+ * stream callback times, gaps between callbacks, delivered sample rates and
+ * drops, and per stage processing times.
+ *
+ * Histograms have log2 buckets: bucket b counts times in [2^b, 2^(b+1)) ns,
+ * with bucket 0 also counting 0.
+ */
+
+#define STATS_BUCKETS 40
+
+struct stats_hist {
+    atomic_uint_least64_t count;
+    atomic_uint_least64_t total;        // In ns
+    atomic_uint_least64_t max;
+    atomic_uint_least64_t buckets[STATS_BUCKETS];
+};
+
+// Written by one stream's callback
+struct stats_stream {
+    atomic_uint_least64_t callbacks;
+    atomic_uint_least64_t samples;
+    atomic_uint_least64_t dropped;      // Buffers, RX only
+    struct stats_hist     callback;     // Time spent in the callback
+    struct stats_hist     interval;     // Time from one callback to the next
+    uint64_t              last;         // When the last callback returned
+    uint64_t              reported;     // Samples at the last stats_write
+};
+
+enum {
+    STATS_STAGE_WRITE,                  // Sign extension and file output
+    STATS_STAGE_IQ,                     // DC and IQ imbalance correction
+    STATS_STAGE_RESAMPLE,               // Decimation ahead of the correlator
+    STATS_STAGE_CORRELATE,              // Waiting for a frame's correlation
+    STATS_STAGE_RDMAP,
+    STATS_STAGE_ACQUIRE,
+    STATS_STAGE_DETECT,
+    STATS_STAGE_PUBLISH,                // Copying frames to shared memory
+    STATS_N_STAGES
+};
+
+struct stats {
+    struct stats_stream tx;
+    struct stats_stream rx;
+    struct stats_hist   stages[STATS_N_STAGES]; // Written by the consumer
+
+    // Set before streaming starts, for reporting only
+    unsigned int        tx_sr;
+    unsigned int        rx_sr;
+    size_t              tx_samples_per_buffer;
+    size_t              rx_samples_per_buffer;
+    size_t              tx_transfers;
+    size_t              rx_transfers;
+    const struct rx_queue* queue;       // Continuous mode, else NULL
+
+    const char*         filename;
+    double              interval;       // Seconds between writes
+    uint64_t            start;
+    uint64_t            last_write;
+    pthread_t           thread;
+    pthread_mutex_t     lock;
+    pthread_cond_t      cond;
+    bool                stop;
+    bool                running;
+};
+
+
+static inline uint64_t stats_now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+
+/* Add n to a counter only the calling thread writes */
+static inline void stats_add(atomic_uint_least64_t* counter, uint64_t n)
+{
+    atomic_store_explicit(counter,
+        atomic_load_explicit(counter, memory_order_relaxed) + n,
+        memory_order_relaxed);
+}
+
+
+static inline void stats_hist_add(struct stats_hist* hist, uint64_t ns)
+{
+    int b = ns ? 63 - __builtin_clzll(ns) : 0;
+
+    if(b >= STATS_BUCKETS)
+        b = STATS_BUCKETS - 1;
+    stats_add(&hist->buckets[b], 1);
+    stats_add(&hist->count, 1);
+    stats_add(&hist->total, ns);
+    if(ns > atomic_load_explicit(&hist->max, memory_order_relaxed))
+        atomic_store_explicit(&hist->max, ns, memory_order_relaxed);
+}
+
+
+/* Record a callback that started at start and handled n_samples */
+static inline void stats_stream_cb(struct stats_stream* stream,
+                                   uint64_t start, size_t n_samples)
+{
+    uint64_t end = stats_now();
+
+    stats_hist_add(&stream->callback, end - start);
+    if(stream->last)
+        stats_hist_add(&stream->interval, start - stream->last);
+    stream->last = end;
+    stats_add(&stream->callbacks, 1);
+    stats_add(&stream->samples, n_samples);
+}
+
+
+/* Zero everything; the reporting fields are then set by the caller */
+void stats_init(struct stats* stats);
+
+/*
+ * Write stats->filename every stats->interval seconds from a thread of its
+ * own until stats_stop, which writes it one last time. Returns 0 on success
+ * or an errno value.
+ */
+int  stats_start(struct stats* stats);
+void stats_stop(struct stats* stats);
+
+/* Write the current figures to stats->filename. Returns 0 on success. */
+int  stats_write(struct stats* stats);
+
+#endif
@@ -0,0 +1,203 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include "waveform.h"
+#include "goldcode.h"
+#include "rt.h"
+
+
+static const char* type_names[] = { "prn", "chirp", "pulse" };
+
+
+int waveform_parse(const char* arg, struct waveform* waveforms, int max)
+{
+    struct waveform* w;
+    unsigned long value;
+    size_t len;
+    char* end;
+    int n = 0, t;
+
+    while(*arg && n < max) {
+        w = &waveforms[n];
+        memset(w, 0, sizeof(*w));
+        for(t=0; t<3; t++) {
+            len = strlen(type_names[t]);
+            if(!strncmp(arg, type_names[t], len) && arg[len] == ':')
+                break;
+        }
+        if(t == 3)
+            return 0;
+        w->type = t;
+        arg += strlen(type_names[t]) + 1;
+
+        value = strtoul(arg, &end, 10);
+        if(end == arg || value == 0 || value > UINT32_MAX)
+            return 0;
+        w->param = value;
+        w->n_blocks = 1;
+        arg = end;
+
+        if(w->type == WAVEFORM_PRN && value > GOLDCODE_N_PRNS)
+            return 0;
+        if(w->type == WAVEFORM_PULSE && *arg == ':') {
+            value = strtoul(arg + 1, &end, 10);
+            if(end == arg + 1 || value == 0 || value > UINT32_MAX)
+                return 0;
+            w->n_blocks = value;
+            arg = end;
+        }
+
+        if(*arg && *arg != ',')
+            return 0;
+        arg = *arg ? arg + 1 : arg;
+        n++;
+    }
+
+    return *arg ? 0 : n;
+}
+
+
+void waveform_describe(const struct waveform* waveform, char* str,
+                       size_t size)
+{
+    if(waveform->type == WAVEFORM_PULSE && waveform->n_blocks > 1) {
+        snprintf(str, size, "%s:%u:%u", type_names[waveform->type],
+                 waveform->param, waveform->n_blocks);
+    } else {
+        snprintf(str, size, "%s:%u", type_names[waveform->type],
+                 waveform->param);
+    }
+}
+
+
+static void build_prn(int16_t* block, size_t n, unsigned int prn,
+                      int16_t amplitude)
+{
+    int8_t chips[GOLDCODE_LEN];
+
+    goldcode_generate(prn, chips);
+    goldcode_modulate(chips, n / GOLDCODE_LEN, amplitude, block, n);
+}
+
+
+// Sweep from -bw/2 to +bw/2 Hz over the block
+static void build_chirp(int16_t* block, size_t n, double bw, double sr,
+                        int16_t amplitude)
+{
+    double t, period = n / sr, phase;
+    size_t i;
+
+    for(i=0; i<n; i++) {
+        t = i / sr;
+        phase = 2 * M_PI * (-bw / 2 * t + bw / (2 * period) * t * t);
+        block[2*i] = lrint(amplitude * cos(phase));
+        block[2*i + 1] = lrint(amplitude * sin(phase));
+    }
+}
+
+
+static void build_pulse(int16_t* block, size_t n, size_t width,
+                        int16_t amplitude)
+{
+    size_t i;
+
+    memset(block, 0, n * 2 * sizeof(int16_t));
+    for(i=0; i<width; i++)
+        block[2*i] = amplitude;
+}
+
+
+struct waveform_lib* waveform_lib_create(const struct waveform* waveforms,
+                                         int n, size_t samples_per_buffer,
+                                         unsigned int sr, int16_t amplitude)
+{
+    struct waveform_lib* lib;
+    struct waveform* w;
+    size_t stride, n_sequence = 0, i, b;
+    int16_t* block;
+    int16_t* zeros = NULL;
+    int k, n_distinct = 0, silence = 0;
+
+    if(n < 1 || n > WAVEFORM_MAX) {
+        errno = EINVAL;
+        return NULL;
+    }
+    for(k=0; k<n; k++) {
+        if((waveforms[k].type == WAVEFORM_PRN &&
+            samples_per_buffer < GOLDCODE_LEN) ||
+           (waveforms[k].type == WAVEFORM_CHIRP && waveforms[k].param > sr) ||
+           (waveforms[k].type == WAVEFORM_PULSE &&
+            waveforms[k].param > samples_per_buffer)) {
+            errno = EINVAL;
+            return NULL;
+        }
+        // One block of its own, and pulse trains share one of silence
+        n_sequence += waveforms[k].n_blocks;
+        n_distinct++;
+        if(waveforms[k].n_blocks > 1 && !silence) {
+            silence = 1;
+            n_distinct++;
+        }
+    }
+
+    lib = calloc(1, sizeof(struct waveform_lib));
+    if(!lib) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    lib->samples_per_buffer = samples_per_buffer;
+    lib->n_waveforms = n;
+    memcpy(lib->waveforms, waveforms, n * sizeof(struct waveform));
+
+    // Each block starts on a cache line
+    stride = (samples_per_buffer * 2 * sizeof(int16_t) + 63) / 64 * 64 /
+             sizeof(int16_t);
+    lib->sequence = calloc(n_sequence, sizeof(int16_t*));
+    lib->arena = rt_alloc(n_distinct * stride * sizeof(int16_t));
+    if(!lib->sequence || !lib->arena) {
+        waveform_lib_destroy(lib);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    block = lib->arena;
+    if(silence) {
+        zeros = block;
+        block += stride;
+    }
+    for(k=0, i=0; k<n; k++) {
+        w = &lib->waveforms[k];
+        if(w->type == WAVEFORM_PRN)
+            build_prn(block, samples_per_buffer, w->param, amplitude);
+        else if(w->type == WAVEFORM_CHIRP)
+            build_chirp(block, samples_per_buffer, w->param, sr, amplitude);
+        else
+            build_pulse(block, samples_per_buffer, w->param, amplitude);
+
+        w->first = i;
+        lib->sequence[i++] = block;
+        for(b=1; b<w->n_blocks; b++)
+            lib->sequence[i++] = zeros;
+        block += stride;
+    }
+
+    atomic_init(&lib->selected, 0);
+    atomic_init(&lib->active, 0);
+    lib->pos = 0;
+
+    return lib;
+}
+
+
+void waveform_lib_destroy(struct waveform_lib* lib)
+{
+    if(!lib)
+        return;
+
+    rt_free(lib->arena);
+    free(lib->sequence);
+    free(lib);
+}
@@ -0,0 +1,109 @@
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+/*
+ * Library of TX waveforms, built before streaming starts.
+ *
+ * Each waveform is a run of blocks of SC16 samples, one TX buffer each, so
+ * its period is a whole number of buffers. Every distinct block is computed
+ * once into one page-aligned allocation, from the rt.h arena if there is
+ * one, and blocks that repeat, such as the silence between pulses, are
+ * stored once and pointed to many times. While
+ * streaming, the TX callback only hands out pointers from the waveform's run
+ * of blocks; nothing is computed or copied.
+ *
+ * waveform_select may be called from any thread, or a signal handler. The
+ * TX callback picks the new waveform up at the end of the current one's
+ * period, so a waveform is never cut short and no buffer mixes two of them.
+ */
+
+enum waveform_type {
+    WAVEFORM_PRN,       // Gold code, stretched over the buffer
+    WAVEFORM_CHIRP,     // Linear FM sweep across the buffer
+    WAVEFORM_PULSE      // Rectangular pulse at the start of the period
+};
+
+#define WAVEFORM_MAX 16
+
+struct waveform {
+    enum waveform_type type;
+    unsigned int param;     // PRN, chirp sweep (Hz) or pulse width (samples)
+    unsigned int n_blocks;  // Buffers per period
+    size_t       first;     // Its first block in the library's sequence
+};
+
+struct waveform_lib {
+    size_t           samples_per_buffer;
+    struct waveform  waveforms[WAVEFORM_MAX];
+    int              n_waveforms;
+    int16_t*         arena;         // Every distinct block
+    int16_t**        sequence;      // Each waveform's blocks in turn
+    atomic_int       selected;      // Waveform to send from the next period
+    atomic_int       active;        // Waveform being sent
+    size_t           pos;           // Next block of its period
+};
+
+/*
+ * Parse a comma separated list of waveforms into waveforms: "prn:N",
+ * "chirp:BW" with the sweep in Hz, or "pulse:WIDTH[:BUFFERS]" with the
+ * width in TX samples, repeating every BUFFERS buffers (default 1).
+ * Returns how many there are, or 0 if the list is not valid.
+ */
+int waveform_parse(const char* arg, struct waveform* waveforms, int max);
+
+/* Format a waveform the way waveform_parse reads it */
+void waveform_describe(const struct waveform* waveform, char* str,
+                       size_t size);
+
+/*
+ * Build n waveforms for buffers of samples_per_buffer samples at sample
+ * rate sr, with peaks of amplitude. The first is selected. Returns NULL
+ * if out of memory or a waveform does not fit (errno EINVAL).
+ */
+struct waveform_lib* waveform_lib_create(const struct waveform* waveforms,
+                                         int n, size_t samples_per_buffer,
+                                         unsigned int sr, int16_t amplitude);
+void waveform_lib_destroy(struct waveform_lib* lib);
+
+/* Switch to waveform index at the end of the current period */
+static inline void waveform_select(struct waveform_lib* lib, int index)
+{
+    if(index >= 0 && index < lib->n_waveforms)
+        atomic_store_explicit(&lib->selected, index, memory_order_relaxed);
+}
+
+/* The waveform being sent */
+static inline const struct waveform* waveform_active(struct waveform_lib* lib)
+{
+    return &lib->waveforms[atomic_load_explicit(&lib->active,
+                                                memory_order_relaxed)];
+}
+
+/*
+ * Next buffer to send, for the TX callback only. The blocks never change
+ * once built, so only the index needs to be atomic.
+ */
+static inline void* waveform_next(struct waveform_lib* lib)
+{
+    const struct waveform* w;
+    void* block;
+    int index;
+
+    if(lib->pos == 0) {
+        index = atomic_load_explicit(&lib->selected, memory_order_relaxed);
+        atomic_store_explicit(&lib->active, index, memory_order_relaxed);
+    } else {
+        index = atomic_load_explicit(&lib->active, memory_order_relaxed);
+    }
+    w = &lib->waveforms[index];
+
+    block = lib->sequence[w->first + lib->pos];
+    lib->pos = (lib->pos + 1) % w->n_blocks;
+    return block;
+}
+
+#endif
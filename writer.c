@@ -0,0 +1,333 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "writer.h"
+#include "convert.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+#define WRITER_IOV (IOV_MAX < 64 ? IOV_MAX : 64)
+
+static char zeros[WRITER_ALIGN];
+
+// Gathers the pieces of one writer_write call for writev
+struct gather {
+    struct iovec iov[WRITER_IOV];
+    int          n;
+};
+
+
+static int write_all(int fd, const char* data, size_t len)
+{
+    ssize_t rv;
+
+    while(len) {
+        rv = write(fd, data, len);
+        if(rv < 0) {
+            if(errno == EINTR)
+                continue;
+            return 1;
+        }
+        data += rv;
+        len -= rv;
+    }
+
+    return 0;
+}
+
+
+static int writev_all(int fd, struct iovec* iov, int iovcnt)
+{
+    ssize_t rv;
+
+    while(iovcnt) {
+        rv = writev(fd, iov, iovcnt);
+        if(rv < 0) {
+            if(errno == EINTR)
+                continue;
+            return 1;
+        }
+        // Skip whatever was written, which may end part way into an iovec
+        while(iovcnt && (size_t)rv >= iov->iov_len) {
+            rv -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if(iovcnt) {
+            iov->iov_base = (char*)iov->iov_base + rv;
+            iov->iov_len -= rv;
+        }
+    }
+
+    return 0;
+}
+
+
+static int writer_stage(struct writer* writer, const char* data, size_t len)
+{
+    size_t chunk;
+
+    while(len) {
+        chunk = WRITER_STAGE_SIZE - writer->stage_fill;
+        if(chunk > len)
+            chunk = len;
+        memcpy(writer->stage + writer->stage_fill, data, chunk);
+        writer->stage_fill += chunk;
+        data += chunk;
+        len -= chunk;
+
+        if(writer->stage_fill == WRITER_STAGE_SIZE) {
+            if(write_all(writer->fd, writer->stage, WRITER_STAGE_SIZE))
+                return 1;
+            writer->stage_fill = 0;
+        }
+    }
+
+    return 0;
+}
+
+
+static int writer_flush(struct writer* writer, struct gather* g)
+{
+    int n = g->n;
+
+    g->n = 0;
+    return n ? writev_all(writer->fd, g->iov, n) : 0;
+}
+
+
+// Stage data, or queue it for writev; it must stay put until flushed
+static int writer_emit(struct writer* writer, struct gather* g,
+                       const void* data, size_t len)
+{
+    writer->offset += len;
+    if(writer->direct)
+        return writer_stage(writer, data, len);
+
+    g->iov[g->n].iov_base = (void*)data;
+    g->iov[g->n].iov_len = len;
+    g->n++;
+    return g->n == WRITER_IOV ? writer_flush(writer, g) : 0;
+}
+
+
+// Zero pad the last frame out to the next WRITER_ALIGN boundary
+static int writer_end_frame(struct writer* writer, struct gather* g)
+{
+    size_t pad = -writer->offset & (WRITER_ALIGN - 1);
+
+    writer->frame_fill = 0;
+    return pad ? writer_emit(writer, g, zeros, pad) : 0;
+}
+
+
+static int writer_begin_frame(struct writer* writer, uint64_t sample)
+{
+    struct capture_header* h = &writer->header;
+    struct capture_index* entry;
+    struct capture_index* index;
+
+    if(h->n_frames == writer->max_index) {
+        index = realloc(writer->index, 2 * writer->max_index *
+                                       sizeof(struct capture_index));
+        if(!index) {
+            errno = ENOMEM;
+            return 1;
+        }
+        writer->index = index;
+        writer->max_index *= 2;
+    }
+
+    entry = &writer->index[h->n_frames++];
+    entry->offset = writer->offset;
+    entry->sample = sample;
+    entry->n_samples = 0;
+    // Split so that sample * 1e9 cannot overflow on long recordings
+    entry->time = h->start_time + sample / h->rx_sr * 1000000000ULL +
+                  sample % h->rx_sr * 1000000000ULL / h->rx_sr;
+
+    return 0;
+}
+
+
+int writer_open(struct writer* writer, const char* filename, bool direct,
+                const struct capture_header* header)
+{
+    struct gather g = { .n = 0 };
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    char page[WRITER_ALIGN];
+
+    writer->stage = NULL;
+    writer->stage_fill = 0;
+    writer->packed = NULL;
+    writer->packed_size = 0;
+    writer->bytes_written = 0;
+    writer->offset = 0;
+    writer->frame_fill = 0;
+    writer->direct = direct;
+    writer->header = *header;
+    writer->header.n_frames = 0;
+    writer->header.index_offset = 0;
+
+    writer->max_index = 64;
+    writer->index = malloc(writer->max_index * sizeof(struct capture_index));
+    if(!writer->index) {
+        errno = ENOMEM;
+        return 1;
+    }
+
+    if(direct) {
+        if(posix_memalign((void**)&writer->stage, WRITER_ALIGN,
+                          WRITER_STAGE_SIZE)) {
+            free(writer->index);
+            errno = ENOMEM;
+            return 1;
+        }
+        flags |= O_DIRECT;
+    }
+
+    writer->fd = open(filename, flags, 0644);
+    if(writer->fd < 0) {
+        free(writer->stage);
+        free(writer->index);
+        writer->stage = NULL;
+        return 1;
+    }
+
+    memset(page, 0, sizeof(page));
+    memcpy(page, &writer->header, sizeof(writer->header));
+    if(writer_emit(writer, &g, page, sizeof(page)) ||
+       writer_flush(writer, &g)) {
+        writer_close(writer);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+// Pack n buffers of samples each into writer->packed, growing it to fit
+static int writer_pack(struct writer* writer, void* const* buffers, size_t n,
+                       size_t samples)
+{
+    size_t len = samples * capture_sample_size(CAPTURE_FORMAT_SC12), i;
+    uint8_t* packed;
+
+    if(n * len > writer->packed_size) {
+        packed = realloc(writer->packed, n * len);
+        if(!packed) {
+            errno = ENOMEM;
+            return 1;
+        }
+        writer->packed = packed;
+        writer->packed_size = n * len;
+    }
+    for(i=0; i<n; i++)
+        sc16_to_sc12(buffers[i], writer->packed + i * len, samples);
+
+    return 0;
+}
+
+
+int writer_write(struct writer* writer, void* const* buffers, size_t n,
+                 size_t len, uint64_t sample)
+{
+    struct gather g = { .n = 0 };
+    bool packed = writer->header.format == CAPTURE_FORMAT_SC12;
+    size_t i, samples = len / (2 * sizeof(int16_t));
+    uint64_t frame_len, next;
+    struct capture_index* last;
+    const void* data;
+
+    if(packed) {
+        if(writer_pack(writer, buffers, n, samples))
+            return 1;
+        len = samples * capture_sample_size(CAPTURE_FORMAT_SC12);
+    }
+    frame_len = writer->header.frame_samples *
+                capture_sample_size(writer->header.format);
+
+    for(i=0; i<n; i++, sample += samples) {
+        if(writer->frame_fill) {
+            last = &writer->index[writer->header.n_frames - 1];
+            next = last->sample + last->n_samples;
+            if((next != sample || writer->frame_fill + len > frame_len) &&
+               writer_end_frame(writer, &g))
+                return 1;
+        }
+        if(!writer->frame_fill && writer_begin_frame(writer, sample))
+            return 1;
+
+        data = packed ? writer->packed + i * len : buffers[i];
+        if(writer_emit(writer, &g, data, len))
+            return 1;
+        writer->frame_fill += len;
+        writer->index[writer->header.n_frames - 1].n_samples += samples;
+    }
+
+    if(writer_flush(writer, &g))
+        return 1;
+
+    writer->bytes_written += (uint64_t)n * len;
+    return 0;
+}
+
+
+int writer_close(struct writer* writer)
+{
+    struct gather g = { .n = 0 };
+    char page[WRITER_ALIGN];
+    size_t aligned, tail;
+    int status = 0;
+
+    // The index starts on a boundary of its own after the last frame
+    status = writer_end_frame(writer, &g);
+    writer->header.index_offset = writer->offset;
+    if(!status)
+        status = writer_emit(writer, &g, writer->index,
+                             writer->header.n_frames *
+                             sizeof(struct capture_index));
+    if(!status)
+        status = writer_flush(writer, &g);
+
+    if(!status && writer->direct && writer->stage_fill) {
+        // O_DIRECT needs whole blocks, so write the last partial block
+        // through the page cache instead.
+        aligned = writer->stage_fill & ~(size_t)(WRITER_ALIGN - 1);
+        tail = writer->stage_fill - aligned;
+        if(aligned && write_all(writer->fd, writer->stage, aligned))
+            status = 1;
+        if(!status && tail) {
+            fcntl(writer->fd, F_SETFL,
+                  fcntl(writer->fd, F_GETFL) & ~O_DIRECT);
+            status = write_all(writer->fd, writer->stage + aligned, tail);
+        }
+    }
+
+    // Rewrite the header now the frames and index are there to find
+    if(!status) {
+        fcntl(writer->fd, F_SETFL, fcntl(writer->fd, F_GETFL) & ~O_DIRECT);
+        memset(page, 0, sizeof(page));
+        memcpy(page, &writer->header, sizeof(writer->header));
+        if(pwrite(writer->fd, page, sizeof(page), 0) != sizeof(page))
+            status = 1;
+    }
+
+    if(close(writer->fd))
+        status = 1;
+    free(writer->stage);
+    free(writer->index);
+    free(writer->packed);
+    writer->stage = NULL;
+    writer->index = NULL;
+    writer->packed = NULL;
+
+    return status;
+}
@@ -0,0 +1,62 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "capture.h"
+
+/*
+ * Capture file writer (see capture.h), used for frames and long recordings.
+ *
+ * Buffers are written in batches with writev, straight from the stream
+ * buffers. With O_DIRECT they are instead gathered into an aligned staging
+ * buffer and written in WRITER_STAGE_SIZE blocks, bypassing the page cache
+ * so a long recording does not evict everything else from memory.
+ *
+ * SC12 captures are packed into a buffer of the writer's own on the way,
+ * which grows to fit the largest batch written.
+ *
+ * The frame index is kept in memory until the file is closed, one entry
+ * per frame_samples samples written.
+ */
+
+#define WRITER_ALIGN      CAPTURE_ALIGN
+#define WRITER_STAGE_SIZE (4 << 20)
+
+struct writer {
+    int      fd;
+    bool     direct;
+    char*    stage;         // O_DIRECT staging buffer, WRITER_ALIGN aligned
+    size_t   stage_fill;
+    uint8_t* packed;        // SC12: one batch, packed
+    size_t   packed_size;
+    uint64_t bytes_written; // Sample bytes, leaving out headers and padding
+    uint64_t offset;        // Where the next byte will land in the file
+    struct capture_header header;
+    struct capture_index* index;
+    size_t   max_index;
+    uint64_t frame_fill;    // Bytes in the last frame, 0 once it is padded
+};
+
+/*
+ * Create filename and write header, taking only its settings,
+ * frame_samples, start_time and format. Returns 0 on success, 1 on failure with
+ * errno set.
+ */
+int writer_open(struct writer* writer, const char* filename, bool direct,
+                const struct capture_header* header);
+
+/*
+ * Write n buffers of len bytes of SC16 samples each, the first starting at
+ * sample number sample and the rest following on from it. A new frame is
+ * started when the current one is full or sample does not follow on from
+ * it.
+ */
+int writer_write(struct writer* writer, void* const* buffers, size_t n,
+                 size_t len, uint64_t sample);
+
+/* Pad the last frame, write the index and header, and close the file */
+int writer_close(struct writer* writer);
+
+#endif